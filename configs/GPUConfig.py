@@ -27,6 +27,7 @@
 # Authors: Jason Power, Joel Hestness
 
 import m5
+import math
 import os
 import re
 from m5.objects import *
@@ -52,6 +53,7 @@ def addGPUOptions(parser):
     parser.add_option("--gpu-core-clock", default='700MHz', help="The frequency of GPU clusters (note: shaders operate at double this frequency when modeling Fermi)")
     parser.add_option("--access-host-pagetable", action="store_true", default=False)
     parser.add_option("--split", default=False, action="store_true", help="Use split CPU and GPU cache hierarchies instead of fusion")
+    parser.add_option("--gpu_direct_segment", default=False, action="store_true", help="In split hierarchies, translate GPU memory as a direct segment instead of through the GPU TLBs")
     parser.add_option("--dev-numa-high-bit", type="int", default=0, help="High order address bit to use for device NUMA mapping.")
     parser.add_option("--num-dev-dirs", default=1, help="In split hierarchies, number of device directories", type="int")
     parser.add_option("--gpu-mem-size", default='1GB', help="In split hierarchies, amount of GPU memory")
@@ -61,12 +63,33 @@ def addGPUOptions(parser):
     parser.add_option("--gpu_membank_busy_time", type="string", default=None, help="GPU memory bank busy time in ns (CL+tRP+tRCD+CAS)")
     parser.add_option("--gpu_warp_size", type="int", default=32, help="Number of threads per warp, also functional units per shader core/SM")
     parser.add_option("--gpu_atoms_per_subline", type="int", default=None, help="Maximum atomic ops to send per subline per access")
+    parser.add_option("--gpu_coalescing", type="choice", choices=['Fermi', 'Sectored'], default='Fermi', help="Rules for coalescing warp memory requests: Fermi segments or Maxwell/Pascal-style sectors")
+    parser.add_option("--gpu_sector_bytes", type="int", default=32, help="Bytes per cache line sector (subline) for coalescing")
+    parser.add_option("--gpu_lsq_mshr_entries", type="int", default=0, help="Lines each LSQ may have outstanding to the L1. 0 implies unlimited")
+    parser.add_option("--gpu_lsq_mshr_merges", type="int", default=0, help="Loads that may merge into each outstanding LSQ load. 0 serializes all accesses to a line")
+    parser.add_option("--gpu_membar_scope", type="choice", choices=['CTA', 'GPU', 'System'], default='GPU', help="Scope of membar fences: threads of the CTA, the GPU or the whole system")
+    parser.add_option("--gpu_lsq_dispatch_width", type="int", default=1, help="Warp memory instructions each LSQ can accept per cycle (the GPGPU-Sim core sends at most 1)")
+    parser.add_option("--gpu_lsq_inject_policy", type="choice", choices=['FIFO', 'OldestWarpFirst', 'RoundRobin', 'GreedyThenOldest', 'SliceLocality'], default='FIFO', help="Arbitration between LSQ accesses ready to inject into the L1")
+    parser.add_option("--gpu_lsq_read_eject_width", type="int", default=1, help="Load and atomic responses each LSQ can receive per cycle")
+    parser.add_option("--gpu_lsq_write_eject_width", type="int", default=0, help="Store acks each LSQ can receive per cycle. 0 implies unlimited")
+    parser.add_option("--gpu_lsq_response_bytes", type="int", default=0, help="Bytes of read data each LSQ returns to the core per cycle, in whole sectors. 0 implies unlimited")
     parser.add_option("--gpu_threads_per_core", type="int", default=1536, help="Maximum number of threads per GPU core (SM)")
     parser.add_option("--gpgpusim-config", type="string", default=None, help="Path to the gpgpusim.config to use. This overrides the gpgpusim.config template")
     parser.add_option("--gpu-l2-resource-stalls", action="store_true", default=False)
     parser.add_option("--gpu_tlb_entries", type="int", default=0, help="Number of entries in GPU TLB. 0 implies infinite")
     parser.add_option("--gpu_tlb_assoc", type="int", default=0, help="Associativity of the L1 TLB. 0 implies infinite")
+    parser.add_option("--gpu_tlb_entries_2mb", type="int", default=0, help="Number of 2MB page entries in GPU TLB. 0 splinters 2MB pages into 4KB entries")
+    parser.add_option("--gpu_tlb_entries_1gb", type="int", default=0, help="Number of 1GB page entries in GPU TLB. 0 splinters 1GB pages into smaller entries")
+    parser.add_option("--gpu_tlb_replacement", type="choice", choices=['LRU', 'TreePLRU', 'NRU'], default='LRU', help="Replacement policy of the set-associative GPU TLBs")
+    parser.add_option("--gpu_tlb_lookup_ports", type="int", default=0, help="Number of lookups per cycle in each GPU L1 data TLB. 0 implies unlimited")
+    parser.add_option("--gpu_cluster_tlb_entries", type="int", default=0, help="Number of entries in the TLB shared by the SMs of each cluster. 0 implies no cluster TLBs")
+    parser.add_option("--gpu_cluster_tlb_assoc", type="int", default=8, help="Associativity of the cluster TLBs. 0 implies fully associative")
+    parser.add_option("--gpu_cluster_tlb_latency", type="int", default=8, help="Round trip latency in GPU cycles from the L1 TLBs to the cluster TLBs")
+    parser.add_option("--gpu_cluster_tlb_lookup_ports", type="int", default=0, help="Number of lookups per cycle in each cluster TLB. 0 implies unlimited")
     parser.add_option("--pwc_size", default="8kB", help="Capacity of the page walk cache")
+    parser.add_option("--gpu_pwc_pml4_entries", type="int", default=0, help="Number of PML4 entries in the GPU MMU's page walk cache")
+    parser.add_option("--gpu_pwc_pdp_entries", type="int", default=0, help="Number of PDP entries in the GPU MMU's page walk cache")
+    parser.add_option("--gpu_pwc_pd_entries", type="int", default=0, help="Number of PD entries in the GPU MMU's page walk cache. If all PWC levels are 0, the MMU does not walk natively")
     parser.add_option("--ce_buffering", type="int", default=128, help="Maximum cache lines buffered in the GPU CE. 0 implies infinite")
 
 def configureMemorySpaces(options):
@@ -159,6 +182,8 @@ def parseGpgpusimConfig(options):
         gpgpu_n_cores_per_cluster = int(config[start:end])
         num_sc = gpgpu_n_clusters * gpgpu_n_cores_per_cluster
         options.num_sc = num_sc
+        options.clusters = gpgpu_n_clusters
+        options.cores_per_cluster = gpgpu_n_cores_per_cluster
         start = config.find("-gpgpu_clock_domains ") + len("-gpgpu_clock_domains ")
         end = config.find(':', start)
         options.gpu_core_clock = config[start:end] + "MHz"
@@ -196,6 +221,7 @@ def createGPU(options, gpu_mem_range):
     # the GPU clock frequency dynamically.
     gpu = CudaGPU(warp_size = options.gpu_warp_size,
                   manage_gpu_memory = options.split,
+                  direct_segment = options.gpu_direct_segment,
                   clk_domain = SrcClockDomain(clock = options.gpu_core_clock,
                                               voltage_domain = VoltageDomain()),
                   gpu_memory_range = gpu_mem_range)
@@ -213,7 +239,8 @@ def createGPU(options, gpu_mem_range):
                                 voltage_domain = gpu.clk_domain.voltage_domain))
 
     warps_per_core = options.gpu_threads_per_core / options.gpu_warp_size
-    gpu.shader_cores = [CudaCore(id = i, warp_contexts = warps_per_core)
+    gpu.shader_cores = [CudaCore(id = i, warp_contexts = warps_per_core,
+                                 membar_scope = options.gpu_membar_scope)
                             for i in xrange(options.num_sc)]
 
     gpu.ce = GPUCopyEngine(driver_delay = 5000000,
@@ -231,13 +258,34 @@ def createGPU(options, gpu_mem_range):
         if options.gpu_core_config == 'Maxwell':
             atoms_per_cache_subline = 32
 
+    gpu.shader_mmu.pwc_pml4_entries = options.gpu_pwc_pml4_entries
+    gpu.shader_mmu.pwc_pdp_entries = options.gpu_pwc_pdp_entries
+    gpu.shader_mmu.pwc_pd_entries = options.gpu_pwc_pd_entries
+
     for sc in gpu.shader_cores:
         sc.lsq = ShaderLSQ()
         sc.lsq.data_tlb.entries = options.gpu_tlb_entries
+        sc.lsq.data_tlb.entries_2mb = options.gpu_tlb_entries_2mb
+        sc.lsq.data_tlb.entries_1gb = options.gpu_tlb_entries_1gb
+        sc.lsq.data_tlb.replacement_policy = options.gpu_tlb_replacement
+        sc.lsq.data_tlb.lookup_ports = options.gpu_tlb_lookup_ports
         sc.lsq.forward_flush = (buildEnv['PROTOCOL'] == 'VI_hammer_fusion' \
                                 and options.flush_kernel_end)
         sc.lsq.warp_size = options.gpu_warp_size
         sc.lsq.cache_line_size = options.cacheline_size
+        sc.lsq.subline_bytes = options.gpu_sector_bytes
+        sc.lsq.coalescing_rules = options.gpu_coalescing
+        sc.lsq.mshr_entries = options.gpu_lsq_mshr_entries
+        sc.lsq.mshr_merge_capacity = options.gpu_lsq_mshr_merges
+        sc.lsq.dispatch_width = options.gpu_lsq_dispatch_width
+        sc.lsq.inject_policy = options.gpu_lsq_inject_policy
+        # Select the L2 slice of an access as the Ruby protocols select the
+        # GPU L2 bank: log2(num_l2caches) bits above the cache line offset
+        sc.lsq.l2_slices = options.num_l2caches
+        sc.lsq.l2_select_num_bits = int(math.log(options.num_l2caches, 2))
+        sc.lsq.read_eject_width = options.gpu_lsq_read_eject_width
+        sc.lsq.write_eject_width = options.gpu_lsq_write_eject_width
+        sc.lsq.response_bytes_per_cycle = options.gpu_lsq_response_bytes
         if atoms_per_cache_subline is not None:
             sc.lsq.atoms_per_subline = atoms_per_cache_subline
         if options.gpu_threads_per_core % options.gpu_warp_size:
@@ -254,6 +302,18 @@ def createGPU(options, gpu_mem_range):
             sc.lsq.l1_tag_cycles = 1
             sc.lsq.latency = 6
 
+    if options.gpu_cluster_tlb_entries > 0:
+        # GPGPU-Sim numbers SMs consecutively within each cluster
+        gpu.cluster_tlbs = [ClusterTLB(entries = options.gpu_cluster_tlb_entries,
+                                associativity = options.gpu_cluster_tlb_assoc,
+                                replacement_policy = options.gpu_tlb_replacement,
+                                latency = options.gpu_cluster_tlb_latency,
+                                lookup_ports = options.gpu_cluster_tlb_lookup_ports)
+                            for i in xrange(options.clusters)]
+        for i,sc in enumerate(gpu.shader_cores):
+            cluster = i / options.cores_per_cluster
+            sc.lsq.data_tlb.cluster_tlb = gpu.cluster_tlbs[cluster]
+
     # This is a stop-gap solution until we implement a better way to register device memory
     if options.access_host_pagetable:
         gpu.access_host_pagetable = True
@@ -0,0 +1,53 @@
+# Copyright (c) 2011 Mark D. Hill and David A. Wood
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are
+# met: redistributions of source code must retain the above copyright
+# notice, this list of conditions and the following disclaimer;
+# redistributions in binary form must reproduce the above copyright
+# notice, this list of conditions and the following disclaimer in the
+# documentation and/or other materials provided with the distribution;
+# neither the name of the copyright holders nor the names of its
+# contributors may be used to endorse or promote products derived from
+# this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+
+
+from m5.params import *
+from m5.proxy import *
+from ClockedObject import ClockedObject
+from ShaderTLB import TLBReplacementPolicy
+
+class ClusterTLB(ClockedObject):
+    type = 'ClusterTLB'
+    cxx_class = 'ClusterTLB'
+    cxx_header = "gpu/cluster_tlb.hh"
+
+    gpu = Param.CudaGPU(Parent.any, "The GPU")
+
+    entries = Param.Int(512, "number of 4KB page entries")
+    entries_2mb = Param.Int(0, "number of fully associative 2MB page " \
+                "entries (0 => 2MB pages are filled as 4KB pages)")
+    entries_1gb = Param.Int(0, "number of fully associative 1GB page " \
+                "entries (0 => 1GB pages are filled as smaller pages)")
+
+    associativity = Param.Int(8, "Associativity of the TLB (0 => full)")
+    replacement_policy = Param.TLBReplacementPolicy('LRU',
+                "Replacement policy for the TLB")
+
+    latency = Param.Cycles(8, "Round trip latency for requests from L1 TLBs")
+    lookup_ports = Param.Unsigned(0, "number of lookups that can start " \
+                "per cycle (0 => unlimited)")
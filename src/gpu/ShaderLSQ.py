@@ -30,6 +30,23 @@ from MemObject import MemObject
 from ShaderTLB import ShaderTLB
 from m5.params import *
 
+# Fermi: 32/64/128B segments by access size, reduced by halves to the sectors
+#        touched
+# Sectored: one access per run of consecutive sectors touched in each line
+#           (Maxwell, Pascal)
+class CoalescingRules(Enum): vals = ['Fermi', 'Sectored']
+
+# Order in which accesses that are ready to inject are sent to the L1:
+# FIFO: inject buffer order, with unblocked accesses first
+# OldestWarpFirst: accesses of the oldest warp instruction first
+# RoundRobin: rotate across warps
+# GreedyThenOldest: keep injecting from the last warp, then the oldest
+# SliceLocality: group accesses to the same L2 slice, then the oldest. With a
+#                single L2 slice, this is the same as OldestWarpFirst
+class InjectArbitration(Enum):
+    vals = ['FIFO', 'OldestWarpFirst', 'RoundRobin', 'GreedyThenOldest',
+            'SliceLocality']
+
 class ShaderLSQ(MemObject):
     type = 'ShaderLSQ'
     cxx_class = 'ShaderLSQ'
@@ -44,13 +61,30 @@ class ShaderLSQ(MemObject):
     control_port = SlavePort("The control port for this LSQ")
 
     inject_width = Param.Int(1, "Max requests sent to L1 per cycle")
-    eject_width = Param.Int(1, "Max cache lines to receive per cycle")
+    read_eject_width = Param.Unsigned(1, "Max load and atomic responses to receive per cycle")
+    write_eject_width = Param.Unsigned(0, "Max store acks to receive per cycle (0 = unlimited)")
+    response_bytes_per_cycle = Param.Unsigned(0, "Read data returned to the core per cycle, in whole sublines (0 = unlimited)")
 
     warp_size = Param.Int(32, "Size of the warp")
     cache_line_size = Param.Int("Cache line size in bytes")
     subline_bytes = Param.Int(32, "Bytes per cache subline (e.g. Fermi = 32")
+    coalescing_rules = Param.CoalescingRules('Fermi', "Rules for coalescing lane requests into cache accesses")
     warp_contexts = Param.Int(48, "Number of warps possible per GPU core")
     num_warp_inst_buffers = Param.Int(64, "Maximum number of in-flight warp instructions")
+    # GPGPU-Sim's core model sends the LSQ at most one warp instruction per
+    # cycle from its single LD/ST unit, so widths above 1 only take effect
+    # with a core model that issues more
+    dispatch_width = Param.Unsigned(1, "Warp instructions that can be dispatched to the LSQ per cycle (e.g. LD/ST units per SM)")
+    mshr_entries = Param.Unsigned(0, "Cache lines with accesses outstanding to the L1 at once (0 = unlimited)")
+    mshr_merge_capacity = Param.Unsigned(0, "Loads that may merge into the outstanding load to each line (0 = serialize all accesses)")
+    inject_policy = Param.InjectArbitration('FIFO', "Arbitration between accesses ready to inject into the L1")
+    # The L2 slice of an access is selected from its physical address as
+    # Ruby's GPU L1 selects the L2 bank (getL2ID): l2_select_num_bits bits
+    # from l2_select_low_bit, modulo l2_slices
+    l2_slices = Param.Unsigned(1, "L2 slices, for SliceLocality arbitration")
+    l2_select_num_bits = Param.Unsigned(0, "Address bits selecting the L2 slice")
+    l2_select_low_bit = Param.Unsigned(0, "Lowest address bit selecting the " \
+                "L2 slice (0 => the bit above the cache line offset)")
     atoms_per_subline = Param.Int(3, "Maximum atomic ops to send per cache subline in a single access (Fermi = 3)")
 
     # Notes: Fermi back-to-back dependent warp load L1 hits are 19 SM cycles
@@ -60,4 +94,5 @@ class ShaderLSQ(MemObject):
 
     # currently only VI_hammer cache protocol supports flushing.
     # In VI_hammer only the L1 is flushed.
-    forward_flush = Param.Bool("Issue a flush all to caches whenever the LSQ is flushed")
+    forward_flush = Param.Bool("Issue a flush all to caches for the " \
+                "kernel-end flush of the shader core")
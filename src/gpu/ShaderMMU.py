@@ -31,9 +31,11 @@ from m5.defines import buildEnv
 from m5.params import *
 from m5.proxy import *
 from m5.util import fatal
-from ClockedObject import ClockedObject
+from MemObject import MemObject
+from ShaderTLB import TLBReplacementPolicy
+from TLBPrefetcher import NextNTLBPrefetcher
 
-class ShaderMMU(ClockedObject):
+class ShaderMMU(MemObject):
     type = 'ShaderMMU'
     cxx_class = 'ShaderMMU'
     cxx_header = "gpu/shader_mmu.hh"
@@ -48,12 +50,51 @@ class ShaderMMU(ClockedObject):
     else:
         fatal('ShaderMMU only supports x86 and ARM architectures currently')
 
+    sys = Param.System(Parent.any, "system the MMU will run on")
+    walk_port = MasterPort("Port for page table reads by the native walker")
+    walk_bypass_l1 = Param.Bool(False, "Whether native walker page table " \
+                "reads bypass the L1 (page walk) cache")
+    pwc_pml4_entries = Param.Int(0, "Number of PML4 entries in the page " \
+                "walk cache")
+    pwc_pdp_entries = Param.Int(0, "Number of PDP entries in the page " \
+                "walk cache")
+    pwc_pd_entries = Param.Int(0, "Number of PD entries in the page walk " \
+                "cache (all 0 => no native walks)")
+
     latency = Param.Int(20, "Round trip latency for requests from L1 TLBs")
+    lookup_ports = Param.Int(0, "Number of L2 TLB lookups per cycle " \
+                "(0 => unlimited)")
 
     l2_tlb_entries = Param.Int(0, "Number of entries in the L2 TLB (0=>no L2)")
+    l2_tlb_entries_2mb = Param.Int(0, "Number of fully associative 2MB " \
+                "page entries in the L2 TLB (0 => filled as 4KB pages)")
+    l2_tlb_entries_1gb = Param.Int(0, "Number of fully associative 1GB " \
+                "page entries in the L2 TLB (0 => filled as smaller pages)")
     l2_tlb_assoc = Param.Int(4, "Associativity of the L2 TLB (0 => full)")
+    l2_tlb_replacement_policy = Param.TLBReplacementPolicy('LRU',
+                "Replacement policy for the L2 TLB")
+
+    checkpoint_translations = Param.Bool(False, "Save and restore the " \
+                "contents of the GPU TLBs and prefetch buffer in checkpoints")
+
+    fault_batch_size = Param.Int(1, "Maximum number of page faults " \
+                "raised to the CPU before retrying their walks")
+
+    max_retry_walkers = Param.Unsigned(0, "Maximum page walkers used by " \
+                "fault retry walks at once (0 => no limit)")
+    max_demand_walkers = Param.Unsigned(0, "Maximum page walkers used by " \
+                "demand walks at once (0 => no limit)")
+    max_prefetch_walkers = Param.Unsigned(0, "Maximum page walkers used by " \
+                "prefetch walks at once (0 => no limit)")
+    walk_starvation_cycles = Param.Cycles(0, "Cycles a waiting walk can be " \
+                "passed over by higher priority walks (0 => no limit)")
 
-    prefetch_buffer_size = Param.Int(0, "Size of the prefetch buffer")
+    prefetch_buffer_size = Param.Int(0, "Size of the prefetch buffer " \
+                "(0 => no prefetching)")
+    prefetch_queue_size = Param.Int(16, "Number of prefetches waiting for " \
+                "an idle walker")
+    prefetcher = Param.TLBPrefetcher(NextNTLBPrefetcher(),
+                "Translation prefetcher")
 
     def setUpPagewalkers(self, num, port, bypass_l1):
         if buildEnv['TARGET_ISA'] == 'arm':
@@ -75,3 +116,7 @@ class ShaderMMU(ClockedObject):
             t.walker.port = port
             tlbs.append(t)
         self.pagewalkers = tlbs
+        if buildEnv['TARGET_ISA'] == 'x86':
+            # The native walker shares the pagewalkers' path to memory
+            self.walk_port = port
+            self.walk_bypass_l1 = bypass_l1
@@ -29,6 +29,8 @@ from m5.params import *
 from m5.proxy import *
 from BaseTLB import BaseTLB
 
+class TLBReplacementPolicy(Enum): vals = ['LRU', 'TreePLRU', 'NRU']
+
 class ShaderTLB(BaseTLB):
     type = 'ShaderTLB'
     cxx_class = 'ShaderTLB'
@@ -39,8 +41,26 @@ class ShaderTLB(BaseTLB):
     gpu = Param.CudaGPU(Parent.any, "The GPU")
 
     entries = Param.Int(0, "number entries in TLB (0 implies infinite)")
+    entries_2mb = Param.Int(0, "number of fully associative 2MB page " \
+                "entries (0 => 2MB pages are filled as 4KB pages)")
+    entries_1gb = Param.Int(0, "number of fully associative 1GB page " \
+                "entries (0 => 1GB pages are filled as smaller pages)")
+
+    associativity = Param.Int(4, "Associativity of the TLB (0 => full)")
+    replacement_policy = Param.TLBReplacementPolicy('LRU',
+                "Replacement policy for set-associative TLBs")
 
-    associativity = Param.Int(4, "Number of sets in the TLB")
+    mshrs = Param.Int(16, "number of outstanding misses to distinct pages")
+    mshr_targets = Param.Int(32, "number of misses merged per MSHR")
 
     hit_latency = Param.Cycles(1, "number of cycles for a hit")
+    lookup_ports = Param.Unsigned(0, "number of lookups that can start " \
+                "per cycle (0 => unlimited)")
+
+    translation_cache_entries = Param.Int(64, "number of direct-mapped " \
+                "GPU page table translations cached when not accessing " \
+                "the host page table (0 => none)")
+
 
+    cluster_tlb = Param.ClusterTLB(NULL, "TLB shared by the SMs of this " \
+                "SM's cluster, looked up before the ShaderMMU on misses")
@@ -0,0 +1,56 @@
+# Copyright (c) 2012 Mark D. Hill and David A. Wood
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are
+# met: redistributions of source code must retain the above copyright
+# notice, this list of conditions and the following disclaimer;
+# redistributions in binary form must reproduce the above copyright
+# notice, this list of conditions and the following disclaimer in the
+# documentation and/or other materials provided with the distribution;
+# neither the name of the copyright holders nor the names of its
+# contributors may be used to endorse or promote products derived from
+# this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+from m5.params import *
+from m5.SimObject import SimObject
+
+class TLBPrefetcher(SimObject):
+    type = 'TLBPrefetcher'
+    abstract = True
+    cxx_class = 'TLBPrefetcher'
+    cxx_header = "gpu/tlb_prefetcher.hh"
+
+    degree = Param.Int(1, "Maximum number of pages to prefetch per miss")
+
+class NextNTLBPrefetcher(TLBPrefetcher):
+    type = 'NextNTLBPrefetcher'
+    cxx_class = 'NextNTLBPrefetcher'
+    cxx_header = "gpu/tlb_prefetcher.hh"
+
+class StrideTLBPrefetcher(TLBPrefetcher):
+    type = 'StrideTLBPrefetcher'
+    cxx_class = 'StrideTLBPrefetcher'
+    cxx_header = "gpu/tlb_prefetcher.hh"
+
+    confidence_threshold = Param.Int(2, "Number of times a stride must " \
+                "repeat before prefetching along it")
+
+class DistanceTLBPrefetcher(TLBPrefetcher):
+    type = 'DistanceTLBPrefetcher'
+    cxx_class = 'DistanceTLBPrefetcher'
+    cxx_header = "gpu/tlb_prefetcher.hh"
+
+    table_entries = Param.Int(64, "Number of entries in the distance table")
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2013 Mark D. Hill and David A. Wood
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer;
+ * redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution;
+ * neither the name of the copyright holders nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ADDR_HASH_TABLE_HH_
+#define ADDR_HASH_TABLE_HH_
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "base/intmath.hh"
+#include "base/types.hh"
+
+/**
+ * Flat open-addressing hash table keyed by address (e.g. page base). Entries
+ * live in a single power of 2 sized array and are probed linearly from the
+ * key's hashed slot. Erase shifts later entries of the probe run back into
+ * the hole, so no tombstones are needed and probe runs stay short. The table
+ * doubles when it becomes half full, so sizing it for the expected number of
+ * entries up front avoids all allocation on insert, find and erase.
+ *
+ * NOTE: Pointers returned by find() are invalidated by insert() and erase().
+ */
+template <class Value>
+class AddrHashTable
+{
+  public:
+    // Reserved key marking an empty slot. Never a valid page base.
+    static const Addr emptyKey = (Addr)-1;
+
+  private:
+    struct Slot {
+        Addr key;
+        Value value;
+    };
+
+    std::vector<Slot> slots;
+    unsigned logCapacity;
+    unsigned numEntries;
+
+    // Fibonacci hashing: take the top bits of the key times 2^64/phi, which
+    // spreads page-aligned keys whose low bits are all zero
+    unsigned homeSlot(Addr key) const
+    {
+        return (key * ULL(0x9e3779b97f4a7c15)) >> (64 - logCapacity);
+    }
+
+    unsigned nextSlot(unsigned slot) const
+    {
+        return (slot + 1) & (slots.size() - 1);
+    }
+
+    int findSlot(Addr key) const
+    {
+        unsigned slot = homeSlot(key);
+        while (slots[slot].key != emptyKey) {
+            if (slots[slot].key == key) {
+                return slot;
+            }
+            slot = nextSlot(slot);
+        }
+        return -1;
+    }
+
+    void resize(unsigned log_capacity)
+    {
+        std::vector<Slot> old_slots;
+        old_slots.swap(slots);
+        logCapacity = log_capacity;
+        Slot empty = { emptyKey, Value() };
+        slots.assign(1 << logCapacity, empty);
+        numEntries = 0;
+        for (int i = 0; i < old_slots.size(); i++) {
+            if (old_slots[i].key != emptyKey) {
+                insert(old_slots[i].key, old_slots[i].value);
+            }
+        }
+    }
+
+  public:
+    /// Table that holds at least min_entries without growing
+    AddrHashTable(unsigned min_entries = 8) : logCapacity(0), numEntries(0)
+    {
+        resize(ceilLog2(std::max(2 * min_entries, 2U)));
+    }
+
+    unsigned size() const { return numEntries; }
+    bool empty() const { return numEntries == 0; }
+
+    Value *find(Addr key)
+    {
+        int slot = findSlot(key);
+        return (slot < 0) ? NULL : &slots[slot].value;
+    }
+
+    /// Insert a key that is not already in the table
+    Value *insert(Addr key, const Value &value)
+    {
+        assert(key != emptyKey);
+        assert(findSlot(key) < 0);
+        if (2 * (numEntries + 1) > slots.size()) {
+            resize(logCapacity + 1);
+        }
+        unsigned slot = homeSlot(key);
+        while (slots[slot].key != emptyKey) {
+            slot = nextSlot(slot);
+        }
+        slots[slot].key = key;
+        slots[slot].value = value;
+        numEntries++;
+        return &slots[slot].value;
+    }
+
+    /// Remove key from the table, returning whether it was present
+    bool erase(Addr key)
+    {
+        int found = findSlot(key);
+        if (found < 0) {
+            return false;
+        }
+        // Backward shift: move each later entry of the run whose home slot
+        // is not cyclically between the hole and itself into the hole
+        unsigned hole = found;
+        unsigned slot = nextSlot(hole);
+        while (slots[slot].key != emptyKey) {
+            unsigned home = homeSlot(slots[slot].key);
+            bool stays = (hole <= slot) ? (hole < home && home <= slot)
+                                        : (hole < home || home <= slot);
+            if (!stays) {
+                slots[hole] = slots[slot];
+                hole = slot;
+            }
+            slot = nextSlot(slot);
+        }
+        slots[hole].key = emptyKey;
+        slots[hole].value = Value();
+        numEntries--;
+        return true;
+    }
+
+    /// Call f(key, value) for every entry, in no particular order
+    template <class Func>
+    void forEach(Func f) const
+    {
+        for (int i = 0; i < slots.size(); i++) {
+            if (slots[i].key != emptyKey) {
+                f(slots[i].key, slots[i].value);
+            }
+        }
+    }
+
+    /// Remove all entries, keeping the current capacity
+    void clear()
+    {
+        Slot empty = { emptyKey, Value() };
+        slots.assign(slots.size(), empty);
+        numEntries = 0;
+    }
+
+    /// Remove all entries for which pred(key, value) holds, returning how
+    /// many were removed. Rebuilds the table in place at the same capacity.
+    template <class Pred>
+    unsigned eraseIf(Pred pred)
+    {
+        std::vector<Slot> old_slots(slots);
+        unsigned old_entries = numEntries;
+        clear();
+        for (int i = 0; i < old_slots.size(); i++) {
+            if (old_slots[i].key != emptyKey &&
+                !pred(old_slots[i].key, old_slots[i].value)) {
+                insert(old_slots[i].key, old_slots[i].value);
+            }
+        }
+        return old_entries - numEntries;
+    }
+};
+
+#endif // ADDR_HASH_TABLE_HH_
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2011 Mark D. Hill and David A. Wood
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer;
+ * redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution;
+ * neither the name of the copyright holders nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "debug/ClusterTLB.hh"
+#include "gpu/cluster_tlb.hh"
+#include "gpu/gpgpu-sim/cuda_gpu.hh"
+#include "gpu/shader_mmu.hh"
+
+ClusterTLB::ClusterTLB(const Params *p) :
+    ClockedObject(p), cudaGPU(p->gpu), latency(p->latency),
+    lookupPorts(p->lookup_ports), lookupEvent(this)
+{
+    if (p->entries <= 0) {
+        fatal("%s: cluster TLBs need at least one 4KB page entry\n", name());
+    }
+    int entries[NumGPUPageSizes] =
+        { p->entries, p->entries_2mb, p->entries_1gb };
+    tlbMemory = new MultiPageTLBMemory(entries, p->associativity,
+                                       p->replacement_policy);
+    mmu = cudaGPU->getMMU();
+    mmu->registerClusterTLB(this);
+}
+
+ClusterTLB::~ClusterTLB()
+{
+    delete tlbMemory;
+}
+
+void
+ClusterTLB::beginTLBMiss(ShaderTLB *req_tlb,
+                         BaseTLB::Translation *translation, RequestPtr req,
+                         BaseTLB::Mode mode, ThreadContext *tc, GPUAsid asid)
+{
+    PendingLookup lookup = { req_tlb, translation, req, mode, tc, asid,
+                             clockEdge(latency) };
+    lookups.push(lookup);
+    if (!lookupEvent.scheduled()) {
+        schedule(lookupEvent, lookup.readyTick);
+    }
+}
+
+void
+ClusterTLB::processLookups()
+{
+    assert(!lookups.empty());
+
+    unsigned started = 0;
+    while (!lookups.empty() && lookups.front().readyTick <= curTick()) {
+        if (lookupPorts > 0 && started == lookupPorts) {
+            lookupPortStalls++;
+            break;
+        }
+        PendingLookup lookup = lookups.front();
+        lookups.pop();
+        started++;
+
+        Addr vaddr = lookup.req->getVaddr();
+        Addr paddr;
+        GPUPageSize page_size;
+        if (tlbMemory->lookup(vaddr, lookup.asid, paddr, page_size)) {
+            DPRINTF(ClusterTLB, "Hit for vaddr %#x (ASID %d, %s page). "
+                    "Phys addr %#x.\n", vaddr, lookup.asid,
+                    gpuPageSizeNames[page_size], paddr);
+            hits++;
+            hitsByPageSize[page_size]++;
+            lookup.req->setPaddr(paddr);
+            lookup.reqTLB->insert(vaddr, lookup.asid, paddr, page_size,
+                                  false);
+            lookup.translation->finish(NoFault, lookup.req, lookup.tc,
+                                       lookup.mode);
+        } else {
+            DPRINTF(ClusterTLB, "Miss for vaddr %#x (ASID %d)\n", vaddr,
+                    lookup.asid);
+            misses++;
+            mmu->beginTLBMiss(lookup.reqTLB, lookup.translation, lookup.req,
+                              lookup.mode, lookup.tc, lookup.asid);
+        }
+    }
+    lookupBatchSize.sample(started);
+
+    if (!lookups.empty()) {
+        schedule(lookupEvent, std::max(lookups.front().readyTick,
+                                       clockEdge(Cycles(1))));
+    }
+}
+
+void
+ClusterTLB::regStats()
+{
+    hits
+        .name(name()+".hits")
+        .desc("Number of hits in this TLB")
+        ;
+    misses
+        .name(name()+".misses")
+        .desc("Number of misses in this TLB")
+        ;
+    hitRate
+        .name(name()+".hitRate")
+        .desc("Hit rate for this TLB")
+        ;
+
+    hitRate = hits / (hits + misses);
+
+    hitsByPageSize
+        .init(NumGPUPageSizes)
+        .name(name()+".hitsByPageSize")
+        .desc("Number of hits in this TLB by page size")
+        ;
+    for (int size = 0; size < NumGPUPageSizes; size++) {
+        hitsByPageSize.subname(size, gpuPageSizeNames[size]);
+    }
+
+    lookupPortStalls
+        .name(name()+".lookupPortStalls")
+        .desc("Cycles with arrived misses left waiting for a lookup port")
+        ;
+
+    lookupBatchSize
+        .name(name()+".lookupBatchSize")
+        .desc("Number of misses looked up per lookup cycle")
+        .init(16)
+        ;
+}
+
+ClusterTLB *
+ClusterTLBParams::create()
+{
+    return new ClusterTLB(this);
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2011 Mark D. Hill and David A. Wood
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer;
+ * redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution;
+ * neither the name of the copyright holders nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CLUSTER_TLB_HH_
+#define CLUSTER_TLB_HH_
+
+#include <queue>
+
+#include "arch/generic/tlb.hh"
+#include "base/statistics.hh"
+#include "gpu/shader_tlb.hh"
+#include "params/ClusterTLB.hh"
+#include "sim/clocked_object.hh"
+
+class CudaGPU;
+class ShaderMMU;
+
+/**
+ * A mid-level TLB shared by the L1 TLBs of the SMs in a cluster. L1 TLB
+ * misses (one per L1 MSHR) look up the cluster TLB after latency cycles.
+ * Hits fill the requesting L1 TLB, and misses continue to the ShaderMMU,
+ * which fills the cluster TLB along with the L1 TLB when it translates the
+ * page. Cross-SM merging of misses to the same page is left to the MMU.
+ *
+ * Cluster TLB contents are invalidated by ShaderMMU shootdowns, but are not
+ * checkpointed, so they are cold after a restore.
+ */
+class ClusterTLB : public ClockedObject
+{
+  private:
+    CudaGPU *cudaGPU;
+    ShaderMMU *mmu;
+
+    MultiPageTLBMemory *tlbMemory;
+
+    // Round trip latency for lookups from the L1 TLBs
+    Cycles latency;
+    // Lookups per cycle (0 => unlimited)
+    unsigned lookupPorts;
+
+    struct PendingLookup {
+        ShaderTLB *reqTLB;
+        BaseTLB::Translation *translation;
+        RequestPtr req;
+        BaseTLB::Mode mode;
+        ThreadContext *tc;
+        GPUAsid asid;
+        Tick readyTick;
+    };
+    // Lookups arrive in ready tick order, since all take latency cycles
+    std::queue<PendingLookup> lookups;
+
+    /// Look up all misses that have arrived, up to the number of lookup
+    /// ports, and defer the rest to the next cycle
+    void processLookups();
+    EventWrapper<ClusterTLB, &ClusterTLB::processLookups> lookupEvent;
+
+  public:
+    typedef ClusterTLBParams Params;
+    ClusterTLB(const Params *p);
+    ~ClusterTLB();
+
+    /// Called by an L1 TLB on a miss in place of ShaderMMU::beginTLBMiss
+    void beginTLBMiss(ShaderTLB *req_tlb, BaseTLB::Translation *translation,
+                      RequestPtr req, BaseTLB::Mode mode, ThreadContext *tc,
+                      GPUAsid asid);
+
+    /// Fill a translation made by the ShaderMMU
+    void insert(Addr vaddr, GPUAsid asid, Addr paddr, GPUPageSize size)
+    {
+        tlbMemory->insert(vaddr, asid, paddr, size);
+    }
+
+    /// Invalidations for the ShaderMMU's shootdowns. These return the number
+    /// of TLB entries invalidated.
+    unsigned invalidatePage(Addr vaddr, GPUAsid asid)
+    {
+        return tlbMemory->demapPage(vaddr, asid);
+    }
+    unsigned invalidateAsid(GPUAsid asid)
+    {
+        return tlbMemory->flushAsid(asid);
+    }
+    unsigned invalidateAll() { return tlbMemory->flushAll(); }
+
+    void regStats();
+
+    Stats::Scalar hits;
+    Stats::Scalar misses;
+    Stats::Formula hitRate;
+    Stats::Vector hitsByPageSize;
+    Stats::Scalar lookupPortStalls;
+    Stats::Histogram lookupBatchSize;
+};
+
+#endif /* CLUSTER_TLB_HH_ */
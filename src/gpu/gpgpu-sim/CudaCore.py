@@ -31,6 +31,10 @@ from m5.defines import buildEnv
 from m5.params import *
 from m5.proxy import *
 
+# The threads whose memory accesses a fence orders: those of the warp's CTA,
+# all threads on the GPU, or all threads in the system including the CPU
+class FenceScope(Enum): vals = ['CTA', 'GPU', 'System']
+
 class CudaCore(MemObject):
     type = 'CudaCore'
     cxx_class = 'CudaCore'
@@ -50,3 +54,5 @@ class CudaCore(MemObject):
     id = Param.Int(-1, "ID of the SP")
 
     warp_contexts = Param.Int(48, "Number of warps possible per GPU core")
+
+    membar_scope = Param.FenceScope('GPU', "Scope of membar fences (bar.sync fences are CTA scope)")
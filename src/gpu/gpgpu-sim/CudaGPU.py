@@ -57,6 +57,9 @@ class CudaGPU(ClockedObject):
 
     # When using a segmented physical address space, the SPA can manage memory
     manage_gpu_memory = Param.Bool(False, "Handle all GPU memory allocations in this SPA")
+    direct_segment = Param.Bool(False, "Translate GPU-managed memory as a " \
+                "single direct segment rather than through the GPU TLBs " \
+                "(requires manage_gpu_memory)")
     access_host_pagetable = Param.Bool(False, \
                 "Whether to allow accesses to host page table")
     gpu_memory_range = Param.AddrRange(AddrRange('1kB'), "The address range for the GPU memory space")
@@ -30,6 +30,7 @@
 #include <iostream>
 #include <map>
 
+#include "base/intmath.hh"
 #include "cpu/translation.hh"
 #include "debug/CudaCore.hh"
 #include "debug/CudaCoreAccess.hh"
@@ -47,7 +48,8 @@ CudaCore::CudaCore(const Params *p) :
     lsqControlPort(name() + ".lsq_ctrl_port", this), _params(p),
     dataMasterId(p->sys->getMasterId(name() + ".data")),
     instMasterId(p->sys->getMasterId(name() + ".inst")), id(p->id),
-    itb(p->itb), cudaGPU(p->gpu), maxNumWarpsPerCore(p->warp_contexts)
+    itb(p->itb), cudaGPU(p->gpu), maxNumWarpsPerCore(p->warp_contexts),
+    membarScope(p->membar_scope)
 {
     writebackBlocked = -1; // Writeback is not blocked
 
@@ -71,6 +73,12 @@ CudaCore::CudaCore(const Params *p) :
 
     activeCTAs = 0;
 
+    // CTA flushes name the warps they cover in a 64-bit mask
+    if (maxNumWarpsPerCore > 64) {
+        fatal("%s: At most 64 warp_contexts are supported (got %d)", name(),
+              maxNumWarpsPerCore);
+    }
+
     needsFenceUnblock.resize(maxNumWarpsPerCore);
     for (int i = 0; i < maxNumWarpsPerCore; i++) {
         needsFenceUnblock[i] = false;
@@ -365,11 +373,13 @@ CudaCore::executeMemOp(const warp_inst_t &inst)
                         lane, pkt->req->getVaddr(), *(int*)inst.get_data(lane));
             } else if (inst.op == BARRIER_OP || inst.op == MEMORY_BARRIER_OP) {
                 assert(!inst.isatomic());
-                // Setup Fence packet
-                // TODO: If adding fencing functionality, specify control data
-                // in packet or request
+                // Setup Fence packet, passing the scope of the fence to the
+                // LSQ in the request. Barriers only order memory accesses
+                // among the threads of a CTA
                 RequestPtr req = new Request(asid, 0x0, 0, flags, dataMasterId,
                         inst.pc, id, inst.warp_id());
+                req->setExtraData(inst.op == BARRIER_OP ? Enums::CTA :
+                                                          membarScope);
                 pkt = new Packet(req, MemCmd::FenceReq);
                 pkt->senderState = new SenderState(inst);
             } else {
@@ -470,7 +480,11 @@ CudaCore::recvLSQControlResp(PacketPtr pkt)
 {
     if (pkt->isFlush()) {
         DPRINTF(CudaCoreAccess, "Got flush response\n");
-        if (signalKernelFinish) {
+        // The kernel-end flush completes behind the flushes of all of the
+        // kernel's CTAs, so the kernel ends with it. CTA flushes sent for
+        // the next kernel in the meantime are not waited for
+        if (pkt->cmd == MemCmd::FlushAllResp) {
+            assert(signalKernelFinish);
             shaderImpl->finish_kernel();
             signalKernelFinish = false;
         }
@@ -495,9 +509,27 @@ CudaCore::flush()
     Addr addr(0);
     Request::Flags flags;
     RequestPtr req = new Request(asid, addr, flags, dataMasterId);
+    req->setExtraData(0);
+    PacketPtr pkt = new Packet(req, MemCmd::FlushAllReq);
+
+    DPRINTF(CudaCoreAccess, "Sending kernel-end flush request\n");
+    if (!lsqControlPort.sendTimingReq(pkt)){
+        panic("Flush requests should never fail");
+    }
+}
+
+void
+CudaCore::flushWarps(uint64_t warp_mask)
+{
+    int asid = 0;
+    Addr addr(0);
+    Request::Flags flags;
+    RequestPtr req = new Request(asid, addr, flags, dataMasterId);
+    req->setExtraData(warp_mask);
     PacketPtr pkt = new Packet(req, MemCmd::FlushReq);
 
-    DPRINTF(CudaCoreAccess, "Sending flush request\n");
+    DPRINTF(CudaCoreAccess, "Sending flush request for warps: %#x\n",
+            warp_mask);
     if (!lsqControlPort.sendTimingReq(pkt)){
         panic("Flush requests should never fail");
     }
@@ -508,6 +540,8 @@ CudaCore::finishKernel()
 {
     numKernelsCompleted++;
     signalKernelFinish = true;
+    // Each CTA's warps were flushed as the CTA completed, so the kernel-end
+    // flush only waits for those flushes and then flushes the L1
     flush();
 }
 
@@ -749,6 +783,19 @@ CudaCore::record_block_commit(unsigned hw_cta_id)
     if (activeCTAs == 0) {
         activeCycles += curCycle() - beginActiveCycle;
     }
+
+    // Drain the CTA's outstanding memory instructions without stalling the
+    // other CTAs on this core. GPGPU-Sim assigns each hardware CTA slot the
+    // warps from hw_cta_id * (CTA size padded to whole warps).
+    unsigned cta_threads = shaderImpl->get_kernel()->threads_per_cta();
+    unsigned warps_per_cta = divCeil(cta_threads, warpSize);
+    uint64_t warp_mask = 0;
+    for (unsigned w = 0; w < warps_per_cta; w++) {
+        unsigned warp_id = hw_cta_id * warps_per_cta + w;
+        assert(warp_id < maxNumWarpsPerCore);
+        warp_mask |= ULL(1) << warp_id;
+    }
+    flushWarps(warp_mask);
 }
 
 void CudaCore::printCTAStats(std::ostream& out)
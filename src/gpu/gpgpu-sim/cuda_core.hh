@@ -37,6 +37,7 @@
 #include "cuda-sim/ptx.tab.h"
 #include "cuda-sim/ptx_ir.h"
 #include "cuda-sim/ptx_sim.h"
+#include "enums/FenceScope.hh"
 #include "gpgpu-sim/mem_fetch.h"
 #include "gpgpu-sim/shader.h"
 #include "gpu/atomic_operations.hh"
@@ -217,6 +218,9 @@ class CudaCore : public MemObject
     // the shader (e.g. to unblock warp issue)
     std::vector<bool> needsFenceUnblock;
     unsigned maxNumWarpsPerCore;
+    // The scope of membar fences. GPGPU-Sim's warp instructions do not
+    // carry the membar level, so it is set per core
+    Enums::FenceScope membarScope;
 
     // if true then need to signal GPGPU-Sim once cleanup is done
     bool signalKernelFinish;
@@ -304,11 +308,20 @@ class CudaCore : public MemObject
     void writebackClear();
 
     /**
-     * Flush the core of all pending instructions,
-     * This is currently used to force the LSQ to flush on kernel end
+     * Send the kernel-end flush: it completes once every flush sent before
+     * it has completed, and then flushes the L1 if the LSQ forwards flushes.
+     * It covers no warps itself, so warps of the next kernel keep issuing
      */
     void flush();
 
+    /**
+     * Flush the pending instructions of only the warps set in warp_mask
+     * (e.g. a single warp, or the warps of a CTA). Other warps continue to
+     * issue to the LSQ while the flush drains. Used to flush each CTA as it
+     * completes
+     */
+    void flushWarps(uint64_t warp_mask);
+
     /**
      * Called from GPGPU-Sim when a kernel completes on this shader
      * Must signal back to GPGPU-Sim after all cleanup is done
@@ -36,7 +36,9 @@
 #include "arch/x86/regs/misc.hh"
 #include "arch/utility.hh"
 #include "arch/vtophys.hh"
+#include "base/bitfield.hh"
 #include "base/chunk_generator.hh"
+#include "base/intmath.hh"
 #include "base/statistics.hh"
 #include "cpu/thread_context.hh"
 #include "cuda-sim/cuda-sim.h"
@@ -69,10 +71,12 @@ CudaGPU::CudaGPU(const Params *p) :
     system(p->sys), warpSize(p->warp_size), sharedMemDelay(p->shared_mem_delay),
     gpgpusimConfigPath(p->config_path), unblockNeeded(false), ruby(p->ruby),
     runningTC(NULL), runningStream(NULL), runningTID(-1), runningPTBase(0),
+    runningASID(0),
     clearTick(0), dumpKernelStats(p->dump_kernel_stats), pageTable(),
     manageGPUMemory(p->manage_gpu_memory),
     accessHostPageTable(p->access_host_pagetable),
-    gpuMemoryRange(p->gpu_memory_range), shaderMMU(p->shader_mmu)
+    gpuMemoryRange(p->gpu_memory_range), directSegment(p->direct_segment),
+    shaderMMU(p->shader_mmu)
 {
     // Register this device as a CUDA-enabled GPU
     cudaDeviceID = registerCudaDevice(this);
@@ -99,6 +103,12 @@ CudaGPU::CudaGPU(const Params *p) :
     // Reserve the 0 virtual page for NULL pointers
     virtualGPUBrkAddr = TheISA::PageBytes;
     physicalGPUBrkAddr = gpuMemoryRange.start();
+    if (directSegment && !manageGPUMemory) {
+        fatal("%s: direct_segment requires manage_gpu_memory\n", name());
+    }
+    directSegmentVBase = virtualGPUBrkAddr;
+    directSegmentPBase = physicalGPUBrkAddr;
+    directSegmentLimit = virtualGPUBrkAddr;
 
     // Initialize GPGPU-Sim
     theGPU = gem5_ptx_sim_init_perf(&streamManager, this, getConfigPath());
@@ -161,6 +171,13 @@ void CudaGPU::serialize(CheckpointOut &cp) const
     SERIALIZE_SCALAR(instBaseVaddr);
     SERIALIZE_SCALAR(localBaseVaddr);
 
+    if (directSegment) {
+        // Direct segment pages are not in the page table
+        SERIALIZE_SCALAR(virtualGPUBrkAddr);
+        SERIALIZE_SCALAR(physicalGPUBrkAddr);
+        SERIALIZE_SCALAR(directSegmentLimit);
+    }
+
     SERIALIZE_SCALAR(runningTID);
 
     int numBinaries = fatBinaries.size();
@@ -198,6 +215,19 @@ void CudaGPU::serialize(CheckpointOut &cp) const
         paramOut(cp, csprintf("cudaVars[%d].sim_hostVar", i), var.sim_hostVar);
     }
 
+    // ASIDs tag any GPU translations the ShaderMMU checkpoints
+    unsigned numASIDs = ptBaseASIDs.size();
+    std::vector<Addr> asidPTBases;
+    std::vector<unsigned> asids;
+    std::map<Addr, GPUAsid>::const_iterator asid_it = ptBaseASIDs.begin();
+    for (; asid_it != ptBaseASIDs.end(); asid_it++) {
+        asidPTBases.push_back(asid_it->first);
+        asids.push_back(asid_it->second);
+    }
+    SERIALIZE_SCALAR(numASIDs);
+    arrayParamOut(cp, "asidPTBases", asidPTBases);
+    arrayParamOut(cp, "asids", asids);
+
     pageTable.serialize(cp);
 }
 
@@ -211,6 +241,12 @@ void CudaGPU::unserialize(CheckpointIn &cp)
     UNSERIALIZE_SCALAR(instBaseVaddr);
     UNSERIALIZE_SCALAR(localBaseVaddr);
 
+    if (directSegment) {
+        UNSERIALIZE_SCALAR(virtualGPUBrkAddr);
+        UNSERIALIZE_SCALAR(physicalGPUBrkAddr);
+        UNSERIALIZE_SCALAR(directSegmentLimit);
+    }
+
     UNSERIALIZE_SCALAR(runningTID);
 
     DPRINTF(CudaGPU, "UNSerializing %d, %d\n", m_last_fat_cubin_handle, instBaseVaddr);
@@ -254,6 +290,18 @@ void CudaGPU::unserialize(CheckpointIn &cp)
         paramIn(cp, csprintf("cudaVars[%d].sim_hostVar", i), cudaVars[i].sim_hostVar);
     }
 
+    unsigned numASIDs = 0;
+    if (optParamIn(cp, "numASIDs", numASIDs) && numASIDs > 0) {
+        std::vector<Addr> asidPTBases;
+        std::vector<unsigned> asids;
+        arrayParamIn(cp, "asidPTBases", asidPTBases);
+        arrayParamIn(cp, "asids", asids);
+        assert(asidPTBases.size() == numASIDs && asids.size() == numASIDs);
+        for (unsigned i = 0; i < numASIDs; i++) {
+            ptBaseASIDs[asidPTBases[i]] = asids[i];
+        }
+    }
+
     pageTable.unserialize(cp);
 }
 
@@ -519,6 +567,25 @@ void CudaGPU::finishCopyOperation()
     endStreamOperation();
 }
 
+GPUAsid CudaGPU::getASID(Addr pt_base)
+{
+    std::map<Addr, GPUAsid>::iterator it = ptBaseASIDs.find(pt_base);
+    if (it != ptBaseASIDs.end()) {
+        return it->second;
+    }
+    if (ptBaseASIDs.size() == NumGPUAsids) {
+        // Out of ASIDs: Drop all translations so ASIDs can be reassigned
+        DPRINTF(CudaGPU, "ASIDs exhausted, flushing GPU TLBs\n");
+        shaderMMU->flushAll();
+        ptBaseASIDs.clear();
+    }
+    GPUAsid asid = ptBaseASIDs.size();
+    DPRINTF(CudaGPU, "Assigning ASID %d to page table base %#x\n", asid,
+            pt_base);
+    ptBaseASIDs[pt_base] = asid;
+    return asid;
+}
+
 // TODO: When we move the stream manager into libcuda, this will need to be
 // eliminated, and libcuda will have to decide when to block the calling thread
 bool CudaGPU::needsToBlock()
@@ -662,43 +729,170 @@ uint64_t CudaGPU::getLocalBaseVaddr()
     return localBaseVaddr;
 }
 
+CudaGPU::GPUPageTable::GPUPageTable()
+    : root(newNode(false)), numPages(0), lastLeaf(NULL), lastLeafBase(0)
+{
+}
+
+CudaGPU::GPUPageTable::~GPUPageTable()
+{
+    freeNode(root, NumLevels - 1);
+}
+
+unsigned CudaGPU::GPUPageTable::nodeIndex(Addr vaddr, int level)
+{
+    unsigned low_bit = TheISA::PageShift + level * LevelBits;
+    return bits(vaddr, low_bit + LevelBits - 1, low_bit);
+}
+
+Addr CudaGPU::GPUPageTable::leafBase(Addr vaddr)
+{
+    return vaddr & ~mask(TheISA::PageShift + LevelBits);
+}
+
+CudaGPU::GPUPageTable::Node *CudaGPU::GPUPageTable::newNode(bool leaf)
+{
+    Node *node = new Node;
+    for (unsigned i = 0; i < NodeEntries; i++) {
+        if (leaf) {
+            node->ppBases[i] = invalidPage;
+        } else {
+            node->children[i] = NULL;
+        }
+    }
+    return node;
+}
+
+void CudaGPU::GPUPageTable::freeNode(Node *node, int level)
+{
+    if (level > 0) {
+        for (unsigned i = 0; i < NodeEntries; i++) {
+            if (node->children[i]) {
+                freeNode(node->children[i], level - 1);
+            }
+        }
+    }
+    delete node;
+}
+
+CudaGPU::GPUPageTable::Node *CudaGPU::GPUPageTable::findLeaf(Addr vaddr,
+                                                              bool allocate)
+{
+    if (lastLeaf && leafBase(vaddr) == lastLeafBase) {
+        return lastLeaf;
+    }
+    if (vaddr >> (TheISA::PageShift + NumLevels * LevelBits)) {
+        if (allocate) {
+            panic("GPU page table cannot map vaddr %#x\n", vaddr);
+        }
+        return NULL;
+    }
+    Node *node = root;
+    for (int level = NumLevels - 1; level > 0; level--) {
+        Node *&child = node->children[nodeIndex(vaddr, level)];
+        if (!child) {
+            if (!allocate) {
+                return NULL;
+            }
+            child = newNode(level == 1);
+        }
+        node = child;
+    }
+    lastLeaf = node;
+    lastLeafBase = leafBase(vaddr);
+    return node;
+}
+
 Addr CudaGPU::GPUPageTable::addrToPage(Addr addr)
 {
     Addr offset = addr % TheISA::PageBytes;
     return addr - offset;
 }
 
-void CudaGPU::GPUPageTable::serialize(CheckpointOut &cp) const
+void CudaGPU::GPUPageTable::insert(Addr vaddr, Addr paddr)
 {
-    unsigned int num_ptes = pageMap.size();
-    unsigned int index = 0;
-    Addr* pagetable_vaddrs = new Addr[num_ptes];
-    Addr* pagetable_paddrs = new Addr[num_ptes];
-    std::map<Addr, Addr>::const_iterator it = pageMap.begin();
-    for (; it != pageMap.end(); ++it) {
-        pagetable_vaddrs[index] = (*it).first;
-        pagetable_paddrs[index++] = (*it).second;
+    assert(vaddr == addrToPage(vaddr) && paddr != invalidPage);
+    Addr &pp_base = findLeaf(vaddr, true)->ppBases[nodeIndex(vaddr, 0)];
+    if (pp_base == invalidPage) {
+        pp_base = paddr;
+        numPages++;
+    } else {
+        assert(paddr == pp_base);
     }
+}
+
+bool CudaGPU::GPUPageTable::lookup(Addr vaddr, Addr& paddr)
+{
+    Node *leaf = findLeaf(vaddr, false);
+    if (!leaf) {
+        return false;
+    }
+    Addr pp_base = leaf->ppBases[nodeIndex(vaddr, 0)];
+    if (pp_base == invalidPage) {
+        return false;
+    }
+    paddr = pp_base + vaddr % TheISA::PageBytes;
+    return true;
+}
+
+void CudaGPU::GPUPageTable::writePages(CheckpointOut &cp, const Node *node,
+                                       int level, Addr vaddr, bool paddrs,
+                                       bool &first) const
+{
+    for (unsigned i = 0; i < NodeEntries; i++) {
+        Addr entry_vaddr =
+            vaddr | ((Addr)i << (TheISA::PageShift + level * LevelBits));
+        if (level > 0) {
+            if (node->children[i]) {
+                writePages(cp, node->children[i], level - 1, entry_vaddr,
+                           paddrs, first);
+            }
+        } else if (node->ppBases[i] != invalidPage) {
+            // Same format as arrayParamOut: values separated by spaces
+            if (!first) {
+                cp << " ";
+            }
+            first = false;
+            cp << (paddrs ? node->ppBases[i] : entry_vaddr);
+        }
+    }
+}
+
+void CudaGPU::GPUPageTable::serialize(CheckpointOut &cp) const
+{
+    unsigned int num_ptes = numPages;
     SERIALIZE_SCALAR(num_ptes);
-    SERIALIZE_ARRAY(pagetable_vaddrs, num_ptes);
-    SERIALIZE_ARRAY(pagetable_paddrs, num_ptes);
-    delete[] pagetable_vaddrs;
-    delete[] pagetable_paddrs;
+    bool first = true;
+    cp << "pagetable_vaddrs=";
+    writePages(cp, root, NumLevels - 1, 0, false, first);
+    cp << "\n";
+    first = true;
+    cp << "pagetable_paddrs=";
+    writePages(cp, root, NumLevels - 1, 0, true, first);
+    cp << "\n";
 }
 
 void CudaGPU::GPUPageTable::unserialize(CheckpointIn &cp)
 {
     unsigned int num_ptes = 0;
     UNSERIALIZE_SCALAR(num_ptes);
-    Addr* pagetable_vaddrs = new Addr[num_ptes];
-    Addr* pagetable_paddrs = new Addr[num_ptes];
-    UNSERIALIZE_ARRAY(pagetable_vaddrs, num_ptes);
-    UNSERIALIZE_ARRAY(pagetable_paddrs, num_ptes);
+    string vaddrs_str, paddrs_str;
+    if (!cp.find(Serializable::currentSection(), "pagetable_vaddrs",
+                 vaddrs_str) ||
+        !cp.find(Serializable::currentSection(), "pagetable_paddrs",
+                 paddrs_str)) {
+        fatal("GPU page table missing from checkpoint\n");
+    }
+    istringstream vaddrs(vaddrs_str);
+    istringstream paddrs(paddrs_str);
     for (unsigned int i = 0; i < num_ptes; ++i) {
-        pageMap[pagetable_vaddrs[i]] = pagetable_paddrs[i];
+        Addr vaddr, paddr;
+        if (!(vaddrs >> vaddr) || !(paddrs >> paddr)) {
+            fatal("GPU page table checkpoint has fewer than %d pages\n",
+                  num_ptes);
+        }
+        insert(vaddr, paddr);
     }
-    delete[] pagetable_vaddrs;
-    delete[] pagetable_paddrs;
 }
 
 void CudaGPU::registerDeviceMemory(ThreadContext *tc, Addr vaddr, size_t size)
@@ -753,6 +947,14 @@ Addr CudaGPU::allocateGPUMemory(size_t size)
         panic("Ran out of GPU memory!");
     }
 
+    if (directSegment) {
+        // Allocations extend the segment rather than the page table
+        directSegmentLimit = roundUp(virtualGPUBrkAddr, TheISA::PageBytes);
+        DPRINTF(CudaGPUAccess, "Allocating %d bytes for GPU at address 0x%x "
+                "in direct segment\n", size, base_vaddr);
+        return base_vaddr;
+    }
+
     // Map pages to physical pages
     for (ChunkGenerator gen(base_vaddr, aligned_size, TheISA::PageBytes); !gen.done(); gen.next()) {
         Addr page_vaddr = pageTable.addrToPage(gen.addr());
@@ -310,6 +310,13 @@ class CudaGPU : public ClockedObject
     struct CUstream_st *runningStream;
     int runningTID;
     Addr runningPTBase;
+    GPUAsid runningASID;
+
+    /// ASIDs assigned to page table bases. When all ASIDs are in use, the
+    /// GPU TLBs are flushed and assignment starts over.
+    std::map<Addr, GPUAsid> ptBaseASIDs;
+    GPUAsid getASID(Addr pt_base);
+
     void beginStreamOperation(struct CUstream_st *_stream) {
         // We currently do not support multiple concurrent streams
         if (runningStream || runningTC) {
@@ -332,12 +339,14 @@ class CudaGPU : public ClockedObject
         // to be called the TTBR1 register). Further investigation required.
         warn_once("ISA's pagetable base register handling needs to be set up");
 #endif
+        runningASID = getASID(runningPTBase);
     }
     void endStreamOperation() {
         runningStream = NULL;
         runningTC = NULL;
         runningTID = -1;
         runningPTBase = 0;
+        runningASID = 0;
     }
 
     /// For statistics
@@ -394,32 +403,63 @@ class CudaGPU : public ClockedObject
     std::vector<_FatBinary> fatBinaries;
     std::vector<_CudaVar> cudaVars;
 
+    /**
+     * Page table for memory mapped by the GPU itself (GPU-managed memory, or
+     * device memory when the GPU does not walk the host page table). Like
+     * the x86-64 page table, it is a radix tree of 512-entry nodes over 48
+     * virtual address bits, so a lookup costs four dependent loads no matter
+     * how many pages are mapped. The last leaf found is remembered, since
+     * consecutive lookups usually fall in the same 2MB region.
+     */
     class GPUPageTable
     {
       private:
-        std::map<Addr, Addr> pageMap;
+        static const unsigned LevelBits = 9;
+        static const unsigned NumLevels = 4;
+        static const unsigned NodeEntries = 1 << LevelBits;
+        // Marks an unmapped page in a leaf. Never a physical page base.
+        static const Addr invalidPage = (Addr)-1;
+
+        // Interior nodes point to the nodes of the next level down, and
+        // leaves (level 0) hold physical page bases
+        union Node {
+            Node *children[NodeEntries];
+            Addr ppBases[NodeEntries];
+        };
+
+        Node *root;
+        unsigned numPages;
+        Node *lastLeaf;
+        // Virtual base of the region mapped by lastLeaf
+        Addr lastLeafBase;
+
+        static unsigned nodeIndex(Addr vaddr, int level);
+        static Addr leafBase(Addr vaddr);
+        static Node *newNode(bool leaf);
+        static void freeNode(Node *node, int level);
+
+        /// Return the leaf mapping vaddr, creating missing nodes if allocate
+        /// is set, or NULL if there is none
+        Node *findLeaf(Addr vaddr, bool allocate);
+
+        /// Write the virtual or physical page bases of all mapped pages
+        /// under node in virtual address order
+        void writePages(CheckpointOut &cp, const Node *node, int level,
+                        Addr vaddr, bool paddrs, bool &first) const;
+
+        // Not copyable: owns its nodes
+        GPUPageTable(const GPUPageTable &);
+        GPUPageTable &operator=(const GPUPageTable &);
 
       public:
-        GPUPageTable() {};
+        GPUPageTable();
+        ~GPUPageTable();
 
         Addr addrToPage(Addr addr);
-        void insert(Addr vaddr, Addr paddr) {
-            if (pageMap.find(vaddr) == pageMap.end()) {
-                pageMap[vaddr] = paddr;
-            } else {
-                assert(paddr == pageMap[vaddr]);
-            }
-        }
-        bool lookup(Addr vaddr, Addr& paddr) {
-            Addr page_vaddr = addrToPage(vaddr);
-            Addr offset = vaddr - page_vaddr;
-            if (pageMap.find(page_vaddr) != pageMap.end()) {
-                paddr = pageMap[page_vaddr] + offset;
-                return true;
-            }
-            return false;
-        }
-        /// For checkpointing
+        void insert(Addr vaddr, Addr paddr);
+        bool lookup(Addr vaddr, Addr& paddr);
+        /// For checkpointing. The page bases are streamed to and from the
+        /// checkpoint rather than staged in temporary arrays.
         void serialize(CheckpointOut &cp) const;
         void unserialize(CheckpointIn &cp);
     };
@@ -429,6 +469,17 @@ class CudaGPU : public ClockedObject
     AddrRange gpuMemoryRange;
     Addr physicalGPUBrkAddr;
     Addr virtualGPUBrkAddr;
+
+    /**
+     * GPU-managed memory is allocated from contiguous virtual and physical
+     * ranges, so it can be translated as a direct segment: addresses from
+     * the virtual base up to the page-aligned limit map linearly onto the
+     * physical base. These pages are then not entered in the page table.
+     */
+    bool directSegment;
+    Addr directSegmentVBase;
+    Addr directSegmentPBase;
+    Addr directSegmentLimit;
     std::map<Addr,size_t> allocatedGPUMemory;
 
     ShaderMMU *shaderMMU;
@@ -520,6 +571,17 @@ class CudaGPU : public ClockedObject
     /// TODO: Move the thread context handling to GPU context when we get there
     ThreadContext *getThreadContext() { return runningTC; }
     Addr getRunningPTBase() { return runningPTBase; }
+    GPUAsid getRunningASID() { return runningASID; }
+
+    /// Translate vaddr if it lies in the direct segment
+    bool translateDirectSegment(Addr vaddr, Addr &paddr) {
+        if (!directSegment || vaddr < directSegmentVBase ||
+            vaddr >= directSegmentLimit) {
+            return false;
+        }
+        paddr = directSegmentPBase + (vaddr - directSegmentVBase);
+        return true;
+    }
     void checkUpdateThreadContext(ThreadContext *tc) {
         if (!runningTC) {
             // The GPU isn't running anything, so it won't try to access the
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2013 Mark D. Hill and David A. Wood
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer;
+ * redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution;
+ * neither the name of the copyright holders nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __LSQ_MSHR_TABLE_HH__
+#define __LSQ_MSHR_TABLE_HH__
+
+#include <vector>
+
+#include "base/intmath.hh"
+#include "gpu/lsq_warp_inst_buffer.hh"
+
+/**
+ * The LSQ's table of cache lines with an access outstanding to the L1. Each
+ * entry tracks the access sent to the cache, the loads merged into it that
+ * will complete from its response, and the accesses serialized behind it.
+ * Merged and serialized accesses are chained through their mshrNext
+ * pointers, so the table does not allocate once it has grown.
+ *
+ * Entries are kept in a flat, open-addressed hash table with linear probing.
+ * Entry pointers are only valid until the next allocate() or release().
+ */
+class LSQMSHRTable
+{
+  public:
+    typedef WarpInstBuffer::CoalescedAccess Access;
+
+    struct Entry {
+        Addr lineAddr;
+        bool valid;
+        // The access outstanding to the cache for this line. NULL while the
+        // next serialized access waits to be injected
+        Access *issued;
+        // Loads that complete with the response to the issued access
+        Access *mergedHead;
+        unsigned numMerged;
+        // Accesses waiting for the issued access to complete, in order
+        Access *blockedHead;
+        Access *blockedTail;
+    };
+
+  private:
+    std::vector<Entry> table;
+    // Maximum number of entries, or 0 to grow the table as needed
+    unsigned maxEntries;
+    unsigned numEntries;
+    unsigned lineBits;
+
+    unsigned
+    homeSlot(Addr line_addr) const
+    {
+        uint64_t hash = (line_addr >> lineBits) * 0x9e3779b97f4a7c15ULL;
+        return (hash >> 32) & (table.size() - 1);
+    }
+
+    void
+    resize(unsigned num_slots)
+    {
+        std::vector<Entry> old_table(num_slots);
+        old_table.swap(table);
+        for (unsigned i = 0; i < table.size(); i++) {
+            table[i].valid = false;
+        }
+        for (unsigned i = 0; i < old_table.size(); i++) {
+            if (old_table[i].valid) {
+                unsigned slot = homeSlot(old_table[i].lineAddr);
+                while (table[slot].valid) {
+                    slot = (slot + 1) & (table.size() - 1);
+                }
+                table[slot] = old_table[i];
+            }
+        }
+    }
+
+  public:
+    LSQMSHRTable(unsigned max_entries, unsigned line_bytes)
+        : maxEntries(max_entries), numEntries(0),
+          lineBits(floorLog2(line_bytes))
+    {
+        // Keep the table at most half full to keep probe sequences short
+        resize(max_entries ? 2 << ceilLog2(max_entries) : 64);
+    }
+
+    unsigned size() const { return numEntries; }
+    bool full() const { return maxEntries && numEntries >= maxEntries; }
+
+    Entry *
+    find(Addr line_addr)
+    {
+        unsigned slot = homeSlot(line_addr);
+        while (table[slot].valid) {
+            if (table[slot].lineAddr == line_addr) {
+                return &table[slot];
+            }
+            slot = (slot + 1) & (table.size() - 1);
+        }
+        return NULL;
+    }
+
+    Entry *
+    allocate(Addr line_addr)
+    {
+        assert(!full());
+        assert(!find(line_addr));
+        if (2 * (numEntries + 1) > table.size()) {
+            resize(2 * table.size());
+        }
+        unsigned slot = homeSlot(line_addr);
+        while (table[slot].valid) {
+            slot = (slot + 1) & (table.size() - 1);
+        }
+        Entry &entry = table[slot];
+        entry.lineAddr = line_addr;
+        entry.valid = true;
+        entry.issued = NULL;
+        entry.mergedHead = NULL;
+        entry.numMerged = 0;
+        entry.blockedHead = entry.blockedTail = NULL;
+        numEntries++;
+        return &entry;
+    }
+
+    void
+    release(Entry *entry)
+    {
+        assert(entry->valid && !entry->issued && !entry->mergedHead &&
+               !entry->blockedHead);
+        // Backward shift deletion: move later entries of the probe sequence
+        // into the hole unless they would move before their home slot
+        unsigned hole = entry - &table[0];
+        unsigned slot = hole;
+        while (true) {
+            slot = (slot + 1) & (table.size() - 1);
+            if (!table[slot].valid) {
+                break;
+            }
+            unsigned home = homeSlot(table[slot].lineAddr);
+            if (((slot - home) & (table.size() - 1)) >=
+                ((slot - hole) & (table.size() - 1))) {
+                table[hole] = table[slot];
+                hole = slot;
+            }
+        }
+        table[hole].valid = false;
+        numEntries--;
+    }
+};
+
+#endif // __LSQ_MSHR_TABLE_HH__
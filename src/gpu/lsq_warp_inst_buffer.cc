@@ -29,8 +29,10 @@
  *
  */
 
+#include <algorithm>
 #include <cmath>
 
+#include "base/bitfield.hh"
 #include "gpu/lsq_warp_inst_buffer.hh"
 
 using namespace std;
@@ -38,6 +40,40 @@ using namespace std;
 const string WarpInstBuffer::instructionTypeStrings[] =
         { "invalid", "load", "store", "fence", "atomic" };
 
+WarpInstBuffer::~WarpInstBuffer()
+{
+    // Accesses still in flight go with the LSQ's pools
+    delete [] laneRequestPkts;
+}
+
+void
+WarpInstBuffer::addCoalesced(CoalescedAccess *mem_access)
+{
+    if (coalescedTail) {
+        coalescedTail->coalescedNext = mem_access;
+    } else {
+        coalescedHead = mem_access;
+    }
+    coalescedTail = mem_access;
+    numCoalesced++;
+}
+
+WarpInstBuffer::CoalescedAccess::~CoalescedAccess()
+{
+    assert(activeLanes == 0);
+    if (pktData) warpInst->pools->data.put(pktData);
+    if (req) warpInst->pools->requests.destroy(req);
+}
+
+void
+WarpInstBuffer::CoalescedAccess::allocateData()
+{
+    assert(!pktData);
+    pktData = (uint8_t*)warpInst->pools->data.get();
+    assert(getSize() <= warpInst->pools->data.getBlockBytes());
+    dataStatic(pktData);
+}
+
 bool
 WarpInstBuffer::addLaneRequest(unsigned lane_id, PacketPtr pkt)
 {
@@ -52,15 +88,19 @@ WarpInstBuffer::addLaneRequest(unsigned lane_id, PacketPtr pkt)
     return true;
 }
 
-// Struct to track the chunks touched by a cache access and the lanes that
-// whose requests are coalesced into this access
-// Copied from GPGPU-Sim
-struct transaction_info {
-    std::bitset<4> chunks; // bitmask: 32-byte chunks accessed
-    // mem_access_byte_mask_t bytes;
-    std::list<unsigned> activeLanes; // threads in this transaction
+// The sectors of a segment touched by a subwarp and the lanes whose requests
+// are coalesced into accesses to the segment. Subwarps touch at most two
+// segments per lane, so the segments are tracked in a small open-addressed
+// table that is at least twice as large as that. Based on transaction_info
+// in GPGPU-Sim.
+struct SegmentInfo {
+    Addr addr;
+    WarpInstBuffer::LaneMask lanes; // 0 => unused table entry
+    uint32_t sectors; // bitmask: sectors of the segment accessed
 };
 
+static const unsigned segmentTableSize = 4 * WarpInstBuffer::MaxLanes;
+
 void
 WarpInstBuffer::coalesce()
 {
@@ -68,173 +108,239 @@ WarpInstBuffer::coalesce()
      * This code is largely based on coalescing code found in GPGPU-Sim. It
      * is suggested that you review the NVidia CUDA manual for coalescing rules
      * before modifying this code.
+     *
+     * Fermi rules: Lanes access 32, 64 or 128-byte segments depending on
+     * their request size, and each segment accessed is reduced by halves to
+     * the smallest aligned block holding all of the sectors touched.
+     * Sectored rules (Maxwell and later): Lanes access whole cache lines, and
+     * each run of consecutive sectors touched in a line is a separate access.
      */
-    assert(laneCount == 32 &&
-           "Unknown whether coalescing works with more or less than 32 lanes");
-
     assert(instructionType == LOAD_INST || instructionType == STORE_INST ||
            instructionType == ATOMIC_INST);
 
-    unsigned segment_size = 0;
-    switch (requestDataSize) {
-      case 1: segment_size = 32; break;
-      case 2: segment_size = 64; break;
-      case 4: case 8: case 16: segment_size = 128; break;
+    // A request crosses at most one sector boundary, so it is split across
+    // at most two segments
+    assert(requestDataSize <= sectorBytes);
+
+    unsigned segment_size = lineBytes;
+    if (coalescingRules == Enums::Fermi) {
+        switch (requestDataSize) {
+          case 1: segment_size = 32; break;
+          case 2: segment_size = 64; break;
+        }
+        segment_size = std::min(lineBytes,
+                                std::max(sectorBytes, segment_size));
     }
     unsigned subwarp_size = laneCount / warpParts;
+    Addr segment_mask = ~((Addr)(segment_size - 1));
+
+    // Step 1: Find the bytes accessed by each lane. Inactive lanes are
+    // computed but never used.
+    Addr lane_addrs[MaxLanes];
+    LaneMask active_lanes = 0;
+    for (unsigned lane = 0; lane < laneCount; lane++) {
+        PacketPtr lane_pkt = laneRequestPkts[lane];
+        lane_addrs[lane] = lane_pkt ? lane_pkt->req->getVaddr() : 0;
+        active_lanes |= lane_pkt ? laneBit(lane) : 0;
+        laneAccesses[lane] = 0;
+    }
+
+    SegmentInfo segment_table[segmentTableSize];
+    for (unsigned i = 0; i < segmentTableSize; i++) {
+        segment_table[i].lanes = 0;
+    }
 
     for (unsigned subwarp = 0; subwarp < warpParts; subwarp++) {
-        map<Addr, transaction_info> subwarp_transactions;
-
-        // Step 1: Find all transactions generated by this subwarp
-        for (unsigned thread = subwarp * subwarp_size;
-             thread < subwarp_size * (subwarp+1);
-             thread++)
-        {
-            if (!laneRequestPkts[thread])
-                continue;
-
-            unsigned num_accesses = 1;
-
-            for (unsigned access = 0; access < num_accesses; access++) {
-                Addr addr = getLaneAddr(thread);
-                Addr block_address = addr & ~((Addr)(segment_size - 1));
-                // Figure out which 32-byte chunk within in a 128-byte block
-                // this thread is accessing
-                unsigned chunk = (addr & 127) / 32;
-                transaction_info &info = subwarp_transactions[block_address];
-
-                // Can only write to one segment
-                assert(block_address == ((addr + requestDataSize - 1) &
-                       ~((Addr)(segment_size - 1))));
-
-                info.chunks.set(chunk);
-                info.activeLanes.push_back(thread);
+        LaneMask subwarp_lanes = active_lanes &
+            (mask(subwarp_size) << (subwarp * subwarp_size));
+
+        // Step 2: Find all segments and sectors accessed by this subwarp
+        unsigned segments[2 * MaxLanes];
+        unsigned num_segments = 0;
+        for (LaneMask lanes = subwarp_lanes; lanes; lanes &= lanes - 1) {
+            unsigned lane = findLsbSet(lanes);
+            Addr first_byte = lane_addrs[lane];
+            Addr last_byte = first_byte + requestDataSize - 1;
+
+            for (Addr block_address = first_byte & segment_mask;
+                 block_address <= (last_byte & segment_mask);
+                 block_address += segment_size) {
+                unsigned slot = (block_address / segment_size) %
+                                segmentTableSize;
+                while (segment_table[slot].lanes &&
+                       segment_table[slot].addr != block_address) {
+                    slot = (slot + 1) % segmentTableSize;
+                }
+                SegmentInfo &info = segment_table[slot];
+                if (!info.lanes) {
+                    info.addr = block_address;
+                    info.sectors = 0;
+                    segments[num_segments++] = slot;
+                }
+                Addr lo = std::max(first_byte, block_address);
+                Addr hi = std::min(last_byte,
+                                   block_address + segment_size - 1);
+                unsigned first_sector = (lo - block_address) / sectorBytes;
+                unsigned last_sector = (hi - block_address) / sectorBytes;
+                info.sectors |= mask(last_sector - first_sector + 1) <<
+                                first_sector;
+                info.lanes |= laneBit(lane);
             }
         }
 
-        // Step 2: Reduce each transaction size, if possible
-        map<Addr, transaction_info>::iterator t = subwarp_transactions.begin();
-        for (; t != subwarp_transactions.end(); t++) {
-            Addr addr = t->first;
-            transaction_info &info = t->second;
+        // Generate accesses in address order
+        for (unsigned i = 1; i < num_segments; i++) {
+            unsigned slot = segments[i];
+            unsigned j = i;
+            for (; j > 0 && segment_table[segments[j - 1]].addr >
+                            segment_table[slot].addr; j--) {
+                segments[j] = segments[j - 1];
+            }
+            segments[j] = slot;
+        }
 
-            // GPGPU-Sim: memory_coalescing_arch_13_reduce_and_send(); code
-            // ported below.
-            assert((addr & (segment_size-1)) == 0);
+        // Step 3: Reduce each segment to the blocks of sectors accessed
+        for (unsigned s = 0; s < num_segments; s++) {
+            SegmentInfo &info = segment_table[segments[s]];
+            Addr addr = info.addr;
+            uint32_t sectors = info.sectors;
+            LaneMask segment_lanes = info.lanes;
+            // Free the table entry for the next subwarp
+            info.lanes = 0;
 
-            const bitset<4> &q = info.chunks;
-            assert(q.count() >= 1);
-            // Halves (used to check if 64 byte segment can be compressed
-            // into a single 32 byte segment)
-            bitset<2> h;
-
-            unsigned size = segment_size;
-            if (segment_size == 128 ) {
-                bool lower_half_used = q[0] || q[1];
-                bool upper_half_used = q[2] || q[3];
-                if (lower_half_used && !upper_half_used) {
-                    // only lower 64 bytes used
-                    size = 64;
-                    if(q[0]) h.set(0);
-                    if(q[1]) h.set(1);
-                } else if (!lower_half_used && upper_half_used) {
-                    // only upper 64 bytes used
-                    addr += 64;
-                    size = 64;
-                    if(q[2]) h.set(0);
-                    if(q[3]) h.set(1);
-                } else {
-                    assert(lower_half_used && upper_half_used);
+            assert((addr & (segment_size-1)) == 0);
+            assert(sectors != 0);
+
+            // The blocks of the segment to access, as (first sector, number
+            // of sectors)
+            unsigned block_sectors[MaxSectors][2];
+            unsigned num_blocks = 0;
+            if (coalescingRules == Enums::Fermi) {
+                // GPGPU-Sim: memory_coalescing_arch_13_reduce_and_send():
+                // while only one half of the block is used, access just that
+                // half
+                unsigned first = 0;
+                unsigned num_sectors = segment_size / sectorBytes;
+                while (num_sectors > 1) {
+                    unsigned half = num_sectors / 2;
+                    uint32_t lower_half = mask(half) << first;
+                    uint32_t upper_half = mask(half) << (first + half);
+                    if ((sectors & lower_half) && !(sectors & upper_half)) {
+                        num_sectors = half;
+                    } else if (!(sectors & lower_half) &&
+                               (sectors & upper_half)) {
+                        first += half;
+                        num_sectors = half;
+                    } else {
+                        break;
+                    }
                 }
-            } else if (segment_size == 64) {
-                // need to set halves
-                if ((addr % 128) == 0) {
-                    if(q[0]) h.set(0);
-                    if(q[1]) h.set(1);
-                } else {
-                    assert((addr % 128) == 64);
-                    if(q[2]) h.set(0);
-                    if(q[3]) h.set(1);
+                block_sectors[0][0] = first;
+                block_sectors[0][1] = num_sectors;
+                num_blocks = 1;
+            } else {
+                // Each run of consecutive sectors is accessed separately
+                while (sectors) {
+                    unsigned first = findLsbSet(sectors);
+                    unsigned num_sectors = 0;
+                    while (first + num_sectors < MaxSectors &&
+                           (sectors & (1U << (first + num_sectors)))) {
+                        sectors &= ~(1U << (first + num_sectors));
+                        num_sectors++;
+                    }
+                    block_sectors[num_blocks][0] = first;
+                    block_sectors[num_blocks][1] = num_sectors;
+                    num_blocks++;
                 }
             }
-            if (size == 64) {
-                bool lower_half_used = h[0];
-                bool upper_half_used = h[1];
-                if (lower_half_used && !upper_half_used) {
-                    size = 32;
-                } else if (!lower_half_used && upper_half_used) {
-                    addr += 32;
-                    size = 32;
+
+            for (unsigned b = 0; b < num_blocks; b++) {
+                Addr block_addr = addr + block_sectors[b][0] * sectorBytes;
+                unsigned size = block_sectors[b][1] * sectorBytes;
+
+                // The lanes that access this block
+                LaneMask lanes = 0;
+                for (LaneMask l = segment_lanes; l; l &= l - 1) {
+                    unsigned lane = findLsbSet(l);
+                    if (lane_addrs[lane] < block_addr + size &&
+                        lane_addrs[lane] + requestDataSize > block_addr) {
+                        lanes |= laneBit(lane);
+                    }
+                }
+                assert(lanes != 0);
+
+                if (instructionType == LOAD_INST) {
+                    // It would be good to reduce the size as much as possible
+                    // to allow for flexibility in the minimum request size in
+                    // caches
+                    generateCoalescedAccesses(block_addr, size, lanes);
+                } else if (instructionType == STORE_INST) {
+                    coalesceStores(block_addr, size, lanes, lane_addrs);
+                } else if (instructionType == ATOMIC_INST) {
+                    // NOTE: Atomics are coalesced differently than loads, but
+                    // they use the same method to identify the portions of
+                    // cache lines that will be touched. Send to
+                    // generateCoalescedAccesses to construct atomic packets
+                    generateCoalescedAccesses(block_addr, size, lanes);
                 } else {
-                    assert(lower_half_used && upper_half_used);
+                    panic("Invalid instruction in coalescer");
                 }
             }
+        }
+    }
+}
 
-            if (instructionType == LOAD_INST) {
-                // It would be good to reduce the size as much as possible to
-                // allow for flexibility in the minimum request size in caches
-                generateCoalescedAccesses(addr, size, info.activeLanes);
-            } else if (instructionType == STORE_INST) {
-                // Currently, writes must be contiguous
-                // A map from the word of the block to the lane id
-                // Needs to be multimap since two lanes could have same addr
-                multimap<unsigned, unsigned> validWords;
-                list<unsigned>::const_iterator iter = info.activeLanes.begin();
-                for (; iter != info.activeLanes.end(); iter++) {
-                    Addr a = getLaneAddr(*iter);
-                    int offset = a & (size-1);
-                    validWords.insert(pair<unsigned, unsigned>(offset, *iter));
-                }
+void
+WarpInstBuffer::coalesceStores(Addr addr, unsigned size, LaneMask lanes,
+                               const Addr *lane_addrs)
+{
+    // Currently, writes must be contiguous. Sort the lanes by the offset of
+    // the bytes they write in the block, keeping lanes with the same offset
+    // in lane order. Requests that cross the block boundary are clipped.
+    unsigned word_starts[MaxLanes];
+    unsigned word_ends[MaxLanes];
+    unsigned word_lanes[MaxLanes];
+    unsigned num_words = 0;
+    for (; lanes; lanes &= lanes - 1) {
+        unsigned lane = findLsbSet(lanes);
+        unsigned start = std::max(lane_addrs[lane], addr) - addr;
+        unsigned end = std::min(lane_addrs[lane] + requestDataSize,
+                                addr + size) - addr;
+        unsigned j = num_words++;
+        for (; j > 0 && word_starts[j - 1] > start; j--) {
+            word_starts[j] = word_starts[j - 1];
+            word_ends[j] = word_ends[j - 1];
+            word_lanes[j] = word_lanes[j - 1];
+        }
+        word_starts[j] = start;
+        word_ends[j] = end;
+        word_lanes[j] = lane;
+    }
 
-                multimap<unsigned, unsigned>::iterator it = validWords.begin();
-                while (it != validWords.end()) {
-                    Addr base = addr + it->first;
-                    list<unsigned> lanes;
-                    int chunkSize = requestDataSize;
-                    // While the next offset is the current offset + size of
-                    // word. Use >= because could have two requests with same
-                    // offset incr the current offset
-                    multimap<unsigned, unsigned>::iterator next(it);
-                    next++;
-                    do {
-                        lanes.push_back(it->second);
-                        if (next == validWords.end()) {
-                            // This was the last thread
-                            it++;
-                            break;
-                        }
-                        if (it->first + requestDataSize == next->first) {
-                            // Only add to the chunk if the address is the next
-                            chunkSize += requestDataSize;
-                        } else if (it->first != next->first) {
-                            // If the next offset is not cur + size or cur,
-                            // this is at the end of a chunk
-                            it++;
-                            break;
-                        }
-                        it++;
-                        next++;
-                    } while (it != validWords.end());
-                    // This is a new chunk that needs to be sent
-                    generateCoalescedAccesses(base, chunkSize, lanes);
-                }
-            } else if (instructionType == ATOMIC_INST) {
-                // NOTE: Atomics are coalesced differently than loads, but they
-                // use the same method to identify the portions of cache lines
-                // that will be touched. Send to generateCoalescedAccesses to
-                // construct atomic packets
-                generateCoalescedAccesses(addr, size, info.activeLanes);
-            } else {
-                panic("Invalid instruction in coalescer");
-            }
+    unsigned w = 0;
+    while (w < num_words) {
+        unsigned chunk_start = word_starts[w];
+        unsigned chunk_end = word_ends[w];
+        LaneMask chunk_lanes = laneBit(word_lanes[w]);
+        w++;
+        // While the next word is the same as the previous word or starts
+        // right after it, extend the chunk. Words that partially overlap the
+        // previous word start a new chunk.
+        while (w < num_words && (word_starts[w] == word_starts[w - 1] ||
+                                 word_starts[w] == word_ends[w - 1])) {
+            chunk_lanes |= laneBit(word_lanes[w]);
+            chunk_end = std::max(chunk_end, word_ends[w]);
+            w++;
         }
+        // This is a new chunk that needs to be sent
+        generateCoalescedAccesses(addr + chunk_start, chunk_end - chunk_start,
+                                  chunk_lanes);
     }
 }
 
 void
 WarpInstBuffer::generateCoalescedAccesses(Addr addr, size_t size,
-                                          list<unsigned> &active_lanes)
+                                          LaneMask active_lanes)
 {
     Request::Flags flags;
     int asid = 0;
@@ -244,23 +350,32 @@ WarpInstBuffer::generateCoalescedAccesses(Addr addr, size_t size,
 
     CoalescedAccess *mem_access;
     if (instructionType == LOAD_INST) {
-        RequestPtr req = new Request(asid, addr, size, flags, masterId,
-                                     pc, 0, 0);
-        mem_access = new CoalescedAccess(req, MemCmd::ReadReq, this,
-                                         active_lanes);
-        coalescedAccesses.push_back(mem_access);
+        RequestPtr req = pools->requests.create<Request>(asid, addr, size,
+                                        flags, masterId, pc, 0, 0);
+        mem_access = pools->accesses.create<CoalescedAccess>(req,
+                                        MemCmd::ReadReq, this, active_lanes);
+        for (LaneMask lanes = active_lanes; lanes; lanes &= lanes - 1) {
+            laneAccesses[findLsbSet(lanes)]++;
+        }
+        addCoalesced(mem_access);
     } else if (instructionType == STORE_INST) {
-        RequestPtr req = new Request(asid, addr, size, flags, masterId,
-                                     pc, 0, 0);
-        uint8_t *pkt_data = new uint8_t[size];
-        list<unsigned>::iterator iter = active_lanes.begin();
-        for (; iter != active_lanes.end(); iter++) {
-            Addr offset = getLaneAddr(*iter) - addr;
-            memcpy(&pkt_data[offset], getLaneData(*iter), requestDataSize);
+        RequestPtr req = pools->requests.create<Request>(asid, addr, size,
+                                        flags, masterId, pc, 0, 0);
+        assert(size <= pools->data.getBlockBytes());
+        uint8_t *pkt_data = (uint8_t*)pools->data.get();
+        for (LaneMask lanes = active_lanes; lanes; lanes &= lanes - 1) {
+            unsigned lane = findLsbSet(lanes);
+            // Only write the part of the lane's data within this access
+            Addr lane_addr = getLaneAddr(lane);
+            Addr start = std::max(lane_addr, addr);
+            Addr end = std::min(lane_addr + requestDataSize, addr + size);
+            memcpy(&pkt_data[start - addr],
+                   getLaneData(lane) + (start - lane_addr), end - start);
+            laneAccesses[lane]++;
         }
-        mem_access = new CoalescedAccess(req, MemCmd::WriteReq, this,
-                                         active_lanes, pkt_data);
-        coalescedAccesses.push_back(mem_access);
+        mem_access = pools->accesses.create<CoalescedAccess>(req,
+                            MemCmd::WriteReq, this, active_lanes, pkt_data);
+        addCoalesced(mem_access);
     } else if (instructionType == ATOMIC_INST) {
         // To coalesce atomics requires a different style of packet. When
         // performed in the cache hierarchy and/or at the memory controller,
@@ -290,7 +405,7 @@ WarpInstBuffer::generateCoalescedAccesses(Addr addr, size_t size,
         // floats and unsigned int (i.e. 4B)
         assert(requestDataSize == 4);
 
-        assert(active_lanes.size() > 0);
+        assert(active_lanes != 0);
 
         // Set this request to be a locked read-modify-write (swap)
         flags.set(Request::LOCKED_RMW | Request::MEM_SWAP);
@@ -298,28 +413,33 @@ WarpInstBuffer::generateCoalescedAccesses(Addr addr, size_t size,
         // The maximum number of atomic operations that can be sent to each
         // cache subblock (i.e. (1) above)
         unsigned max_atom_per_subblock_per_pkt = atomsPerSubline;
-        unsigned bytes_per_subblock = 32;
+        unsigned bytes_per_subblock = sectorBytes;
 
         // Calculate the number of cache subblocks that this set of coalesced
         // accesses will touch
+        const unsigned max_subblocks = MaxSectors;
         unsigned num_subblocks = size / bytes_per_subblock;
+        assert(num_subblocks <= max_subblocks);
 
         // For each subblock, pull out the lanes that will access it
-        list<unsigned>::iterator iter = active_lanes.begin();
-        map<unsigned, list<unsigned> > subblock_atomics;
-        for (; iter != active_lanes.end(); iter++) {
-            unsigned lane_index = *iter;
+        LaneMask subblock_atomics[max_subblocks] = { 0 };
+        for (LaneMask lanes = active_lanes; lanes; lanes &= lanes - 1) {
+            unsigned lane_index = findLsbSet(lanes);
+            // Aligned 4B atomics never cross a sector
+            assert(getLaneAddr(lane_index) + requestDataSize <= addr + size);
             unsigned subblock_id = (getLaneAddr(lane_index) - addr) /
                                                             bytes_per_subblock;
-            subblock_atomics[subblock_id].push_back(lane_index);
+            assert(subblock_id < num_subblocks);
+            subblock_atomics[subblock_id] |= laneBit(lane_index);
         }
 
         // Based on the number of atomics that will touch each subblock,
         // calculate the number of memory accesses that will need to be sent
         unsigned max_atoms_per_subline = 0;
         for (unsigned subblock = 0; subblock < num_subblocks; subblock++) {
-            if (subblock_atomics[subblock].size() > max_atoms_per_subline) {
-                max_atoms_per_subline = subblock_atomics[subblock].size();
+            unsigned subblock_atoms = popCount(subblock_atomics[subblock]);
+            if (subblock_atoms > max_atoms_per_subline) {
+                max_atoms_per_subline = subblock_atoms;
             }
         }
         unsigned num_packets = ceil((float)max_atoms_per_subline /
@@ -327,21 +447,22 @@ WarpInstBuffer::generateCoalescedAccesses(Addr addr, size_t size,
 
         // Create the packets
         for (unsigned pkt_num = 0; pkt_num < num_packets; pkt_num++) {
-            // First, gather the lanes that will be included in this packet
-            list<unsigned> lanes_this_packet;
+            // First, gather the lanes that will be included in this packet,
+            // in the order their atomics are performed
+            unsigned lanes_this_packet[MaxLanes];
+            LaneMask packet_lanes = 0;
             unsigned num_atoms_this_access = 0;
             for (unsigned subblock = 0; subblock < num_subblocks; subblock++) {
                 // Only pull up to the maximum accesses per subblock
-                for (unsigned i = 0; i < max_atom_per_subblock_per_pkt; i++) {
-                    if (!subblock_atomics[subblock].empty()) {
-                        lanes_this_packet.push_back(
-                                            subblock_atomics[subblock].front());
-                        subblock_atomics[subblock].pop_front();
-                        num_atoms_this_access++;
-                    }
+                LaneMask &subblock_lanes = subblock_atomics[subblock];
+                for (unsigned i = 0; i < max_atom_per_subblock_per_pkt &&
+                                     subblock_lanes; i++) {
+                    unsigned lane_index = findLsbSet(subblock_lanes);
+                    subblock_lanes &= subblock_lanes - 1;
+                    lanes_this_packet[num_atoms_this_access++] = lane_index;
+                    packet_lanes |= laneBit(lane_index);
                 }
             }
-            assert(num_atoms_this_access == lanes_this_packet.size());
 
             // Now create the packet by appropriately setting the packet data
             // for each of the lane atomics associated with this access
@@ -350,27 +471,26 @@ WarpInstBuffer::generateCoalescedAccesses(Addr addr, size_t size,
             if (size > actual_data_size) {
                 actual_data_size = size;
             }
-            uint8_t *pkt_data = new uint8_t[actual_data_size];
+            assert(actual_data_size <= pools->data.getBlockBytes());
+            uint8_t *pkt_data = (uint8_t*)pools->data.get();
             AtomicOpRequest **atom_data = (AtomicOpRequest**)pkt_data;
-            unsigned data_index = 0;
-            list<unsigned>::iterator iter = lanes_this_packet.begin();
-            for (; iter != lanes_this_packet.end(); iter++) {
-                unsigned lane_index = *iter;
+            for (unsigned i = 0; i < num_atoms_this_access; i++) {
+                unsigned lane_index = lanes_this_packet[i];
                 AtomicOpRequest *lane_request =
                                             getLaneAtomicRequest(lane_index);
                 assert(lane_request->uniqueId == lane_index);
-                atom_data[data_index] = lane_request;
+                atom_data[i] = lane_request;
                 lane_request->lineOffset = getLaneAddr(lane_index) - addr;
                 lane_request->lastAccess = false;
-                data_index++;
             }
             atom_data[num_atoms_this_access-1]->lastAccess = true;
 
-            RequestPtr req = new Request(asid, addr, size, flags, masterId,
-                                         pc, 0, 0);
-            CoalescedAccess *mem_access = new CoalescedAccess(req,
-                    MemCmd::SwapReq, this, lanes_this_packet, pkt_data);
-            coalescedAccesses.push_back(mem_access);
+            RequestPtr req = pools->requests.create<Request>(asid, addr,
+                                        size, flags, masterId, pc, 0, 0);
+            CoalescedAccess *mem_access =
+                pools->accesses.create<CoalescedAccess>(req, MemCmd::SwapReq,
+                                                this, packet_lanes, pkt_data);
+            addCoalesced(mem_access);
         }
     } else {
         panic("Invalid instruction generating coalesced accesses\n");
@@ -381,14 +501,14 @@ bool
 WarpInstBuffer::finishAccess(CoalescedAccess *mem_access)
 {
     // For lane in active mask, make response packet, and if read, data
-    list<unsigned>* active_lanes = mem_access->getActiveLanes();
+    LaneMask *active_lanes = mem_access->getActiveLanes();
     if (instructionType == ATOMIC_INST) {
         AtomicOpRequest **atomic_ops =
                 (AtomicOpRequest**)mem_access->getPtr<uint8_t>();
         bool atomics_done = false;
         for (int i = 0; !atomics_done; i++) {
             unsigned lane_id = atomic_ops[i]->uniqueId;
-            assert(active_lanes->front() == lane_id);
+            assert(*active_lanes & laneBit(lane_id));
             PacketPtr lane_pkt = laneRequestPkts[lane_id];
             assert(lane_pkt);
             lane_pkt->makeResponse();
@@ -396,22 +516,33 @@ WarpInstBuffer::finishAccess(CoalescedAccess *mem_access)
                    atomic_ops[i]);
             atomics_done = atomic_ops[i]->lastAccess;
             atomic_ops[i]->lastAccess = true;
-            active_lanes->pop_front();
+            *active_lanes &= ~laneBit(lane_id);
         }
-        assert(active_lanes->empty());
+        assert(*active_lanes == 0);
     } else {
-        while (!active_lanes->empty()) {
-            unsigned lane_id = active_lanes->front();
+        while (*active_lanes) {
+            unsigned lane_id = findLsbSet(*active_lanes);
             PacketPtr lane_pkt = laneRequestPkts[lane_id];
             assert(lane_pkt);
+            assert(laneAccesses[lane_id] > 0);
+            laneAccesses[lane_id]--;
             if (instructionType == LOAD_INST) {
-                Addr offset = lane_pkt->req->getVaddr() -
-                              mem_access->req->getVaddr();
-                assert(offset < mem_access->getSize());
-                memcpy(lane_pkt->getPtr<uint8_t>(),
-                        mem_access->getPtr<uint8_t>() + offset,
-                        lane_pkt->getSize());
-                lane_pkt->makeTimingResponse();
+                // Only read the part of the lane's data within this access
+                Addr lane_addr = lane_pkt->req->getVaddr();
+                Addr access_addr = mem_access->req->getVaddr();
+                Addr start = std::max(lane_addr, access_addr);
+                Addr end = std::min(lane_addr + lane_pkt->getSize(),
+                                    access_addr + mem_access->getSize());
+                assert(start < end);
+                memcpy(lane_pkt->getPtr<uint8_t>() + (start - lane_addr),
+                        mem_access->getPtr<uint8_t>() + (start - access_addr),
+                        end - start);
+                if (laneAccesses[lane_id] == 0) {
+                    lane_pkt->makeTimingResponse();
+                }
+            } else if (laneAccesses[lane_id] > 0) {
+                // The rest of the lane's store is in another access
+                assert(instructionType == STORE_INST);
             } else {
                 // No need to send response for writes
                 // This assumes that the shader core moves store instructions
@@ -421,11 +552,11 @@ WarpInstBuffer::finishAccess(CoalescedAccess *mem_access)
                 delete lane_pkt;
                 laneRequestPkts[lane_id] = NULL;
             }
-            active_lanes->pop_front();
+            *active_lanes &= ~laneBit(lane_id);
         }
     }
     removeTranslated(mem_access);
-    delete mem_access;
+    pools->accesses.destroy(mem_access);
 
     // TODO: If restricting per-warp queued memory accesses (e.g. Fermi),
     // if there are translated requests that are not yet scheduled for
@@ -433,7 +564,7 @@ WarpInstBuffer::finishAccess(CoalescedAccess *mem_access)
 
     // If all accesses have completed, signal completion of this
     // warp instruction, so it can be written back
-    if (coalescedAccesses.empty() && translatedAccesses.empty()) {
+    if (numCoalesced == 0 && numTranslated == 0) {
         return true;
     }
     return false;
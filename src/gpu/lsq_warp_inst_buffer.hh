@@ -32,9 +32,14 @@
 #ifndef __LSQ_WARP_INST_BUFFER_HH__
 #define __LSQ_WARP_INST_BUFFER_HH__
 
+#include "enums/CoalescingRules.hh"
+#include "enums/FenceScope.hh"
 #include "gpu/atomic_operations.hh"
+#include "gpu/recycling_pool.hh"
 #include "mem/packet.hh"
 
+struct CoalescedAccessPools;
+
 /**
  * The WarpInstBuffer class represents a hardware buffer to hold a warp
  * instruction that is in-flight in a GPU load-store queue. It tracks the
@@ -48,6 +53,27 @@
  * accesses in various hardware LSQ buffers after coalescing.
  */
 class WarpInstBuffer {
+  public:
+    // The lanes of a warp as a bitmask, with bit i set for lane i
+    typedef uint64_t LaneMask;
+    static const unsigned MaxLanes = 64;
+
+    static LaneMask laneBit(unsigned lane_id)
+    {
+        return (LaneMask)1 << lane_id;
+    }
+
+    // The most sectors per cache line that the coalescer can track
+    static const unsigned MaxSectors = 32;
+
+    // The largest data buffer of a coalesced access: a full cache line, or
+    // the atomic operation pointers of all lanes
+    static size_t maxAccessDataBytes(unsigned lane_count, unsigned line_bytes)
+    {
+        return std::max((size_t)line_bytes,
+                        lane_count * sizeof(AtomicOpRequest*));
+    }
+
   private:
     // An enumeration to track the current state of the warp instruction
     //  EMPTY: This buffer does not contain a valid warp instruction
@@ -71,10 +97,17 @@ class WarpInstBuffer {
     const unsigned laneCount;
     const unsigned warpParts;
     const unsigned atomsPerSubline;
+    // The cache line and sector sizes, and the rules used to coalesce lane
+    // requests into accesses to them
+    const unsigned lineBytes;
+    const unsigned sectorBytes;
+    const Enums::CoalescingRules coalescingRules;
     BufferState state;
     // Track the type of this warp instruction
     InstructionType instructionType;
     unsigned requestDataSize;
+    // The threads that a fence orders memory accesses for
+    Enums::FenceScope fenceScope;
     // Tick values to track latency of warp instructions
     Tick startTick;
     Tick firstCycleTick;
@@ -83,18 +116,28 @@ class WarpInstBuffer {
     // An array to hold warp instruction requests per lane (thread) while
     // they are coalesced and access the caches
     PacketPtr* laneRequestPkts;
+    // The number of outstanding coalesced accesses that each lane's request
+    // is part of. Vector requests that cross a segment boundary are split
+    // across two accesses, and complete when both have.
+    uint8_t laneAccesses[MaxLanes];
     Addr pc;
     // Whether to bypass the L1 cache
     // NOTE: If implementing coherence scopes, this will need to be changed to
     // hold scoping information that can be translated down to cache mechanism
     // like bypassing the L1.
     bool bypassL1;
+    // The LSQ's pools for coalesced accesses, their requests and data
+    CoalescedAccessPools *pools;
 
     // Coalesce requests into cache accesses
     void coalesce();
+    // Called from coalesce() to split the stores to a block into contiguous
+    // chunks, each of which is a separate access
+    void coalesceStores(Addr addr, unsigned size, LaneMask lanes,
+                        const Addr *lane_addrs);
     // Called from coalesce() to instantiate the CoalescedAccess
     void generateCoalescedAccesses(Addr addr, size_t size,
-                                   std::list<unsigned> &active_lanes);
+                                   LaneMask active_lanes);
 
     Addr getLaneAddr(unsigned lane_id)
     {
@@ -129,80 +172,99 @@ class WarpInstBuffer {
       private:
         // The warp instruction that generated this access
         WarpInstBuffer *warpInst;
+        // Data buffer from the LSQ's data pool. The packet only points at
+        // it (as static data), and it is returned to the pool with the
+        // access.
         uint8_t *pktData;
         // The lanes of the warp that are participating in this access
-        std::list<unsigned> activeLanes;
+        LaneMask activeLanes;
         Cycles injectTime;
 
       public:
         CoalescedAccess(RequestPtr _req, MemCmd _cmd, WarpInstBuffer *warp_inst,
-                    std::list<unsigned> active_lanes, uint8_t *pkt_data = NULL)
+                    LaneMask active_lanes, uint8_t *pkt_data = NULL)
             : Packet(_req, _cmd), warpInst(warp_inst), pktData(pkt_data),
-              activeLanes(active_lanes), injectTime(0) {}
+              activeLanes(active_lanes), injectTime(0), coalescedNext(NULL),
+              translatedNext(NULL), samePageNext(NULL), mshrNext(NULL) {}
 
-        ~CoalescedAccess()
-        {
-            assert(activeLanes.empty());
-            if (pktData) delete [] pktData;
-            if (req) delete req;
-        }
+        // Returns the request and data buffer to the LSQ's pools
+        ~CoalescedAccess();
 
         WarpInstBuffer *getWarpBuffer() { return warpInst; }
         int getWarpId() { return warpInst->getWarpId(); }
-        std::list<unsigned> *getActiveLanes() { return &activeLanes; };
+        LaneMask *getActiveLanes() { return &activeLanes; };
         void moveDataToPacket()
         {
             assert(pktData);
             // Place the data pointer in the packet portion of the object
-            dataDynamic(pktData);
-            pktData = NULL;
+            dataStatic(pktData);
         }
+        // Give a read access a data buffer for its response
+        void allocateData();
 
         void setInjectCycle(Cycles inject_time) { injectTime = inject_time; }
         Cycles getInjectCycle() { return injectTime; }
 
         Cycles tlbStartCycle;
+        // Next access of the warp instruction in the order the accesses
+        // were generated, and in the order they were translated
+        CoalescedAccess *coalescedNext;
+        CoalescedAccess *translatedNext;
+        // Next access of the warp instruction to the same virtual page. Only
+        // the first access to a page is translated, and the result is
+        // applied to the rest of the page's accesses.
+        CoalescedAccess *samePageNext;
+        // Next access merged into or serialized behind the same LSQ MSHR
+        CoalescedAccess *mshrNext;
     };
 
   private:
     // Buffers for convenience of tracking accesses for this warp instruction:
 
-    // Buffer to track accesses generated by coalescing stage for this warp
-    // instruction. Accesses are held in this buffer until injected into the
-    // cache hierarchy
-    std::list<CoalescedAccess*> coalescedAccesses;
-    // Buffer to hold accesses that have been translated. Accesses are held in
-    // this buffer until ejected from the cache hierarchy
-    std::list<CoalescedAccess*> translatedAccesses;
+    // Accesses generated by the coalescing stage for this warp instruction,
+    // chained through their coalescedNext pointers, and the number of them
+    // not yet injected into the cache hierarchy
+    CoalescedAccess *coalescedHead;
+    CoalescedAccess *coalescedTail;
+    unsigned numCoalesced;
+    // Accesses that have been translated, chained through their
+    // translatedNext pointers, and the number of them not yet ejected from
+    // the cache hierarchy
+    CoalescedAccess *translatedHead;
+    CoalescedAccess *translatedTail;
+    unsigned numTranslated;
+
+    // Add a newly generated access to the end of the coalesced accesses
+    void addCoalesced(CoalescedAccess *mem_access);
 
     void removeTranslated(CoalescedAccess *mem_access)
     {
-        translatedAccesses.remove(mem_access);
+        assert(numTranslated > 0);
+        numTranslated--;
     }
 
   public:
     WarpInstBuffer(unsigned lane_count, unsigned atoms_per_subline,
-                   unsigned warp_parts = 1)
+                   unsigned line_bytes, unsigned sector_bytes,
+                   Enums::CoalescingRules coalescing_rules,
+                   CoalescedAccessPools *_pools, unsigned warp_parts = 1)
         : warpId(-1), laneCount(lane_count), warpParts(warp_parts),
-          atomsPerSubline(atoms_per_subline), state(EMPTY),
-          instructionType(INVALID)
+          atomsPerSubline(atoms_per_subline), lineBytes(line_bytes),
+          sectorBytes(sector_bytes), coalescingRules(coalescing_rules),
+          state(EMPTY), instructionType(INVALID), pools(_pools),
+          coalescedHead(NULL), coalescedTail(NULL), numCoalesced(0),
+          translatedHead(NULL), translatedTail(NULL), numTranslated(0)
     {
+        assert(laneCount <= MaxLanes);
+        assert(lineBytes % sectorBytes == 0 &&
+               lineBytes / sectorBytes <= MaxSectors);
         laneRequestPkts = new PacketPtr[laneCount];
         for (int i = 0; i < laneCount; i++) {
             laneRequestPkts[i] = NULL;
         }
     }
 
-    ~WarpInstBuffer()
-    {
-        if (!coalescedAccesses.empty()) {
-            std::list<CoalescedAccess*>::iterator iter =
-                                                coalescedAccesses.begin();
-            for (; iter != coalescedAccesses.end(); iter++) {
-                delete (*iter);
-            }
-        }
-    }
+    ~WarpInstBuffer();
 
     int getWarpId() { return warpId; }
     void initializeInstBuffer(PacketPtr pkt)
@@ -222,6 +284,10 @@ class WarpInstBuffer {
         } else if (pkt->cmd == MemCmd::FenceReq) {
             assert(!pkt->req->isSwap());
             instructionType = MEM_FENCE;
+            // The core passes the scope of the fence as the request's extra
+            // data. Fences without one order accesses GPU-wide
+            fenceScope = pkt->req->extraDataValid() ?
+                (Enums::FenceScope)pkt->req->getExtraData() : Enums::GPU;
         } else {
             panic("Instruction type not found!");
         }
@@ -234,14 +300,14 @@ class WarpInstBuffer {
     void startFence() {
         assert(state == DISPATCHING);
         firstCycleTick = curTick();
-        // TODO: If tracking multiple fences concurrently, or enforcing inter-
-        // warp memory orderings, update fence state as appropriate here
+        // TODO: If enforcing inter-warp memory orderings, update fence state
+        // as appropriate here
         state = FENCING;
     }
     void arriveAtFence() {
         assert(state == FENCING);
-        // TODO: If tracking multiple fences concurrently, or enforcing inter-
-        // warp memory orderings, update fence state as appropriate here
+        // TODO: If enforcing inter-warp memory orderings, update fence state
+        // as appropriate here
         state = FENCE_COMPLETE;
     }
     std::string getInstTypeString() {
@@ -251,6 +317,11 @@ class WarpInstBuffer {
     bool isLoad() { return instructionType == LOAD_INST; }
     bool isStore() { return instructionType == STORE_INST; }
     bool isFence() { return instructionType == MEM_FENCE; }
+    Enums::FenceScope getFenceScope()
+    {
+        assert(isFence());
+        return fenceScope;
+    }
     bool isAtomic() { return instructionType == ATOMIC_INST; }
     bool addLaneRequest(unsigned lane_id, PacketPtr pkt);
 
@@ -265,32 +336,46 @@ class WarpInstBuffer {
 
     void removeCoalesced(CoalescedAccess *mem_access)
     {
-        coalescedAccesses.remove(mem_access);
+        assert(numCoalesced > 0);
+        numCoalesced--;
     }
 
     unsigned coalescedAccessesSize()
     {
-        return coalescedAccesses.size();
+        return numCoalesced;
     }
 
-    const std::list<CoalescedAccess*>* getCoalescedAccesses()
+    // The first coalesced access; the rest follow through coalescedNext.
+    // The chain is only walked before any of the accesses complete
+    CoalescedAccess* getCoalescedAccesses()
     {
-        return &coalescedAccesses;
+        return coalescedHead;
     }
 
     void setTranslated(CoalescedAccess *mem_access)
     {
-        translatedAccesses.push_back(mem_access);
+        mem_access->translatedNext = NULL;
+        if (translatedTail) {
+            translatedTail->translatedNext = mem_access;
+        } else {
+            translatedHead = mem_access;
+        }
+        translatedTail = mem_access;
+        numTranslated++;
     }
 
-    const std::list<CoalescedAccess*>* getTranslatedAccesses()
+    // The first translated access; the rest follow through translatedNext.
+    // The chain is only walked before any of the accesses complete
+    CoalescedAccess* getTranslatedAccesses()
     {
-        return &translatedAccesses;
+        return translatedHead;
     }
 
     PacketPtr* getLaneRequestPkts() { return laneRequestPkts; }
     void setCompleteTick(Tick time) { completeCycleTick = time; }
     Tick getCompleteTick() { return completeCycleTick; }
+    Tick getStartTick() { return startTick; }
+    Addr getPC() { return pc; }
     Tick getLatency() { return curTick() - firstCycleTick; }
 
     // When a memory access is complete, update the lane requests accordingly
@@ -299,8 +384,10 @@ class WarpInstBuffer {
     void resetState()
     {
         assert(state == COALESCED || state == FENCE_COMPLETE);
-        assert(coalescedAccesses.empty());
-        assert(translatedAccesses.empty());
+        assert(numCoalesced == 0);
+        assert(numTranslated == 0);
+        coalescedHead = coalescedTail = NULL;
+        translatedHead = translatedTail = NULL;
         warpId = -1;
         state = EMPTY;
         instructionType = INVALID;
@@ -309,4 +396,23 @@ class WarpInstBuffer {
     }
 };
 
+/**
+ * Recycling pools for the coalesced accesses of an LSQ's warp instruction
+ * buffers, and for their requests and data buffers, so that the steady
+ * state memory access path does not use the global allocator.
+ */
+struct CoalescedAccessPools {
+    RecyclingPool accesses;
+    RecyclingPool requests;
+    RecyclingPool data;
+
+    CoalescedAccessPools(unsigned lane_count, unsigned line_bytes,
+                         unsigned initial_accesses)
+        : accesses(sizeof(WarpInstBuffer::CoalescedAccess), initial_accesses),
+          requests(sizeof(Request), initial_accesses),
+          data(WarpInstBuffer::maxAccessDataBytes(lane_count, line_bytes),
+               initial_accesses)
+    {}
+};
+
 #endif
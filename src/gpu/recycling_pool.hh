@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2013 Mark D. Hill and David A. Wood
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer;
+ * redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution;
+ * neither the name of the copyright holders nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RECYCLING_POOL_HH_
+#define RECYCLING_POOL_HH_
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * Pool of fixed-size memory blocks that are recycled instead of being
+ * returned to the global allocator. Objects are constructed in and destroyed
+ * from blocks with create() and destroy(). Blocks are allocated up front and
+ * whenever the pool runs dry, and are only freed with the pool, so once the
+ * pool has grown to the peak number of blocks in use, getting and putting
+ * blocks never allocates.
+ */
+class RecyclingPool
+{
+  private:
+    size_t blockBytes;
+    // All blocks owned by the pool, and those not in use
+    std::vector<uint8_t*> blocks;
+    std::vector<uint8_t*> freeBlocks;
+    unsigned inUse;
+    unsigned maxInUse;
+
+    void grow(unsigned num_blocks)
+    {
+        for (unsigned i = 0; i < num_blocks; i++) {
+            // Array new aligns blocks for any fundamental type
+            blocks.push_back(new uint8_t[blockBytes]);
+            freeBlocks.push_back(blocks.back());
+        }
+    }
+
+  public:
+    RecyclingPool(size_t block_bytes, unsigned initial_blocks)
+        : blockBytes(block_bytes), inUse(0), maxInUse(0)
+    {
+        grow(initial_blocks);
+    }
+
+    // Objects still in flight when the simulator exits go with their blocks
+    ~RecyclingPool()
+    {
+        for (unsigned i = 0; i < blocks.size(); i++) {
+            delete [] blocks[i];
+        }
+    }
+
+    size_t getBlockBytes() const { return blockBytes; }
+
+    void *get()
+    {
+        if (freeBlocks.empty()) {
+            // Double the pool rather than growing a block at a time
+            grow(blocks.empty() ? 1 : blocks.size());
+        }
+        uint8_t *block = freeBlocks.back();
+        freeBlocks.pop_back();
+        inUse++;
+        maxInUse = std::max(maxInUse, inUse);
+        return block;
+    }
+
+    void put(void *block)
+    {
+        assert(inUse > 0);
+        inUse--;
+        freeBlocks.push_back((uint8_t*)block);
+    }
+
+    template <class T, class... Args>
+    T *create(Args&&... args)
+    {
+        assert(sizeof(T) <= blockBytes);
+        return new (get()) T(std::forward<Args>(args)...);
+    }
+
+    template <class T>
+    void destroy(T *obj)
+    {
+        obj->~T();
+        put(obj);
+    }
+
+    /// The most blocks that have been in use at once
+    unsigned highWaterMark() const { return maxInUse; }
+};
+
+#endif // RECYCLING_POOL_HH_
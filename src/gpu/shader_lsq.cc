@@ -29,6 +29,8 @@
  *
  */
 
+#include "base/bitfield.hh"
+#include "base/intmath.hh"
 #include "debug/ShaderLSQ.hh"
 #include "gpu/shader_lsq.hh"
 
@@ -39,18 +41,65 @@ ShaderLSQ::ShaderLSQ(Params *p)
       writebackBlocked(false), cachePort(name() + ".cache_port", this),
       warpSize(p->warp_size), maxNumWarpsPerCore(p->warp_contexts),
       atomsPerSubline(p->atoms_per_subline),
-      flushing(false), flushingPkt(NULL), forwardFlush(p->forward_flush),
-      warpInstBufPoolSize(p->num_warp_inst_buffers), dispatchWarpInstBuf(NULL),
+      perWarpFlushes(p->warp_contexts, 0),
+      perWarpActiveInsts(p->warp_contexts, 0),
+      forwardFlush(p->forward_flush), flushForwarded(false),
+      warpInstBufPoolSize(p->num_warp_inst_buffers),
+      accessPools(p->warp_size, p->cache_line_size, p->num_warp_inst_buffers),
+      translationPool(sizeof(AccessTranslation), p->num_warp_inst_buffers),
+      dispatchWidth(p->dispatch_width),
       perWarpInstructionQueues(p->warp_contexts),
       perWarpOutstandingAccesses(p->warp_contexts),
       overallLatencyCycles(p->latency), l1TagAccessCycles(p->l1_tag_cycles),
       tlb(p->data_tlb), sublineBytes(p->subline_bytes),
       nextAllowedInject(Cycles(0)), injectWidth(p->inject_width),
-      mshrsFull(false), ejectWidth(p->eject_width), cacheLineAddrMaskBits(-1),
+      mshrTable(p->mshr_entries, p->cache_line_size),
+      mshrMergeCapacity(p->mshr_merge_capacity), mshrTableFull(false),
+      injectPolicy(p->inject_policy), lastInjectWarp(-1),
+      l2Slices(p->l2_slices), lastInjectSlice(-1),
+      l2SelectNumBits(p->l2_select_num_bits),
+      l2SelectLowBit(p->l2_select_low_bit),
+      mshrsFull(false), readEjectWidth(p->read_eject_width),
+      writeEjectWidth(p->write_eject_width),
+      responseBeatsPerCycle(p->response_bytes_per_cycle / p->subline_bytes),
+      readBeatsRemaining(0), ejectCycle(0), readsEjected(0),
+      writesEjected(0), beatsEjected(0), cacheLineAddrMaskBits(-1),
       lastWarpInstBufferChange(0), numActiveWarpInstBuffers(0),
       dispatchInstEvent(this), injectAccessesEvent(this),
-      ejectAccessesEvent(this), commitInstEvent(this)
+      ejectAccessesEvent(this), commitInstEvent(this),
+      issueTranslationsEvent(this)
 {
+    if (warpSize > WarpInstBuffer::MaxLanes) {
+        fatal("%s: warp size %d exceeds the %d lanes the coalescer supports",
+              name(), warpSize, WarpInstBuffer::MaxLanes);
+    }
+    if (!isPowerOf2(p->subline_bytes) || p->subline_bytes < 16 ||
+        !isPowerOf2(p->cache_line_size) ||
+        p->cache_line_size < p->subline_bytes ||
+        p->cache_line_size / p->subline_bytes > WarpInstBuffer::MaxSectors) {
+        fatal("%s: unsupported %dB sectors in %dB lines", name(),
+              p->subline_bytes, p->cache_line_size);
+    }
+
+    if (l2Slices == 0) {
+        fatal("%s: l2_slices must be at least 1", name());
+    }
+    if (l2SelectNumBits >= 32 || l2Slices > (1 << l2SelectNumBits)) {
+        fatal("%s: %d l2_select_num_bits cannot select %d L2 slices",
+              name(), l2SelectNumBits, l2Slices);
+    }
+    if (injectPolicy == Enums::SliceLocality && l2Slices == 1) {
+        warn("%s: SliceLocality arbitration with a single L2 slice injects "
+             "oldest warp first", name());
+    }
+    if (readEjectWidth == 0) {
+        fatal("%s: read_eject_width must be at least 1", name());
+    }
+    if (p->response_bytes_per_cycle % p->subline_bytes) {
+        fatal("%s: response_bytes_per_cycle must be a multiple of the %dB "
+              "sublines", name(), p->subline_bytes);
+    }
+
     // Create the lane ports based on the number threads per warp
     for (int i = 0; i < warpSize; i++) {
         lanePorts.push_back(
@@ -61,9 +110,24 @@ ShaderLSQ::ShaderLSQ(Params *p)
         perWarpOutstandingAccesses[i] = 0;
     }
 
+    if (dispatchWidth == 0) {
+        fatal("%s: dispatch_width must be at least 1", name());
+    }
+    // Scoped flushes name the warps they cover in a 64-bit mask
+    if (maxNumWarpsPerCore > 64) {
+        fatal("%s: At most 64 warp_contexts are supported (got %d)", name(),
+              maxNumWarpsPerCore);
+    }
+    dispatchWarpInstBufs.reserve(dispatchWidth);
+    pageTails.reserve(warpSize);
+
     warpInstBufPool = new WarpInstBuffer*[warpInstBufPoolSize];
     for (int i = 0; i < warpInstBufPoolSize; i++) {
-        warpInstBufPool[i] = new WarpInstBuffer(warpSize, atomsPerSubline);
+        warpInstBufPool[i] = new WarpInstBuffer(warpSize, atomsPerSubline,
+                                                p->cache_line_size,
+                                                p->subline_bytes,
+                                                p->coalescing_rules,
+                                                &accessPools);
         availableWarpInstBufs.push(warpInstBufPool[i]);
     }
 
@@ -81,6 +145,11 @@ ShaderLSQ::ShaderLSQ(Params *p)
 
     // Set the number of bits to mask for cache line addresses
     cacheLineAddrMaskBits = log2(p->cache_line_size);
+
+    // By default, Ruby selects L2 banks with the bits above the line offset
+    if (l2SelectLowBit == 0) {
+        l2SelectLowBit = cacheLineAddrMaskBits;
+    }
 }
 
 ShaderLSQ::~ShaderLSQ()
@@ -205,14 +274,31 @@ ShaderLSQ::CachePort::recvReqRetry()
 bool
 ShaderLSQ::addFlushRequest(PacketPtr pkt)
 {
-    // TODO: When flush is for a particular warp (e.g. membar instruction),
-    // set a flag that blocks incoming requests to that particular warp until
-    // it is freed, and then send a response to the membar flush
     assert(pkt->req->getPaddr() == Addr(0));
-    flushing = true;
-    flushingPkt = pkt;
-    DPRINTF(ShaderLSQ, "Received flush request\n");
-    if (numActiveWarpInstBuffers == 0) processFlush();
+
+    // Flushes scoped to a warp or CTA carry a mask of the warps they cover in
+    // the request. Without a mask, the flush covers all warps in the SM
+    PendingFlush flush;
+    flush.pkt = pkt;
+    flush.warps.resize(maxNumWarpsPerCore, true);
+    flush.drained = false;
+    flush.flushCache = (pkt->cmd == MemCmd::FlushAllReq);
+    flush.forwarded = false;
+    if (pkt->req->extraDataValid()) {
+        uint64_t warp_mask = pkt->req->getExtraData();
+        for (int i = 0; i < maxNumWarpsPerCore; i++) {
+            flush.warps[i] = bits(warp_mask, i);
+        }
+        DPRINTF(ShaderLSQ, "Received flush request for warps: %#x\n",
+                warp_mask);
+    } else {
+        DPRINTF(ShaderLSQ, "Received flush request for all warps\n");
+    }
+    for (int i = 0; i < maxNumWarpsPerCore; i++) {
+        if (flush.warps[i]) perWarpFlushes[i]++;
+    }
+    pendingFlushes.push_back(flush);
+    processFlushes();
     return true;
 }
 
@@ -241,18 +327,40 @@ ShaderLSQ::decrementActiveWarpInstBuffers()
 bool
 ShaderLSQ::addLaneRequest(int lane_id, PacketPtr pkt)
 {
-    if (flushing) {
-        // ShaderLSQ does not currently support starting further requests
-        // while it is flushing at the end of a kernel
-        // TODO: If adding flush support at a finer granularity than the
-        // complete LSQ, this code path will need to be updated appropriately
-        panic("ShaderLSQ does not support adding requests while flushing\n");
-        return false;
+    // Find the warp instruction being dispatched that this request is from
+    WarpInstBuffer *dispatch_buf = NULL;
+    for (int i = 0; i < dispatchWarpInstBufs.size(); i++) {
+        if (dispatchWarpInstBufs[i]->getWarpId() == pkt->req->threadId() &&
+            dispatchWarpInstBufs[i]->getPC() == pkt->req->getPC()) {
+            dispatch_buf = dispatchWarpInstBufs[i];
+            break;
+        }
     }
 
-    if (!dispatchWarpInstBuf) {
-        assert(!dispatchInstEvent.scheduled());
-        assert(pkt->req->threadId() < maxNumWarpsPerCore);
+    if (!dispatch_buf) {
+        int warp_id = pkt->req->threadId();
+        assert(warp_id < maxNumWarpsPerCore);
+
+        // A warp being flushed may not start new warp instructions until
+        // the flush completes. Lanes of an instruction that already started
+        // dispatching are still accepted above
+        if (perWarpFlushes[warp_id] > 0) {
+            flushRejects++;
+            DPRINTF(ShaderLSQ,
+                    "[%d:%d] Warp is flushing, rejected request for "
+                    "vaddr: %p\n", warp_id, lane_id, pkt->req->getVaddr());
+            return false;
+        }
+
+        if (dispatchWarpInstBufs.size() == dispatchWidth) {
+            // All dispatch slots for this cycle are taken
+            dispatchWidthRejects++;
+            DPRINTF(ShaderLSQ,
+                    "[%d:%d] Dispatch width full, rejected request for "
+                    "vaddr: %p\n", pkt->req->threadId(), lane_id,
+                    pkt->req->getVaddr());
+            return false;
+        }
 
         // TODO: Consider putting in a per-warp limitation on number of
         // concurrent warp instructions in the LSQ
@@ -266,32 +374,36 @@ ShaderLSQ::addLaneRequest(int lane_id, PacketPtr pkt)
 
         // Allocate and initialize a warp instruction dispatch buffer to
         // gather the requests before coalescing into cache accesses
-        dispatchWarpInstBuf = availableWarpInstBufs.front();
-        dispatchWarpInstBuf->initializeInstBuffer(pkt);
+        dispatch_buf = availableWarpInstBufs.front();
+        dispatch_buf->initializeInstBuffer(pkt);
         availableWarpInstBufs.pop();
         incrementActiveWarpInstBuffers();
+        perWarpActiveInsts[warp_id]++;
+        dispatchWarpInstBufs.push_back(dispatch_buf);
 
-        // Schedule an event for when the dispatch buffer should be handled
-        schedule(dispatchInstEvent, clockEdge(Cycles(0)));
+        // Schedule an event for when the dispatch buffers should be handled
+        if (!dispatchInstEvent.scheduled()) {
+            schedule(dispatchInstEvent, clockEdge(Cycles(0)));
+        }
         DPRINTF(ShaderLSQ,
                 "[%d: ] Starting %s instruction (pc: 0x%x) at tick: %llu\n",
-                pkt->req->threadId(), dispatchWarpInstBuf->getInstTypeString(),
+                pkt->req->threadId(), dispatch_buf->getInstTypeString(),
                 pkt->req->getPC(), clockEdge(Cycles(0)));
     }
 
-    bool request_added = dispatchWarpInstBuf->addLaneRequest(lane_id, pkt);
+    bool request_added = dispatch_buf->addLaneRequest(lane_id, pkt);
 
     if (request_added) {
         DPRINTF(ShaderLSQ,
                 "[%d:%d] Received %s request for vaddr: %p, size: %d\n",
                 pkt->req->threadId(), lane_id,
-                dispatchWarpInstBuf->getInstTypeString(),
+                dispatch_buf->getInstTypeString(),
                 pkt->req->getVaddr(), pkt->getSize());
     } else {
         DPRINTF(ShaderLSQ,
                 "[%d:%d] Rejected %s request for vaddr: %p, size: %d\n",
                 pkt->req->threadId(), lane_id,
-                dispatchWarpInstBuf->getInstTypeString(),
+                dispatch_buf->getInstTypeString(),
                 pkt->req->getVaddr(), pkt->getSize());
     }
 
@@ -300,30 +412,39 @@ ShaderLSQ::addLaneRequest(int lane_id, PacketPtr pkt)
 
 void
 ShaderLSQ::dispatchWarpInst()
+{
+    // Dispatch the warp instructions in the order they arrived, so that
+    // instructions from the same warp stay in program order
+    assert(!dispatchWarpInstBufs.empty());
+    warpInstsDispatched.sample(dispatchWarpInstBufs.size());
+    for (int i = 0; i < dispatchWarpInstBufs.size(); i++) {
+        dispatchWarpInst(dispatchWarpInstBufs[i]);
+    }
+
+    // Clear the dispatch buffers
+    dispatchWarpInstBufs.clear();
+}
+
+void
+ShaderLSQ::dispatchWarpInst(WarpInstBuffer *warp_inst)
 {
     // Queue the warp instruction to begin issuing accesses after
     // translations complete
-    perWarpInstructionQueues[dispatchWarpInstBuf->getWarpId()].push(dispatchWarpInstBuf);
-
-    if (dispatchWarpInstBuf->isFence()) {
-        unsigned warp_id = dispatchWarpInstBuf->getWarpId();
-        dispatchWarpInstBuf->startFence();
-        if (perWarpOutstandingAccesses[warp_id] == 0 &&
-            perWarpInstructionQueues[warp_id].front() == dispatchWarpInstBuf) {
+    perWarpInstructionQueues[warp_inst->getWarpId()].push(warp_inst);
 
-            clearFenceAtQueueHead(warp_id);
-            assert(perWarpInstructionQueues[warp_id].empty());
+    if (warp_inst->isFence()) {
+        unsigned warp_id = warp_inst->getWarpId();
+        warp_inst->startFence();
+        if (perWarpInstructionQueues[warp_id].front() == warp_inst) {
+            startWarpQueueHead(warp_id);
         }
     } else {
         // Coalesce memory requests for the dispatched warp instruction
-        dispatchWarpInstBuf->coalesceMemRequests();
+        warp_inst->coalesceMemRequests();
 
         // Issue translation requests for the coalesced accesses
-        issueWarpInstTranslations(dispatchWarpInstBuf);
+        issueWarpInstTranslations(warp_inst);
     }
-
-    // Clear the dispatch buffer
-    dispatchWarpInstBuf = NULL;
 }
 
 void
@@ -338,49 +459,117 @@ ShaderLSQ::issueWarpInstTranslations(WarpInstBuffer *warp_inst)
         panic("Trying to issue translations for unknown instruction type!");
     }
 
-    const list<WarpInstBuffer::CoalescedAccess*> *coalesced_accesses =
+    warpCoalescedAccesses.sample(warp_inst->coalescedAccessesSize());
+    // Translate each virtual page once: Chain later accesses to a page
+    // behind the first, which carries the translation for all of them.
+    // Warp instructions touch few pages, so a linear search suffices.
+    pageTails.clear();
+    unsigned num_pending = pendingTranslations.size();
+    WarpInstBuffer::CoalescedAccess *mem_access =
             warp_inst->getCoalescedAccesses();
-    warpCoalescedAccesses.sample(coalesced_accesses->size());
-    list<WarpInstBuffer::CoalescedAccess*>::const_iterator iter =
-            coalesced_accesses->begin();
-    for (; iter != coalesced_accesses->end(); iter++) {
-        WarpInstBuffer::CoalescedAccess *mem_access = *iter;
+    for (; mem_access; mem_access = mem_access->coalescedNext) {
+        mem_access->samePageNext = NULL;
+        Addr vp_base = roundDown(mem_access->req->getVaddr(),
+                                 TheISA::PageBytes);
+        bool merged = false;
+        for (int i = 0; i < pageTails.size(); i++) {
+            if (roundDown(pageTails[i]->req->getVaddr(), TheISA::PageBytes) ==
+                vp_base) {
+                pageTails[i]->samePageNext = mem_access;
+                pageTails[i] = mem_access;
+                merged = true;
+                coalescedTranslations++;
+                break;
+            }
+        }
+        if (!merged) {
+            pageTails.push_back(mem_access);
+            PendingTranslation pending = { mem_access, mode };
+            pendingTranslations.push_back(pending);
+        }
+    }
+    warpTranslations += pendingTranslations.size() - num_pending;
+
+    if (!issueTranslationsEvent.scheduled()) {
+        issuePendingTranslations();
+    }
+}
+
+void
+ShaderLSQ::issuePendingTranslations()
+{
+    while (!pendingTranslations.empty() && tlb->lookupPortAvailable()) {
+        WarpInstBuffer::CoalescedAccess *mem_access =
+            pendingTranslations.front().memAccess;
+        BaseTLB::Mode mode = pendingTranslations.front().mode;
+        pendingTranslations.pop_front();
+
         RequestPtr req = mem_access->req;
         DPRINTF(ShaderLSQ, "[%d: ] Translating vaddr: %p\n",
                 mem_access->getWarpId(), req->getVaddr());
 
-        req->setExtraData((uint64_t)mem_access);
-
-        WholeTranslationState *state =
-                new WholeTranslationState(req, NULL, NULL, mode);
-        DataTranslation<ShaderLSQ*> *translation
-                = new DataTranslation<ShaderLSQ*>(this, state);
+        AccessTranslation *translation =
+            translationPool.create<AccessTranslation>(this, mem_access);
 
         mem_access->tlbStartCycle = curCycle();
         tlb->beginTranslateTiming(req, translation, mode);
     }
+
+    if (!pendingTranslations.empty()) {
+        // TLB lookup ports are saturated, so try again next cycle
+        DPRINTF(ShaderLSQ, "TLB ports busy, %d translations waiting\n",
+                pendingTranslations.size());
+        tlbPortStallCycles++;
+        schedule(issueTranslationsEvent, clockEdge(Cycles(1)));
+    }
 }
 
 void
-ShaderLSQ::finishTranslation(WholeTranslationState *state)
+ShaderLSQ::finishTranslation(AccessTranslation *translation,
+                             const Fault &fault)
 {
-    if (state->getFault() != NoFault) {
+    WarpInstBuffer::CoalescedAccess *mem_access = translation->memAccess;
+    bool delayed = translation->delayed;
+    translationPool.destroy(translation);
+
+    if (fault != NoFault) {
         // The ShaderLSQ and ShaderTLBs do not currently have a way to signal
         // to a CPU core how a fault should be handled. With current
         // organization, this should not occur unless there are bugs in GPU
         // memory handling
         panic("Translation encountered fault (%s) for address 0x%x\n",
-              state->getFault()->name(), state->mainReq->getVaddr());
+              fault->name(), mem_access->req->getVaddr());
     }
 
-    WarpInstBuffer::CoalescedAccess *mem_access =
-        (WarpInstBuffer::CoalescedAccess*)state->mainReq->getExtraData();
-
     DPRINTF(ShaderLSQ,
             "[%d: ] Finished translation for vaddr: %p, paddr: %p\n",
-            mem_access->getWarpId(), state->mainReq->getVaddr(),
-            state->mainReq->getPaddr());
+            mem_access->getWarpId(), mem_access->req->getVaddr(),
+            mem_access->req->getPaddr());
+
+    if (delayed) {
+        tlbMissLatency.sample(curCycle() - mem_access->tlbStartCycle);
+    }
+
+    // Apply the translation to the other accesses to the same page
+    RequestPtr req = mem_access->req;
+    Addr vp_base = roundDown(req->getVaddr(), TheISA::PageBytes);
+    Addr pp_base = req->getPaddr() - (req->getVaddr() - vp_base);
+    WarpInstBuffer::CoalescedAccess *same_page = mem_access->samePageNext;
+    completeTranslation(mem_access);
+    while (same_page) {
+        WarpInstBuffer::CoalescedAccess *next = same_page->samePageNext;
+        same_page->samePageNext = NULL;
+        RequestPtr same_page_req = same_page->req;
+        same_page_req->setPaddr(pp_base +
+                                (same_page_req->getVaddr() - vp_base));
+        completeTranslation(same_page);
+        same_page = next;
+    }
+}
 
+void
+ShaderLSQ::completeTranslation(WarpInstBuffer::CoalescedAccess *mem_access)
+{
     // Initialize the packet using the translated access and in the case that
     // this is a write access, set the data to be sent to cache
     PacketPtr pkt = mem_access;
@@ -389,15 +578,9 @@ ShaderLSQ::finishTranslation(WholeTranslationState *state)
         mem_access->moveDataToPacket();
     } else {
         assert(pkt->isRead());
-        pkt->allocate();
+        mem_access->allocateData();
     }
 
-    if (state->delay) {
-        tlbMissLatency.sample(curCycle() - mem_access->tlbStartCycle);
-    }
-
-    delete state;
-
     WarpInstBuffer *warp_inst = mem_access->getWarpBuffer();
     warp_inst->setTranslated(mem_access);
 
@@ -423,31 +606,82 @@ ShaderLSQ::pushToInjectBuffer(WarpInstBuffer::CoalescedAccess *mem_access)
             clockEdge(mem_access->getInjectCycle()));
 }
 
+bool
+ShaderLSQ::canMergeAccess(LSQMSHRTable::Entry *mshr,
+                          WarpInstBuffer::CoalescedAccess *mem_access)
+{
+    // Only loads covered by an outstanding load can complete from its
+    // response
+    WarpInstBuffer::CoalescedAccess *issued = mshr->issued;
+    assert(issued);
+    return mshr->numMerged < mshrMergeCapacity &&
+           mem_access->cmd == MemCmd::ReadReq &&
+           issued->cmd == MemCmd::ReadReq &&
+           mem_access->req->isBypassL1() == issued->req->isBypassL1() &&
+           mem_access->getAddr() >= issued->getAddr() &&
+           mem_access->getAddr() + mem_access->getSize() <=
+               issued->getAddr() + issued->getSize();
+}
+
 void
 ShaderLSQ::injectCacheAccesses()
 {
     assert(!mshrsFull);
     assert(!injectBuffer.empty());
     unsigned num_injected = 0;
-    WarpInstBuffer::CoalescedAccess *mem_access = injectBuffer.front();
-    while (!injectBuffer.empty() && num_injected < injectWidth &&
-           curCycle() >= nextAllowedInject &&
-           curCycle() >= mem_access->getInjectCycle()) {
+    InjectIterator pos = selectInjectAccess();
+    while (pos != injectBuffer.end() && num_injected < injectWidth &&
+           curCycle() >= nextAllowedInject) {
 
+        WarpInstBuffer::CoalescedAccess *mem_access = *pos;
         Addr line_addr = addrToLine(mem_access->req->getPaddr());
-        if (blockedLineAddrs[line_addr]) {
+        LSQMSHRTable::Entry *mshr = mshrTable.find(line_addr);
+        if (mshr && mshr->issued && canMergeAccess(mshr, mem_access)) {
+            // Complete this load with the response to the outstanding one
+            // NOTE: Like queuing below, this is not counted against the
+            // injection width for this cycle
+            mem_access->mshrNext = mshr->mergedHead;
+            mshr->mergedHead = mem_access;
+            mshr->numMerged++;
+            dequeueInjectAccess(pos);
+            mshrMergedAccesses++;
+            DPRINTF(ShaderLSQ,
+                    "[%d: ] Merged %s access for paddr: %p\n",
+                    mem_access->getWarpId(),
+                    mem_access->getWarpBuffer()->getInstTypeString(),
+                    mem_access->req->getPaddr());
+            accessInjected(mem_access);
+        } else if (mshr && mshr->issued) {
             // Unblock inject buffer by queuing access to wait for prior access
             // NOTE: This path must inspect the CoalescedAccess to see if it
             // can be injected. This could be counted against the injection
             // width for this cycle, but it is not currently counted here
-            blockedAccesses[line_addr].push(mem_access);
-            injectBuffer.pop_front();
+            mem_access->mshrNext = NULL;
+            if (mshr->blockedTail) {
+                mshr->blockedTail->mshrNext = mem_access;
+            } else {
+                mshr->blockedHead = mem_access;
+            }
+            mshr->blockedTail = mem_access;
+            dequeueInjectAccess(pos);
             mshrHitQueued++;
             DPRINTF(ShaderLSQ,
                     "[%d: ] Line blocked %s access for paddr: %p\n",
                     mem_access->getWarpId(),
                     mem_access->getWarpBuffer()->getInstTypeString(),
                     mem_access->req->getPaddr());
+        } else if (!mshr && mshrTable.full()) {
+            // Wait for a response to free an MSHR
+            DPRINTF(ShaderLSQ,
+                    "[%d: ] LSQ MSHRs full, blocked %s access for paddr: %p\n",
+                    mem_access->getWarpId(),
+                    mem_access->getWarpBuffer()->getInstTypeString(),
+                    mem_access->req->getPaddr());
+            if (!mshrTableFull) {
+                mshrTableFull = true;
+                mshrTableFullStarted = curCycle();
+            }
+            return;
         } else {
             if (!cachePort.sendTimingReq(mem_access)) {
                 DPRINTF(ShaderLSQ,
@@ -465,44 +699,25 @@ ShaderLSQ::injectCacheAccesses()
                         mem_access->getWarpId(),
                         mem_access->getWarpBuffer()->getInstTypeString(),
                         mem_access->req->getPaddr());
-                blockedLineAddrs[line_addr] = true;
+                if (!mshr) {
+                    mshr = mshrTable.allocate(line_addr);
+                }
+                mshr->issued = mem_access;
                 if (mem_access->isWrite()) {
                     // Block issue while the store data is being serialized
                     // through the port to the cache (1 cyc/subline)
                     unsigned num_sublines = mem_access->getSize() / sublineBytes;
                     nextAllowedInject = Cycles(curCycle() + num_sublines);
                 }
-                injectBuffer.pop_front();
+                dequeueInjectAccess(pos);
                 num_injected++;
-                perWarpOutstandingAccesses[mem_access->getWarpId()]++;
                 accessesOutstandingToCache++;
-                WarpInstBuffer *warp_inst = mem_access->getWarpBuffer();
-                warp_inst->removeCoalesced(mem_access);
-                if (warp_inst->coalescedAccessesSize() == 0) {
-                    int warp_id = warp_inst->getWarpId();
-                    // All accesses have entered cache hierarchy, so remove
-                    // this warp instruction from the issuing position (head)
-                    // to let the next warp instruction from this warp inject
-                    perWarpInstructionQueues[warp_id].pop();
-                    if (!perWarpInstructionQueues[warp_id].empty()) {
-                        WarpInstBuffer *next_warp_inst =
-                                perWarpInstructionQueues[warp_id].front();
-                        if (!next_warp_inst->isFence()) {
-                            const list<WarpInstBuffer::CoalescedAccess*> *translated_accesses =
-                                    next_warp_inst->getTranslatedAccesses();
-                            list<WarpInstBuffer::CoalescedAccess*>::const_iterator iter =
-                                    translated_accesses->begin();
-                            for (; iter != translated_accesses->end(); iter++) {
-                                pushToInjectBuffer(*iter);
-                            }
-                        }
-                    }
-                }
+                accessInjected(mem_access);
             }
         }
 
         // Get the next access to check if it can also be injected
-        mem_access = injectBuffer.front();
+        pos = selectInjectAccess();
     }
 
     if (!injectBuffer.empty()) {
@@ -517,6 +732,95 @@ ShaderLSQ::injectCacheAccesses()
     }
 }
 
+ShaderLSQ::InjectIterator
+ShaderLSQ::selectInjectAccess()
+{
+    // Accesses become ready to inject in inject buffer order, so only the
+    // ready accesses at the front of the buffer are candidates
+    InjectIterator selected = injectBuffer.end();
+    InjectIterator iter = injectBuffer.begin();
+    for (; iter != injectBuffer.end() &&
+           curCycle() >= (*iter)->getInjectCycle(); iter++) {
+        if (selected == injectBuffer.end() ||
+            preferInjectAccess(*iter, *selected)) {
+            selected = iter;
+        }
+        if (injectPolicy == Enums::FIFO) {
+            break;
+        }
+    }
+    return selected;
+}
+
+bool
+ShaderLSQ::preferInjectAccess(WarpInstBuffer::CoalescedAccess *access,
+                              WarpInstBuffer::CoalescedAccess *other)
+{
+    // Otherwise equal accesses are injected in inject buffer order
+    bool older = access->getWarpBuffer()->getStartTick() <
+                 other->getWarpBuffer()->getStartTick();
+    switch (injectPolicy) {
+      case Enums::FIFO:
+        return false;
+      case Enums::OldestWarpFirst:
+        return older;
+      case Enums::RoundRobin: {
+        // The next warp after the last one to inject goes first
+        unsigned distance = (access->getWarpId() - lastInjectWarp - 1 +
+                             maxNumWarpsPerCore) % maxNumWarpsPerCore;
+        unsigned other_distance = (other->getWarpId() - lastInjectWarp - 1 +
+                                   maxNumWarpsPerCore) % maxNumWarpsPerCore;
+        return distance < other_distance;
+      }
+      case Enums::GreedyThenOldest: {
+        bool greedy = access->getWarpId() == lastInjectWarp;
+        if (greedy != (other->getWarpId() == lastInjectWarp)) {
+            return greedy;
+        }
+        return older;
+      }
+      case Enums::SliceLocality: {
+        // Keep sending to the same L2 slice while there are accesses to it
+        bool same_slice = addrToSlice(access->req->getPaddr()) ==
+                          lastInjectSlice;
+        if (same_slice !=
+            (addrToSlice(other->req->getPaddr()) == lastInjectSlice)) {
+            return same_slice;
+        }
+        return older;
+      }
+      default:
+        panic("Unknown inject arbitration policy %d\n", injectPolicy);
+    }
+}
+
+void
+ShaderLSQ::dequeueInjectAccess(InjectIterator pos)
+{
+    WarpInstBuffer::CoalescedAccess *mem_access = *pos;
+    injectBuffer.erase(pos);
+    warpInjectWaitCycles[mem_access->getWarpId()]
+        .sample(curCycle() - mem_access->getInjectCycle());
+    lastInjectWarp = mem_access->getWarpId();
+    lastInjectSlice = addrToSlice(mem_access->req->getPaddr());
+}
+
+void
+ShaderLSQ::accessInjected(WarpInstBuffer::CoalescedAccess *mem_access)
+{
+    perWarpOutstandingAccesses[mem_access->getWarpId()]++;
+    WarpInstBuffer *warp_inst = mem_access->getWarpBuffer();
+    warp_inst->removeCoalesced(mem_access);
+    if (warp_inst->coalescedAccessesSize() == 0) {
+        int warp_id = warp_inst->getWarpId();
+        // All accesses have entered cache hierarchy, so remove
+        // this warp instruction from the issuing position (head)
+        // to let the next warp instruction from this warp inject
+        perWarpInstructionQueues[warp_id].pop();
+        startWarpQueueHead(warp_id);
+    }
+}
+
 void
 ShaderLSQ::scheduleRetryInject()
 {
@@ -534,8 +838,8 @@ ShaderLSQ::recvResponsePkt(PacketPtr pkt)
 {
     if (pkt->isFlush()) {
         assert(pkt->isResponse());
-        assert(forwardFlush);
-        finalizeFlush();
+        assert(forwardFlush && flushForwarded);
+        finalizeFlushes();
         delete pkt->req;
         delete pkt;
         return true;
@@ -544,36 +848,69 @@ ShaderLSQ::recvResponsePkt(PacketPtr pkt)
             dynamic_cast<WarpInstBuffer::CoalescedAccess*>(pkt);
     assert(mem_access);
 
-    // Push the completed memory access into eject buffer
-    ejectBuffer.push(mem_access);
+    // Push the completed memory access into eject buffer. Only reads return
+    // data on the response path to the core
+    if (mem_access->getWarpBuffer()->isStore()) {
+        writeEjectBuffer.push(mem_access);
+    } else {
+        readEjectBuffer.push(mem_access);
+    }
 
-    // Check for unblocked accesses, and schedule inject if possible
     Addr line_addr = addrToLine(mem_access->req->getPaddr());
-    assert(blockedLineAddrs[line_addr]);
-    blockedLineAddrs.erase(line_addr);
-    if (blockedAccesses.count(line_addr) > 0) {
-        assert(!blockedAccesses[line_addr].empty());
+    LSQMSHRTable::Entry *mshr = mshrTable.find(line_addr);
+    assert(mshr && mshr->issued == mem_access);
+    mshr->issued = NULL;
+
+    // Complete the loads merged into this access from its data
+    while (mshr->mergedHead) {
+        WarpInstBuffer::CoalescedAccess *merged = mshr->mergedHead;
+        mshr->mergedHead = merged->mshrNext;
+        merged->mshrNext = NULL;
+        merged->makeResponse();
+        memcpy(merged->getPtr<uint8_t>(),
+               mem_access->getPtr<uint8_t>() +
+                   (merged->getAddr() - mem_access->getAddr()),
+               merged->getSize());
+        readEjectBuffer.push(merged);
+    }
+    mshr->numMerged = 0;
+
+    // Check for unblocked accesses, and schedule inject if possible
+    bool schedule_inject = false;
+    if (mshr->blockedHead) {
         // Previously blocked accesses get priority, so add one to the
-        // front of the inject buffer, and schedule inject event
+        // front of the inject buffer, and schedule inject event. It reuses
+        // this line's MSHR when injected.
         // NOTE: Pushing unblocked memory accesses to the front of the inject
         // queue constitutes an arbitration decision, which could be changed
         // in the future. Unblocked accesses could be pushed at any point in
         // the queue (as long as per-warp instruction ordering is preserved)
-        WarpInstBuffer::CoalescedAccess *next_access =
-                                            blockedAccesses[line_addr].front();
-        blockedAccesses[line_addr].pop();
-        if (blockedAccesses[line_addr].empty()) {
-            blockedAccesses.erase(line_addr);
+        WarpInstBuffer::CoalescedAccess *next_access = mshr->blockedHead;
+        mshr->blockedHead = next_access->mshrNext;
+        if (!mshr->blockedHead) {
+            mshr->blockedTail = NULL;
         }
+        next_access->mshrNext = NULL;
         // Assert that the unblocked access has been tried for inject previously
         assert(curCycle() > next_access->getInjectCycle());
+        // It is ready now, and its inject wait restarts from here
+        next_access->setInjectCycle(curCycle());
         injectBuffer.push_front(next_access);
-        if (!mshrsFull) {
-            if (injectAccessesEvent.scheduled()) {
-                reschedule(injectAccessesEvent, clockEdge(Cycles(0)));
-            } else {
-                schedule(injectAccessesEvent, clockEdge(Cycles(0)));
-            }
+        schedule_inject = true;
+    } else {
+        mshrTable.release(mshr);
+        if (mshrTableFull) {
+            // An MSHR is free for the access at the head of the inject buffer
+            mshrTableFull = false;
+            mshrTableFullCycles += curCycle() - mshrTableFullStarted;
+            schedule_inject = true;
+        }
+    }
+    if (schedule_inject && !mshrsFull) {
+        if (injectAccessesEvent.scheduled()) {
+            reschedule(injectAccessesEvent, clockEdge(Cycles(0)));
+        } else {
+            schedule(injectAccessesEvent, clockEdge(Cycles(0)));
         }
     }
 
@@ -592,50 +929,145 @@ ShaderLSQ::recvResponsePkt(PacketPtr pkt)
 void
 ShaderLSQ::ejectAccessResponses()
 {
-    // TODO: Consider separating readEjectWidth from writeEjectWidth, since
-    // reads are only responses that consume bandwidth on return to the core
-    assert(!ejectBuffer.empty());
-    unsigned num_ejected = 0;
-    while (!ejectBuffer.empty() && num_ejected < ejectWidth) {
-        WarpInstBuffer::CoalescedAccess *mem_access = ejectBuffer.front();
-        WarpInstBuffer *warp_inst = mem_access->getWarpBuffer();
-        DPRINTF(ShaderLSQ,
-                "[%d: ] Ejected %s for vaddr: %p, paddr: %p\n",
-                warp_inst->getWarpId(),
-                warp_inst->getInstTypeString(),
-                mem_access->req->getVaddr(), mem_access->req->getPaddr());
-        perWarpOutstandingAccesses[mem_access->getWarpId()]--;
-        bool inst_complete = warp_inst->finishAccess(mem_access);
-        if (inst_complete) {
-            pushToCommitBuffer(warp_inst);
-
-            // If there is a fence at the head of the per-warp instruction queue
-            // and all prior per-warp memory accesses are complete, clear it
-            int warp_id = warp_inst->getWarpId();
-            if (perWarpOutstandingAccesses[warp_id] == 0 &&
-                !perWarpInstructionQueues[warp_id].empty() &&
-                perWarpInstructionQueues[warp_id].front()->isFence()) {
-
-                clearFenceAtQueueHead(warp_id);
+    assert(!readEjectBuffer.empty() || !writeEjectBuffer.empty());
+
+    // Responses may trigger this stage more than once per cycle, so carry
+    // the resources already used over until the cycle ends
+    if (curCycle() != ejectCycle) {
+        ejectCycle = curCycle();
+        readsEjected = 0;
+        writesEjected = 0;
+        beatsEjected = 0;
+    }
+
+    // Read data occupies the response path in subline-sized beats. A read
+    // larger than the remaining beats in this cycle continues sending in
+    // the following cycles, and is ejected once all of its data is back
+    unsigned beats_before = beatsEjected;
+    while (!readEjectBuffer.empty() && readsEjected < readEjectWidth) {
+        WarpInstBuffer::CoalescedAccess *mem_access = readEjectBuffer.front();
+        if (responseBeatsPerCycle > 0) {
+            if (readBeatsRemaining == 0) {
+                readBeatsRemaining = divCeil(mem_access->getSize(),
+                                             sublineBytes);
             }
+            unsigned beats = min(readBeatsRemaining,
+                                 responseBeatsPerCycle - beatsEjected);
+            readBeatsRemaining -= beats;
+            beatsEjected += beats;
+            if (readBeatsRemaining > 0) break;
+        } else {
+            beatsEjected += divCeil(mem_access->getSize(), sublineBytes);
         }
-        ejectBuffer.pop();
-        num_ejected++;
+        readEjectBuffer.pop();
+        ejectAccess(mem_access);
+        readsEjected++;
     }
-    if (!ejectBuffer.empty())
+    if (beatsEjected > beats_before) {
+        readResponseBeats += beatsEjected - beats_before;
+        if (beats_before == 0) responsePathBusyCycles++;
+        if (!readEjectBuffer.empty() && responseBeatsPerCycle > 0 &&
+            beatsEjected == responseBeatsPerCycle) {
+            responsePathSaturatedCycles++;
+        }
+    }
+
+    // Store acks carry no data back to the core
+    while (!writeEjectBuffer.empty() &&
+           (writeEjectWidth == 0 || writesEjected < writeEjectWidth)) {
+        WarpInstBuffer::CoalescedAccess *mem_access = writeEjectBuffer.front();
+        writeEjectBuffer.pop();
+        ejectAccess(mem_access);
+        writesEjected++;
+    }
+
+    if (!readEjectBuffer.empty() || !writeEjectBuffer.empty())
         schedule(ejectAccessesEvent, nextCycle());
 }
 
 void
-ShaderLSQ::clearFenceAtQueueHead(int warp_id) {
-    assert(perWarpOutstandingAccesses[warp_id] == 0);
-    assert(!perWarpInstructionQueues[warp_id].empty());
-    WarpInstBuffer *next_warp_inst = perWarpInstructionQueues[warp_id].front();
-    assert(next_warp_inst->isFence());
-    perWarpInstructionQueues[warp_id].pop();
-    assert(perWarpInstructionQueues[warp_id].empty());
-    next_warp_inst->arriveAtFence();
-    pushToCommitBuffer(next_warp_inst);
+ShaderLSQ::ejectAccess(WarpInstBuffer::CoalescedAccess *mem_access)
+{
+    WarpInstBuffer *warp_inst = mem_access->getWarpBuffer();
+    DPRINTF(ShaderLSQ,
+            "[%d: ] Ejected %s for vaddr: %p, paddr: %p\n",
+            warp_inst->getWarpId(),
+            warp_inst->getInstTypeString(),
+            mem_access->req->getVaddr(), mem_access->req->getPaddr());
+    perWarpOutstandingAccesses[mem_access->getWarpId()]--;
+    bool inst_complete = warp_inst->finishAccess(mem_access);
+    if (inst_complete) {
+        pushToCommitBuffer(warp_inst);
+
+        // If there is a fence at the head of the per-warp instruction queue
+        // and all prior per-warp memory accesses are complete, clear it
+        int warp_id = warp_inst->getWarpId();
+        if (perWarpOutstandingAccesses[warp_id] == 0 &&
+            !perWarpInstructionQueues[warp_id].empty() &&
+            perWarpInstructionQueues[warp_id].front()->isFence()) {
+
+            startWarpQueueHead(warp_id);
+
+            // The warp instruction queued behind the fence may have pushed
+            // translated accesses to inject. Otherwise, an unscheduled inject
+            // waits for the cache or an LSQ MSHR to free up
+            if (!injectBuffer.empty() && !injectAccessesEvent.scheduled() &&
+                !mshrsFull && !mshrTableFull) {
+                Cycles inject_cycle = injectBuffer.back()->getInjectCycle();
+                schedule(injectAccessesEvent,
+                         clockEdge(Cycles(inject_cycle - curCycle())));
+            }
+        }
+    }
+}
+
+bool
+ShaderLSQ::fenceCanComplete(WarpInstBuffer *fence)
+{
+    assert(fence->isFence());
+    switch (fence->getFenceScope()) {
+      case Enums::CTA:
+        // The threads of a CTA share this LSQ and L1, and the warp's prior
+        // accesses have all been injected ahead of any later access to the
+        // same line, so the fence does not wait for them to complete
+        return true;
+      case Enums::GPU:
+      case Enums::System:
+        // The warp's prior accesses must complete (i.e. be performed at
+        // the L2 or beyond) to be visible to other cores. The GPU L2 is also
+        // the point of coherence with the CPU, so system scope fences wait
+        // for the same
+        return perWarpOutstandingAccesses[fence->getWarpId()] == 0;
+      default:
+        panic("Unknown fence scope %d\n", fence->getFenceScope());
+    }
+}
+
+void
+ShaderLSQ::startWarpQueueHead(int warp_id) {
+    // Clear the fences at the head of the queue that can complete. A warp
+    // may have several fences queued, each ordering the accesses before it
+    std::queue<WarpInstBuffer*> &queue = perWarpInstructionQueues[warp_id];
+    while (!queue.empty() && queue.front()->isFence()) {
+        WarpInstBuffer *fence = queue.front();
+        if (!fenceCanComplete(fence)) {
+            return;
+        }
+        queue.pop();
+        fence->arriveAtFence();
+        fencesCompleted[fence->getFenceScope()]++;
+        pushToCommitBuffer(fence);
+    }
+
+    // Let the next warp instruction inject the accesses that have already
+    // been translated. The rest are pushed as their translations complete
+    if (!queue.empty()) {
+        WarpInstBuffer::CoalescedAccess *mem_access =
+                queue.front()->getTranslatedAccesses();
+        for (; mem_access; mem_access = mem_access->translatedNext) {
+            pushToInjectBuffer(mem_access);
+        }
+    }
 }
 
 void
@@ -692,10 +1124,12 @@ ShaderLSQ::commitWarpInst()
         panic("Don't know how to record latency for this instruction\n");
     }
 
+    assert(perWarpActiveInsts[warp_inst->getWarpId()] > 0);
+    perWarpActiveInsts[warp_inst->getWarpId()]--;
     warp_inst->resetState();
     decrementActiveWarpInstBuffers();
     availableWarpInstBufs.push(warp_inst);
-    if (flushing && numActiveWarpInstBuffers == 0) processFlush();
+    if (!pendingFlushes.empty()) processFlushes();
 }
 
 void
@@ -709,38 +1143,102 @@ ShaderLSQ::retryCommitWarpInst()
 }
 
 void
-ShaderLSQ::processFlush()
-{
-    DPRINTF(ShaderLSQ, "Processing flush request\n");
-    assert(flushing && flushingPkt);
-    assert(numActiveWarpInstBuffers == 0);
-    Tick since_last_change = curTick() - lastWarpInstBufferChange;
-    activeWarpInstBuffers.sample(numActiveWarpInstBuffers, since_last_change);
-    lastWarpInstBufferChange = 0;
-    if (forwardFlush) {
-        MasterID master_id = flushingPkt->req->masterId();
-        int asid = 0;
-        Addr addr(0);
-        Request::Flags flags;
-        RequestPtr req = new Request(asid, addr, flags, master_id);
-        PacketPtr flush_pkt = new Packet(req, MemCmd::FlushAllReq);
-        if (!cachePort.sendTimingReq(flush_pkt)) {
-            panic("Unable to forward flush to cache!\n");
+ShaderLSQ::processFlushes()
+{
+    // Whether a flush ahead of the current one has not yet completed
+    bool earlier_pending = false;
+    list<PendingFlush>::iterator it = pendingFlushes.begin();
+    while (it != pendingFlushes.end()) {
+        if (!it->drained) {
+            it->drained = true;
+            for (int i = 0; i < maxNumWarpsPerCore; i++) {
+                if (it->warps[i] && perWarpActiveInsts[i] > 0) {
+                    it->drained = false;
+                    break;
+                }
+            }
+            if (it->drained) {
+                DPRINTF(ShaderLSQ, "Flush request drained\n");
+            }
         }
-    } else {
-        finalizeFlush();
+
+        // Warp and CTA flushes complete as soon as they drain. An L1 flush
+        // must also wait for every flush sent before it, so that it covers
+        // all of their accesses
+        bool ready = it->drained && !(it->flushCache && earlier_pending);
+        if (ready && it->flushCache && forwardFlush) {
+            if (!it->forwarded) {
+                DPRINTF(ShaderLSQ, "Forwarding flush to cache\n");
+                forwardCacheFlush(it->pkt->req->masterId());
+                it->forwarded = true;
+            }
+            ready = false;
+        }
+
+        if (ready) {
+            respondToFlush(*it);
+            it = pendingFlushes.erase(it);
+        } else {
+            earlier_pending = true;
+            ++it;
+        }
+    }
+}
+
+void
+ShaderLSQ::forwardCacheFlush(MasterID master_id)
+{
+    assert(!flushForwarded);
+    int asid = 0;
+    Addr addr(0);
+    Request::Flags flags;
+    RequestPtr req = new Request(asid, addr, flags, master_id);
+    PacketPtr flush_pkt = new Packet(req, MemCmd::FlushAllReq);
+    if (!cachePort.sendTimingReq(flush_pkt)) {
+        panic("Unable to forward flush to cache!\n");
     }
+    flushForwarded = true;
 }
 
-void ShaderLSQ::finalizeFlush()
+void
+ShaderLSQ::finalizeFlushes()
 {
-    assert(flushing && flushingPkt);
-    flushingPkt->makeTimingResponse();
-    if (!controlPort.sendTimingResp(flushingPkt)) {
+    assert(flushForwarded);
+    flushForwarded = false;
+    // An L1 flush is only forwarded once every flush ahead of it completed
+    PendingFlush &flush = pendingFlushes.front();
+    assert(flush.flushCache && flush.forwarded);
+    respondToFlush(flush);
+    pendingFlushes.pop_front();
+
+    // Later L1 flushes may now proceed
+    processFlushes();
+}
+
+void
+ShaderLSQ::respondToFlush(PendingFlush &flush)
+{
+    assert(flush.drained);
+    for (int i = 0; i < maxNumWarpsPerCore; i++) {
+        if (flush.warps[i]) {
+            assert(perWarpFlushes[i] > 0);
+            perWarpFlushes[i]--;
+        }
+    }
+
+    // Don't count the idle time between kernels in the buffer occupancy
+    if (numActiveWarpInstBuffers == 0 && lastWarpInstBufferChange > 0) {
+        Tick since_last_change = curTick() - lastWarpInstBufferChange;
+        activeWarpInstBuffers.sample(numActiveWarpInstBuffers,
+                                     since_last_change);
+        lastWarpInstBufferChange = 0;
+    }
+
+    flush.pkt->makeTimingResponse();
+    if (!controlPort.sendTimingResp(flush.pkt)) {
         panic("Unable to respond to flush message!\n");
     }
-    flushingPkt = NULL;
-    flushing = false;
+    flushesCompleted++;
     DPRINTF(ShaderLSQ, "Flush request complete\n");
 }
 
@@ -752,6 +1250,31 @@ ShaderLSQ::regStats()
         .desc("Histogram of number of active warp inst buffers at a given time")
         .init(warpInstBufPoolSize+1)
         ;
+    fencesCompleted
+        .init(Enums::Num_FenceScope)
+        .name(name()+".fencesCompleted")
+        .desc("Number of warp fences completed by scope")
+        ;
+    for (int i = 0; i < Enums::Num_FenceScope; i++) {
+        fencesCompleted.subname(i, Enums::FenceScopeStrings[i]);
+    }
+    flushesCompleted
+        .name(name()+".flushesCompleted")
+        .desc("Number of warp, CTA and SM flush requests completed")
+        ;
+    flushRejects
+        .name(name()+".flushRejects")
+        .desc("Lane requests rejected because their warp was being flushed")
+        ;
+    warpInstsDispatched
+        .name(name()+".warpInstsDispatched")
+        .desc("Histogram of warp instructions dispatched per dispatch cycle")
+        .init(dispatchWidth+1)
+        ;
+    dispatchWidthRejects
+        .name(name()+".dispatchWidthRejects")
+        .desc("Lane requests rejected because all dispatch slots were taken")
+        ;
     accessesOutstandingToCache
         .name(name()+".cacheAccesses")
         .desc("Average number of concurrent outstanding cache accesses")
@@ -760,9 +1283,37 @@ ShaderLSQ::regStats()
         .name(name()+".writebackBlockedCycles")
         .desc("Number of cycles blocked for core writeback stage")
         ;
+    readResponseBeats
+        .name(name()+".readResponseBeats")
+        .desc("Subline-sized beats of read data returned to the core")
+        ;
+    responsePathBusyCycles
+        .name(name()+".responsePathBusyCycles")
+        .desc("Cycles in which the response path returned read data")
+        ;
+    responsePathSaturatedCycles
+        .name(name()+".responsePathSaturatedCycles")
+        .desc("Cycles in which the response path was full with reads still "
+              "waiting to eject")
+        ;
     mshrHitQueued
         .name(name()+".mshrHitQueued")
-        .desc("Number of hits on blocked lines in MSHRs")
+        .desc("Number of accesses serialized behind outstanding accesses "
+              "to the same line")
+        ;
+    mshrMergedAccesses
+        .name(name()+".mshrMergedAccesses")
+        .desc("Number of loads merged into outstanding loads to the same line")
+        ;
+    mshrTableFullCycles
+        .name(name()+".mshrTableFullCycles")
+        .desc("Number of cycles stalled waiting for an LSQ MSHR")
+        ;
+    warpInjectWaitCycles
+        .init(maxNumWarpsPerCore, 0, 63, 4)
+        .name(name()+".warpInjectWaitCycles")
+        .desc("Cycles each warp's accesses waited in the inject buffer once "
+              "ready to inject")
         ;
     mshrsFullCycles
         .name(name()+".mshrsFullCycles")
@@ -802,8 +1353,44 @@ ShaderLSQ::regStats()
         .desc("Latency in cycles for TLB miss")
         .init(16)
         ;
-}
 
+    tlbPortStallCycles
+        .name(name() + ".tlbPortStallCycles")
+        .desc("Cycles with translations waiting for a TLB lookup port")
+        ;
+
+    warpTranslations
+        .name(name() + ".warpTranslations")
+        .desc("Translations issued for warp instruction accesses")
+        ;
+
+    coalescedTranslations
+        .name(name() + ".coalescedTranslations")
+        .desc("Translations saved by sharing one per page across a warp "
+              "instruction's accesses")
+        ;
+
+    accessPoolHighWater
+        .name(name() + ".accessPoolHighWater")
+        .desc("Most coalesced accesses allocated from the pool at once")
+        .method(&accessPools.accesses, &RecyclingPool::highWaterMark)
+        ;
+    requestPoolHighWater
+        .name(name() + ".requestPoolHighWater")
+        .desc("Most access requests allocated from the pool at once")
+        .method(&accessPools.requests, &RecyclingPool::highWaterMark)
+        ;
+    dataPoolHighWater
+        .name(name() + ".dataPoolHighWater")
+        .desc("Most access data buffers allocated from the pool at once")
+        .method(&accessPools.data, &RecyclingPool::highWaterMark)
+        ;
+    translationPoolHighWater
+        .name(name() + ".translationPoolHighWater")
+        .desc("Most TLB translations allocated from the pool at once")
+        .method(&translationPool, &RecyclingPool::highWaterMark)
+        ;
+}
 
 ShaderLSQ *ShaderLSQParams::create() {
     return new ShaderLSQ(this);
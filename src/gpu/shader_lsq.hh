@@ -36,9 +36,12 @@
 #include <list>
 #include <vector>
 
+#include "base/bitfield.hh"
 #include "base/statistics.hh"
-#include "cpu/translation.hh"
+#include "enums/InjectArbitration.hh"
+#include "gpu/lsq_mshr_table.hh"
 #include "gpu/lsq_warp_inst_buffer.hh"
+#include "gpu/recycling_pool.hh"
 #include "gpu/shader_tlb.hh"
 #include "mem/mem_object.hh"
 #include "mem/port.hh"
@@ -155,12 +158,35 @@ class ShaderLSQ : public MemObject
     // Maximum number of atomic operations to send per subline per access
     unsigned atomsPerSubline;
 
-    // TODO: When adding support for membars, this should be updated to track
-    // flushing status on a per-warp basis
-    // For SM-wide flush handling
-    bool flushing;
-    PacketPtr flushingPkt;
+    // A flush request from the shader core covers a set of warps: a single
+    // warp, the warps of a CTA, or the whole SM (the default). It drains once
+    // its warps have no warp instructions in the LSQ. Other warps keep
+    // issuing requests while a flush drains. Only the kernel-end flush (a
+    // FlushAllReq) also flushes the L1, once every flush ahead of it has
+    // completed; warp and CTA flushes complete as soon as they drain
+    struct PendingFlush {
+        PacketPtr pkt;
+        std::vector<bool> warps;
+        bool drained;
+        // Whether this request also flushes the L1 cache
+        bool flushCache;
+        // Whether the L1 flush for this request has been sent to the cache
+        bool forwarded;
+    };
+    std::list<PendingFlush> pendingFlushes;
+
+    // Number of pending flushes covering each warp. Warps being flushed may
+    // not start new warp instructions until their flushes complete
+    std::vector<unsigned> perWarpFlushes;
+
+    // Number of warp instructions each warp has in the LSQ, from dispatch
+    // until commit
+    std::vector<unsigned> perWarpActiveInsts;
+
+    // Whether L1 flushes are forwarded to the cache as a FlushAllReq, and
+    // whether one is currently outstanding
     bool forwardFlush;
+    bool flushForwarded;
 
     // The complete pool of buffers that hold warp instructions in-flight in
     // the LSQ. Other buffers are just pointers to this physical pool.
@@ -172,11 +198,41 @@ class ShaderLSQ : public MemObject
     // Holds pointers to buffers that are currently unoccupied
     std::queue<WarpInstBuffer*> availableWarpInstBufs;
 
+    // Recycling pools for the coalesced accesses of the warp instruction
+    // buffers, along with their requests and data buffers. These start with
+    // one entry per warp instruction buffer and grow as needed
+    CoalescedAccessPools accessPools;
+
+    /**
+     * The TLB translation of a single coalesced access. These are recycled
+     * through translationPool rather than deleting themselves on finish
+     */
+    class AccessTranslation : public BaseTLB::Translation
+    {
+      public:
+        ShaderLSQ *lsq;
+        WarpInstBuffer::CoalescedAccess *memAccess;
+        bool delayed;
+
+        AccessTranslation(ShaderLSQ *_lsq,
+                          WarpInstBuffer::CoalescedAccess *mem_access)
+            : lsq(_lsq), memAccess(mem_access), delayed(false) {}
+
+        void markDelayed() { delayed = true; }
+        void finish(const Fault &fault, RequestPtr req, ThreadContext *tc,
+                    Mode mode)
+        {
+            lsq->finishTranslation(this, fault);
+        }
+    };
+    RecyclingPool translationPool;
+
     // The warp instruction buffer pointers for different stages of the LSQ:
-    // Currently, GPGPU-Sim only supports dispatching a single warp instruction
-    // to the LSQ per cycle. This pointer holds the warp instruction currently
-    // being dispatched by the core
-    WarpInstBuffer *dispatchWarpInstBuf;
+    // Up to dispatchWidth warp instructions can be dispatched to the LSQ per
+    // cycle (e.g. one per LD/ST unit). These hold the warp instructions
+    // currently being dispatched by the core, in the order they arrived
+    unsigned dispatchWidth;
+    std::vector<WarpInstBuffer*> dispatchWarpInstBufs;
     // After dispatch, warp instruction buffers are pushed into per-warp
     // queues that maintain warp instruction ordering within each warp,
     // ensuring the program order portion of the consistency model. Only the
@@ -204,6 +260,17 @@ class ShaderLSQ : public MemObject
     // Data TLB to translate coalesced virtual to physical addresses
     ShaderTLB *tlb;
 
+    // Coalesced accesses waiting for a TLB lookup port, in issue order
+    struct PendingTranslation {
+        WarpInstBuffer::CoalescedAccess *memAccess;
+        BaseTLB::Mode mode;
+    };
+    std::deque<PendingTranslation> pendingTranslations;
+
+    // The last access to each page of the warp instruction whose
+    // translations are being issued. Reused across warp instructions
+    std::vector<WarpInstBuffer::CoalescedAccess*> pageTails;
+
     // Use this cycle specifier to block inject for variable issue latency
     // e.g. Fermi and Maxwell store issue is 1 cycle per cache subline
     unsigned sublineBytes;
@@ -213,22 +280,72 @@ class ShaderLSQ : public MemObject
     // Buffer to hold accesses to be sent to the cache
     std::deque<WarpInstBuffer::CoalescedAccess*> injectBuffer;
 
-    // Stores whether a cache line is currently blocked by a prior access
-    std::map<Addr, bool> blockedLineAddrs;
-    // Emulate MSHR queuing of accesses to lines with outstanding accesses
-    std::map<Addr, std::queue<WarpInstBuffer::CoalescedAccess*> > blockedAccesses;
+    // Emulate MSHRs for lines with outstanding accesses. Loads covered by
+    // the outstanding access to their line merge into it, up to
+    // mshrMergeCapacity per line, and other accesses queue behind it
+    LSQMSHRTable mshrTable;
+    unsigned mshrMergeCapacity;
+    // Block when all LSQ MSHRs are in use, and track for how many cycles
+    bool mshrTableFull;
+    Cycles mshrTableFullStarted;
+
+    // Policy choosing which of the accesses ready to inject goes next
+    typedef std::deque<WarpInstBuffer::CoalescedAccess*>::iterator
+        InjectIterator;
+    Enums::InjectArbitration injectPolicy;
+    // The warp and L2 slice of the last access to leave the inject buffer
+    int lastInjectWarp;
+    unsigned l2Slices;
+    int lastInjectSlice;
+    // The address bits that select the L2 slice, as Ruby selects L2 banks
+    unsigned l2SelectNumBits;
+    unsigned l2SelectLowBit;
+    int addrToSlice(Addr addr)
+    {
+        if (l2SelectNumBits == 0) {
+            return 0;
+        }
+        return bits(addr, l2SelectLowBit + l2SelectNumBits - 1,
+                    l2SelectLowBit) % l2Slices;
+    }
+    // Returns the access to inject next, or injectBuffer.end() if none is
+    // ready
+    InjectIterator selectInjectAccess();
+    bool preferInjectAccess(WarpInstBuffer::CoalescedAccess *access,
+                            WarpInstBuffer::CoalescedAccess *other);
+    void dequeueInjectAccess(InjectIterator pos);
+    bool canMergeAccess(LSQMSHRTable::Entry *mshr,
+                        WarpInstBuffer::CoalescedAccess *mem_access);
     // Block when there are no available MSHRs to forward the request to lower
     // levels of the cache hierarchy
     bool mshrsFull;
     // Track the number of cycles during which all MSHRs are full
     Cycles mshrsFullStarted;
 
-    // The maximum number of memory accesses that the LSQ can accept from the
-    // cache hierarchy per cycle
-    unsigned ejectWidth;
-    // Buffer to hold accesses when received from the caches until they can
+    // The maximum number of read (load and atomic) responses and store acks
+    // that the LSQ can accept from the cache hierarchy per cycle. Only read
+    // responses carry data back to the core, so store acks are only limited
+    // when writeEjectWidth is non-zero
+    unsigned readEjectWidth;
+    unsigned writeEjectWidth;
+    // Buffers to hold accesses when received from the caches until they can
     // be used to update the appropriate WarpInstBuffer
-    std::queue<WarpInstBuffer::CoalescedAccess*> ejectBuffer;
+    std::queue<WarpInstBuffer::CoalescedAccess*> readEjectBuffer;
+    std::queue<WarpInstBuffer::CoalescedAccess*> writeEjectBuffer;
+
+    // Read data returns to the core in subline-sized beats. The response
+    // path carries responseBeatsPerCycle beats each cycle (0 = unlimited),
+    // so a read of a full line occupies it longer than a single subline.
+    // readBeatsRemaining counts the beats still to send for the read at the
+    // head of readEjectBuffer
+    unsigned responseBeatsPerCycle;
+    unsigned readBeatsRemaining;
+    // Eject resources already used in ejectCycle, since responses can
+    // trigger the eject stage more than once in a cycle
+    Cycles ejectCycle;
+    unsigned readsEjected;
+    unsigned writesEjected;
+    unsigned beatsEjected;
 
     // Buffer to queue warp instruction completions to be sent to core
     std::queue<WarpInstBuffer*> commitInstBuffer;
@@ -253,8 +370,8 @@ class ShaderLSQ : public MemObject
     // Required for implementing MemObject
     virtual BaseMasterPort& getMasterPort(const std::string &if_name, PortID idx = -1);
     virtual BaseSlavePort& getSlavePort(const std::string &if_name, PortID idx = -1);
-    bool isSquashed() { return false; }
-    void finishTranslation(WholeTranslationState *state);
+    void finishTranslation(AccessTranslation *translation,
+                           const Fault &fault);
 
   private:
 
@@ -263,11 +380,16 @@ class ShaderLSQ : public MemObject
     bool addLaneRequest(int lane_id, PacketPtr pkt);
 
     // LSQ Pipeline Stage 1:
-    // Process the dispatchWarpInstBuf, which is holding requests received
+    // Process the dispatchWarpInstBufs, which are holding requests received
     // during the previous cycle. This includes coalescing requests into cache
     // accesses and issuing translations for lines accessed
     void dispatchWarpInst();
+    void dispatchWarpInst(WarpInstBuffer *warp_inst);
     void issueWarpInstTranslations(WarpInstBuffer *warp_inst);
+    // Send pending translations to the TLB while it has free lookup ports
+    void issuePendingTranslations();
+    // Prepare a translated access for injection into the cache hierarchy
+    void completeTranslation(WarpInstBuffer::CoalescedAccess *mem_access);
     void pushToInjectBuffer(WarpInstBuffer::CoalescedAccess *mem_request);
 
     // LSQ Pipeline Stage 2:
@@ -275,6 +397,9 @@ class ShaderLSQ : public MemObject
     // can be injected into the cache hierarchy
     void injectCacheAccesses();
     void scheduleRetryInject();
+    // Update the access's warp instruction once the access has been sent
+    // to the cache or merged into an outstanding access
+    void accessInjected(WarpInstBuffer::CoalescedAccess *mem_access);
 
     // LSQ Pipeline Stage 3:
     // Accept cache access responses and queue them for ejection. Ejection
@@ -282,18 +407,24 @@ class ShaderLSQ : public MemObject
     // threads affected by the access
     bool recvResponsePkt(PacketPtr pkt);
     void ejectAccessResponses();
+    void ejectAccess(WarpInstBuffer::CoalescedAccess *mem_access);
 
     // LSQ Pipeline Stage 4:
     // Once a WarpInstBuffer has received responses for all cache accesses, it
     // can be committed by signaling back to the shader core
-    void clearFenceAtQueueHead(int warp_id);
+    // Clear fences at the head of the warp's instruction queue that can
+    // complete, and let the next warp instruction inject its accesses
+    void startWarpQueueHead(int warp_id);
+    bool fenceCanComplete(WarpInstBuffer *fence);
     void pushToCommitBuffer(WarpInstBuffer *warp_inst);
     void commitWarpInst();
     void retryCommitWarpInst();
 
     // Flush handling functions
-    void processFlush();
-    void finalizeFlush();
+    void processFlushes();
+    void forwardCacheFlush(MasterID master_id);
+    void finalizeFlushes();
+    void respondToFlush(PendingFlush &flush);
 
     // Events that trigger warp instruction dispatch, cache accesses injection
     // and ejection, and warp instruction commit pipeline stages, respectively
@@ -301,12 +432,25 @@ class ShaderLSQ : public MemObject
     EventWrapper<ShaderLSQ, &ShaderLSQ::injectCacheAccesses> injectAccessesEvent;
     EventWrapper<ShaderLSQ, &ShaderLSQ::ejectAccessResponses> ejectAccessesEvent;
     EventWrapper<ShaderLSQ, &ShaderLSQ::commitWarpInst> commitInstEvent;
+    EventWrapper<ShaderLSQ, &ShaderLSQ::issuePendingTranslations>
+        issueTranslationsEvent;
 
     // Stats
     Stats::Histogram activeWarpInstBuffers;
+    Stats::Histogram warpInstsDispatched;
+    Stats::Scalar dispatchWidthRejects;
+    Stats::Vector fencesCompleted;
+    Stats::Scalar flushesCompleted;
+    Stats::Scalar flushRejects;
     Stats::Average accessesOutstandingToCache;
     Stats::Scalar writebackBlockedCycles;
     Stats::Scalar mshrHitQueued;
+    Stats::Scalar readResponseBeats;
+    Stats::Scalar responsePathBusyCycles;
+    Stats::Scalar responsePathSaturatedCycles;
+    Stats::Scalar mshrMergedAccesses;
+    Stats::Scalar mshrTableFullCycles;
+    Stats::VectorDistribution warpInjectWaitCycles;
     Stats::Scalar mshrsFullCycles;
     Stats::Scalar mshrsFullCount;
 
@@ -316,6 +460,13 @@ class ShaderLSQ : public MemObject
     Stats::Histogram warpLatencyFence;
     Stats::Histogram warpLatencyAtomic;
     Stats::Histogram tlbMissLatency;
+    Stats::Scalar tlbPortStallCycles;
+    Stats::Scalar warpTranslations;
+    Stats::Scalar coalescedTranslations;
+    Stats::Value accessPoolHighWater;
+    Stats::Value requestPoolHighWater;
+    Stats::Value dataPoolHighWater;
+    Stats::Value translationPoolHighWater;
     void regStats();
 
 };
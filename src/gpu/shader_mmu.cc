@@ -28,21 +28,26 @@
  * Authors: Jason Power
  */
 
-#include <list>
+#include <algorithm>
 
 #include "arch/isa.hh"
+#include "base/bitfield.hh"
 #include "cpu/base.hh"
 #include "debug/ShaderMMU.hh"
+#include "gpu/cluster_tlb.hh"
 #include "gpu/gpgpu-sim/cuda_gpu.hh"
 #include "gpu/shader_mmu.hh"
 #include "params/ShaderMMU.hh"
 #include "sim/full_system.hh"
+#include "sim/system.hh"
 
 #if THE_ISA == ARM_ISA
     // TODO: To enable full-system mode ARM interrupts may require including
     // an ARM instruction with a GPU interrupt handler
 #elif THE_ISA == X86_ISA
     #include "arch/x86/generated/decoder.hh"
+    #include "arch/x86/pagetable.hh"
+    #include "arch/x86/regs/misc.hh"
 #else
     #error Currently gem5-gpu is only known to support x86 and ARM
 #endif
@@ -50,23 +55,72 @@
 using namespace std;
 using namespace TheISA;
 
+const char *ShaderMMU::pwcLevelNames[NumPWCLevels] = { "PD", "PDP", "PML4" };
+const char *ShaderMMU::shootdownKindNames[NumShootdownKinds] =
+    { "page", "asid", "all" };
+
+const char *ShaderMMU::walkClassNames[NumWalkClasses] =
+    { "retry", "demand", "prefetch" };
+
 ShaderMMU::ShaderMMU(const Params *p) :
-    ClockedObject(p), pagewalkers(p->pagewalkers),
+    MemObject(p), pagewalkers(p->pagewalkers),
 #if THE_ISA == ARM_ISA
     stage2MMU(p->stage2_mmu),
 #endif
-    latency(p->latency), startMissEvent(this), faultTimeoutEvent(this),
-    faultTimeoutCycles(1000000), outstandingFaultStatus(None),
-    outstandingFaultInfo(NULL), curOutstandingWalks(0),
-    prefetchBufferSize(p->prefetch_buffer_size)
+    walkPort(name() + ".walk_port", this),
+    masterId(p->sys->getMasterId(name())), walkBypassL1(p->walk_bypass_l1),
+    nativeWalks(false), latency(p->latency), startMissEvent(this),
+    lookupPorts(p->lookup_ports),
+    faultTimeoutEvent(this),
+    faultTimeoutCycles(1000000),
+    starvationCycles(p->walk_starvation_cycles),
+    outstandingWalks(p->pagewalkers.size()),
+    outstandingFaultStatus(None), outstandingFaultInfo(NULL),
+    faultBatchSize(p->fault_batch_size), faultBatchServiced(0),
+    faultBatchRetries(0), faultBatchStart(0),
+    curOutstandingWalks(0), prefetchBuffer(p->prefetch_buffer_size),
+    prefetchBufferSize(p->prefetch_buffer_size), prefetcher(p->prefetcher),
+    prefetchQueueSize(p->prefetch_queue_size),
+    checkpointTranslations(p->checkpoint_translations)
 {
+    if (faultBatchSize == 0) {
+        fatal("%s: fault_batch_size must be at least 1\n", name());
+    }
+    maxClassWalkers[WalkFaultRetry] = p->max_retry_walkers;
+    maxClassWalkers[WalkDemand] = p->max_demand_walkers;
+    maxClassWalkers[WalkPrefetch] = p->max_prefetch_walkers;
+    for (int c = 0; c < NumWalkClasses; c++) {
+        activeClassWalks[c] = 0;
+    }
     activeWalkers.resize(pagewalkers.size());
     if (p->l2_tlb_entries > 0) {
-        tlb = new TLBMemory(p->l2_tlb_entries, p->l2_tlb_assoc);
+        int entries[NumGPUPageSizes] =
+            { p->l2_tlb_entries, p->l2_tlb_entries_2mb, p->l2_tlb_entries_1gb };
+        tlb = new MultiPageTLBMemory(entries, p->l2_tlb_assoc,
+                                     p->l2_tlb_replacement_policy);
     } else {
         tlb = NULL;
     }
 
+    // Each cached entry at a level covers the region its next table maps:
+    // 2MB for a PD entry, 1GB for a PDP entry and 512GB for a PML4 entry
+    int pwc_entries[NumPWCLevels] =
+        { p->pwc_pd_entries, p->pwc_pdp_entries, p->pwc_pml4_entries };
+    for (int level = 0; level < NumPWCLevels; level++) {
+        if (pwc_entries[level] > 0) {
+            pageWalkCache[level] = new TLBMemory(pwc_entries[level], 0,
+                                                 Enums::LRU, 21 + 9 * level);
+            nativeWalks = true;
+        } else {
+            pageWalkCache[level] = NULL;
+        }
+    }
+#if THE_ISA != X86_ISA
+    if (nativeWalks) {
+        fatal("%s: The page walk cache is only supported for x86\n", name());
+    }
+#endif
+
     pagewalkEvents.resize(pagewalkers.size());
     for (unsigned pw_id = 0; pw_id < pagewalkers.size(); pw_id++) {
         activeWalkers[pw_id] = false;
@@ -84,18 +138,192 @@ ShaderMMU::~ShaderMMU()
     if (tlb) {
         delete tlb;
     }
+    for (int level = 0; level < NumPWCLevels; level++) {
+        if (pageWalkCache[level]) {
+            delete pageWalkCache[level];
+        }
+    }
     for (unsigned pw_id = 0; pw_id < pagewalkers.size(); pw_id++) {
         delete pagewalkEvents[pw_id];
     }
 }
 
+void
+ShaderMMU::init()
+{
+    MemObject::init();
+    if (nativeWalks && !walkPort.isConnected()) {
+        fatal("%s: The page walk cache requires a connected walk_port\n",
+              name());
+    }
+}
+
+void
+ShaderMMU::serializeTranslations(CheckpointOut &cp, const std::string &base,
+                                 const std::vector<GPUTranslation> &ts)
+{
+    std::vector<Addr> vp_bases, pp_bases;
+    std::vector<unsigned> asids, sizes;
+    for (int i = 0; i < ts.size(); i++) {
+        vp_bases.push_back(ts[i].vpBase);
+        asids.push_back(ts[i].asid);
+        pp_bases.push_back(ts[i].ppBase);
+        sizes.push_back(ts[i].size);
+    }
+    paramOut(cp, base + ".num", ts.size());
+    arrayParamOut(cp, base + ".vpBases", vp_bases);
+    arrayParamOut(cp, base + ".asids", asids);
+    arrayParamOut(cp, base + ".ppBases", pp_bases);
+    arrayParamOut(cp, base + ".sizes", sizes);
+}
+
+void
+ShaderMMU::unserializeTranslations(CheckpointIn &cp, const std::string &base,
+                                   std::vector<GPUTranslation> &ts)
+{
+    unsigned num = 0;
+    paramIn(cp, base + ".num", num);
+    std::vector<Addr> vp_bases, pp_bases;
+    std::vector<unsigned> asids, sizes;
+    if (num > 0) {
+        arrayParamIn(cp, base + ".vpBases", vp_bases);
+        arrayParamIn(cp, base + ".asids", asids);
+        arrayParamIn(cp, base + ".ppBases", pp_bases);
+        arrayParamIn(cp, base + ".sizes", sizes);
+    }
+    if (vp_bases.size() != num || asids.size() != num ||
+        pp_bases.size() != num || sizes.size() != num) {
+        fatal("Malformed GPU translations %s in checkpoint\n", base);
+    }
+    for (unsigned i = 0; i < num; i++) {
+        if (asids[i] >= NumGPUAsids || sizes[i] >= NumGPUPageSizes) {
+            fatal("Invalid GPU translation %s[%d] in checkpoint\n", base, i);
+        }
+        GPUTranslation t = { vp_bases[i], (GPUAsid)asids[i], pp_bases[i],
+                             (GPUPageSize)sizes[i] };
+        ts.push_back(t);
+    }
+}
+
+void
+ShaderMMU::serialize(CheckpointOut &cp) const
+{
+    SERIALIZE_SCALAR(checkpointTranslations);
+    if (!checkpointTranslations) {
+        return;
+    }
+
+    std::vector<GPUTranslation> ts;
+    if (tlb) {
+        tlb->getTranslations(ts);
+    }
+    serializeTranslations(cp, "l2tlb", ts);
+
+    ts.clear();
+    prefetchBuffer.getTranslations(ts);
+    serializeTranslations(cp, "prefetchBuffer", ts);
+
+    unsigned num_l1_tlbs = tlbs.size();
+    SERIALIZE_SCALAR(num_l1_tlbs);
+    for (int i = 0; i < tlbs.size(); i++) {
+        ts.clear();
+        tlbs[i]->getTranslations(ts);
+        paramOut(cp, csprintf("l1tlb%d.name", i), tlbs[i]->name());
+        serializeTranslations(cp, csprintf("l1tlb%d", i), ts);
+    }
+}
+
+void
+ShaderMMU::unserialize(CheckpointIn &cp)
+{
+    bool saved_translations = false;
+    optParamIn(cp, "checkpointTranslations", saved_translations);
+    if (!checkpointTranslations || !saved_translations) {
+        // Restore with cold TLBs
+        return;
+    }
+
+    std::vector<GPUTranslation> ts;
+    unserializeTranslations(cp, "l2tlb", ts);
+    if (tlb) {
+        for (int i = 0; i < ts.size(); i++) {
+            tlb->insert(ts[i].vpBase, ts[i].asid, ts[i].ppBase, ts[i].size);
+        }
+    }
+
+    ts.clear();
+    unserializeTranslations(cp, "prefetchBuffer", ts);
+    if (prefetchBufferSize > 0) {
+        for (int i = 0; i < ts.size(); i++) {
+            prefetchBuffer.insert(ts[i].vpBase, ts[i].asid, ts[i].ppBase,
+                                  ts[i].size);
+        }
+    }
+
+    // The kind of an L1 TLB is the last component of its name, such as
+    // data_tlb or itb
+    std::map<std::string, ShaderTLB*> tlbs_by_name;
+    std::map<std::string, std::vector<ShaderTLB*> > tlbs_by_kind;
+    for (int i = 0; i < tlbs.size(); i++) {
+        const std::string &tlb_name = tlbs[i]->name();
+        tlbs_by_name[tlb_name] = tlbs[i];
+        std::string kind = tlb_name.substr(tlb_name.rfind('.') + 1);
+        tlbs_by_kind[kind].push_back(tlbs[i]);
+    }
+    std::map<std::string, unsigned> next_of_kind;
+
+    unsigned num_l1_tlbs = 0;
+    UNSERIALIZE_SCALAR(num_l1_tlbs);
+    for (unsigned i = 0; i < num_l1_tlbs; i++) {
+        std::string saved_name;
+        paramIn(cp, csprintf("l1tlb%d.name", i), saved_name);
+        ts.clear();
+        unserializeTranslations(cp, csprintf("l1tlb%d", i), ts);
+
+        ShaderTLB *target = NULL;
+        auto by_name = tlbs_by_name.find(saved_name);
+        if (by_name != tlbs_by_name.end()) {
+            target = by_name->second;
+        } else {
+            std::string kind = saved_name.substr(saved_name.rfind('.') + 1);
+            auto by_kind = tlbs_by_kind.find(kind);
+            if (by_kind != tlbs_by_kind.end()) {
+                std::vector<ShaderTLB*> &candidates = by_kind->second;
+                target = candidates[next_of_kind[kind]++ % candidates.size()];
+            }
+        }
+        if (!target) {
+            warn("Dropping %d checkpointed translations of %s\n", ts.size(),
+                 saved_name);
+            continue;
+        }
+        DPRINTF(ShaderMMU, "Restoring %d translations of %s into %s\n",
+                ts.size(), saved_name, target->name());
+        for (int j = 0; j < ts.size(); j++) {
+            target->restoreTranslation(ts[j]);
+        }
+    }
+}
+
+BaseMasterPort&
+ShaderMMU::getMasterPort(const std::string &if_name, PortID idx)
+{
+    if (if_name == "walk_port") {
+        return walkPort;
+    } else {
+        return MemObject::getMasterPort(if_name, idx);
+    }
+}
+
 void
 ShaderMMU::beginTLBMiss(ShaderTLB *req_tlb, BaseTLB::Translation *translation,
-                        RequestPtr req, BaseTLB::Mode mode, ThreadContext *tc)
+                        RequestPtr req, BaseTLB::Mode mode, ThreadContext *tc,
+                        GPUAsid asid)
 {
     // Wrap the translation in another class so we can catch the insertion
     TranslationRequest *wrapped_translation = new TranslationRequest(this,
-              req_tlb, translation, req, mode, tc, clockEdge(Cycles(latency)));
+              req_tlb, translation, req, mode, tc, asid,
+              clockEdge(Cycles(latency)));
 
     startMisses.push(wrapped_translation);
     if (!startMissEvent.scheduled()) {
@@ -107,104 +335,134 @@ void
 ShaderMMU::handleTLBMiss()
 {
     assert(!startMisses.empty());
+    assert(!startMissEvent.scheduled());
 
-    TranslationRequest *translation_request = startMisses.front();
-    startMisses.pop();
+    // Misses arrive in start tick order, so drain from the front until
+    // reaching one still in flight or running out of lookup ports
+    unsigned lookups = 0;
+    while (!startMisses.empty() &&
+           startMisses.front()->getStartTick() <= curTick()) {
+        if (lookupPorts > 0 && lookups == lookupPorts) {
+            lookupPortStalls++;
+            break;
+        }
+        TranslationRequest *translation_request = startMisses.front();
+        startMisses.pop();
+        lookupTLBMiss(translation_request);
+        lookups++;
+    }
+    lookupBatchSize.sample(lookups);
 
-    assert(!startMissEvent.scheduled());
     if (!startMisses.empty()) {
-        schedule(startMissEvent, startMisses.front()->getStartTick());
+        schedule(startMissEvent, std::max(startMisses.front()->getStartTick(),
+                                          clockEdge(Cycles(1))));
     }
+}
 
+void
+ShaderMMU::lookupTLBMiss(TranslationRequest *translation_request)
+{
     ShaderTLB *req_tlb = translation_request->origTLB;
     BaseTLB::Translation *translation = translation_request->wrappedTranslation;
     RequestPtr req = translation_request->req;
     BaseTLB::Mode mode = translation_request->mode;
     ThreadContext *tc = translation_request->tc;
+    GPUAsid asid = translation_request->asid;
 
     Addr pp_base;
-    Addr offset = req->getVaddr() % TheISA::PageBytes;
-    Addr vp_base = req->getVaddr() - offset;
+    Addr vaddr = req->getVaddr();
+    Addr offset = vaddr % TheISA::PageBytes;
+    Addr vp_base = vaddr - offset;
+    Addr paddr;
+    GPUPageSize page_size;
 
     // Check the L2 TLB
-    if (tlb && tlb->lookup(vp_base, pp_base, req_tlb)) {
+    if (tlb && tlb->lookup(vaddr, asid, paddr, page_size)) {
         // Found in the L2 TLB
         l2hits++;
-        req->setPaddr(pp_base + offset);
-        req_tlb->insert(vp_base, pp_base);
+        l2hitsByPageSize[page_size]++;
+        req->setPaddr(paddr);
+        req_tlb->insert(vaddr, asid, paddr, page_size);
         translation->finish(NoFault, req, tc, mode);
         delete translation_request;
         return;
     }
 
     // Check for a hit in the prefetch buffers
-    auto it = prefetchBuffer.find(vp_base);
-    if (it != prefetchBuffer.end()) {
+    if (prefetchBuffer.remove(vp_base, asid, pp_base, page_size)) {
         // Hit in the prefetch buffer
         prefetchHits++;
-        pp_base = it->second.ppBase;
+        prefetcher->prefetchUseful();
+        paddr = pp_base + offset;
         if (tlb) {
-            tlb->insert(vp_base, pp_base);
+            tlb->insert(vaddr, asid, paddr, page_size);
         }
-        req->setPaddr(pp_base + offset);
-        req_tlb->insert(vp_base, pp_base);
+        req->setPaddr(paddr);
+        req_tlb->insert(vaddr, asid, paddr, page_size);
         translation->finish(NoFault, req, tc, mode);
-        // Remove from prefetchBuffer
-        prefetchBuffer.erase(it);
-        // This was a hit in the prefetch buffer, so we must have done the
-        // right thing, Let's see if we get lucky again.
-        tryPrefetch(vp_base, tc);
+        notifyPrefetcher(req_tlb, vp_base, asid, tc);
         delete translation_request;
         return;
     }
 
-    DPRINTF(ShaderMMU, "Inserting request for vp base %#x. %d outstanding\n",
-            vp_base, outstandingWalks[vp_base].size());
-    outstandingWalks[vp_base].push_back(translation_request);
+    WalkChain *walks = outstandingWalks.find(translation_request->walkKey());
+    DPRINTF(ShaderMMU, "Inserting request for vp base %#x (ASID %d). %d "
+            "outstanding\n", vp_base, asid, walks ? walks->size : 0);
     totalRequests++;
 
-    if (outstandingWalks[vp_base].size() == 1) {
-        DPRINTF(ShaderMMU, "Walking for %#x\n", req->getVaddr());
-        TLB *walker = getFreeWalker();
-        if (walker == NULL) {
-            pendingWalks.push(translation_request);
-        } else {
-            schedulePagewalk(walker, translation_request);
-            // Try to prefetch on demand misses (but wait until the demand
-            // walk has started.)
-            tryPrefetch(vp_base, tc);
+    if (walks) {
+        if (walks->head->prefetch && !walks->head->prefetchLate) {
+            walks->head->prefetchLate = true;
+            prefetcher->prefetchLate();
         }
+        walks->tail->nextMerged = translation_request;
+        walks->tail = translation_request;
+        walks->size++;
+    } else {
+        WalkChain chain = { translation_request, translation_request, 1 };
+        outstandingWalks.insert(translation_request->walkKey(), chain);
+        DPRINTF(ShaderMMU, "Walking for %#x\n", req->getVaddr());
+        queueWalk(translation_request, WalkDemand);
+        scheduleWalks();
     }
+
+    notifyPrefetcher(req_tlb, vp_base, asid, tc);
 }
 
 void
 ShaderMMU::finishWalk(TranslationRequest *translation, Fault fault)
 {
     pagewalkLatency.sample(curCycle() - translation->beginWalk);
+    if (fault == NoFault) {
+        if (!translation->walkedNatively) {
+            translation->pageSize = getWalkPageSize(translation);
+        }
+        walksByPageSize[translation->pageSize]++;
+    }
     setWalkerFree(translation->pageWalker);
+    activeClassWalks[translation->walkClass]--;
     translation->pageWalker = NULL;
 
-    if (!pendingWalks.empty()) {
-        TLB *walker = getFreeWalker();
-        TranslationRequest *t = pendingWalks.front();
-        schedulePagewalk(walker, t);
-        pendingWalks.pop();
-    }
-
     RequestPtr req = translation->req;
 
     // Handling for after the OS satisfies a page fault
     if (outstandingFaultStatus == Retrying &&
-        req->getVaddr() == outstandingFaultInfo->req->getVaddr()) {
+        find(faultBatch.begin(), faultBatch.end(), translation) !=
+            faultBatch.end()) {
         DPRINTF(ShaderMMU, "Walk finished for retry of %#x\n", req->getVaddr());
         if (fault != NoFault) {
             panic("GPU encountered another fault for faulted address.\n"
                   "      Likely a GPU-triggered segfault for: %#x, pc: %#x",
                   req->getVaddr(), req->getPC());
+        } else if (--faultBatchRetries > 0) {
+            DPRINTF(ShaderMMU, "Retry successful, %d batch retries left\n",
+                    faultBatchRetries);
         } else {
-            DPRINTF(ShaderMMU, "Retry successful\n");
+            DPRINTF(ShaderMMU, "Retry successful, fault batch complete\n");
+            pagefaultBatchLatency.sample(curCycle() - faultBatchStart);
             outstandingFaultStatus = None;
             outstandingFaultInfo = NULL;
+            faultBatch.clear();
             ThreadContext *tc = translation->tc;
             GPUFaultReg fault_reg = tc->readMiscRegNoEffect(MISCREG_GPU_FAULT);
             fault_reg.inFault = 0;
@@ -215,11 +473,9 @@ ShaderMMU::finishWalk(TranslationRequest *translation, Fault fault)
             // care/testing when changing these.
             tc->setMiscRegActuallyNoEffect(MISCREG_GPU_FAULT, fault_reg);
             if (!pendingFaults.empty()) {
-                TranslationRequest *pending = pendingFaults.front();
-                DPRINTF(ShaderMMU, "Invoking pending fault %#x\n",
-                        pending->req->getVaddr());
-                handlePageFault(pending);
-                pendingFaults.pop();
+                DPRINTF(ShaderMMU, "Invoking %d pending faults\n",
+                        pendingFaults.size());
+                raiseFaultBatch();
             } else {
                 DPRINTF(ShaderMMU, "No pending faults\n");
             }
@@ -237,46 +493,59 @@ ShaderMMU::finishWalk(TranslationRequest *translation, Fault fault)
         //       should issue.
         handlePageFault(translation);
     }
+
+    // Hand the freed walker to the next waiting walk
+    scheduleWalks();
 }
 
 void
 ShaderMMU::finalizeTranslation(TranslationRequest *translation)
 {
     RequestPtr req = translation->req;
+    Addr vaddr = req->getVaddr();
+    Addr paddr = req->getPaddr();
+    GPUPageSize page_size = translation->pageSize;
     Addr vp_base = translation->vpBase;
-    Addr pp_base = req->getPaddr() - req->getPaddr() % TheISA::PageBytes;
+    GPUAsid asid = translation->asid;
+    Addr pp_base = paddr - paddr % TheISA::PageBytes;
 
-    DPRINTF(ShaderMMU, "Walk complete for VP %#x to PP %#x\n", vp_base, pp_base);
+    DPRINTF(ShaderMMU, "Walk complete for VP %#x to PP %#x (%s page)\n",
+            vp_base, pp_base, gpuPageSizeNames[page_size]);
 
-    list<TranslationRequest*> &walks = outstandingWalks[vp_base];
-    assert(walks.front() == translation);
-    walks.pop_front();
+    WalkChain *walks = outstandingWalks.find(translation->walkKey());
+    assert(walks && walks->head == translation);
+    TranslationRequest *merged = translation->nextMerged;
+    unsigned num_merged = walks->size - 1;
+    outstandingWalks.erase(translation->walkKey());
 
     // First, complete the walked translation
     if (translation->prefetch) {
         // Only insert into pf buffer if no other requests were made to this
         // virtual page before the prefetch completed
-        if (walks.size() == 0) {
-            insertPrefetch(vp_base, pp_base);
+        if (!merged) {
+            insertPrefetch(vp_base, asid, pp_base, page_size);
+        } else if (tlb) {
+            // Late prefetch: fill the L2 TLB for the waiting demand misses
+            tlb->insert(vaddr, asid, paddr, page_size);
         }
         delete translation->req;
     } else {
         // Insert the mapping into the TLB. This only needs to happen once
         if (tlb) {
-            tlb->insert(vp_base, pp_base);
+            tlb->insert(vaddr, asid, paddr, page_size);
         }
         // Insert into L1 TLB
-        translation->origTLB->insert(vp_base, pp_base);
+        translation->origTLB->insert(vaddr, asid, paddr, page_size);
         // Forward the translation on
         translation->wrappedTranslation->finish(NoFault, translation->req,
                                            translation->tc, translation->mode);
     }
 
     // Next, complete any queued translations for this same page
-    DPRINTF(ShaderMMU, "Walk satisfies %d other requests\n", walks.size());
-    list<TranslationRequest*>::iterator it;
-    for (it = walks.begin(); it != walks.end(); it++) {
-        TranslationRequest *t = (*it);
+    DPRINTF(ShaderMMU, "Walk satisfies %d other requests\n", num_merged);
+    while (merged) {
+        TranslationRequest *t = merged;
+        merged = t->nextMerged;
         // Prefetches should not have been queued
         assert(!t->prefetch);
         assert(t != translation);
@@ -286,14 +555,172 @@ ShaderMMU::finalizeTranslation(TranslationRequest *translation)
         t->req->setPaddr(pp_base + offset);
 
         // Insert into L1 TLB
-        t->origTLB->insert(vp_base, pp_base);
+        t->origTLB->insert(t->req->getVaddr(), asid, pp_base + offset,
+                           page_size);
         // Forward the translation on
         t->wrappedTranslation->finish(NoFault, t->req, t->tc, t->mode);
 
         delete t;
     }
     delete translation;
-    outstandingWalks.erase(vp_base);
+}
+
+void
+ShaderMMU::beginNativeWalk(TranslationRequest *translation)
+{
+#if THE_ISA == X86_ISA
+    Addr vaddr = translation->req->getVaddr();
+    CR3 cr3 = translation->tc->readMiscRegNoEffect(MISCREG_CR3);
+    Addr pt_base = cr3.longPdtb << PageShift;
+
+    // Start below the deepest level that hits in the page walk cache
+    Addr table = pt_base;
+    int walk_level = 3;
+    for (int level = 0; level < NumPWCLevels; level++) {
+        Addr next_table;
+        if (pageWalkCache[level] &&
+            pageWalkCache[level]->lookup(vaddr & ~mask(21 + 9 * level),
+                                         translation->asid, next_table)) {
+            DPRINTF(ShaderMMU, "PWC hit at %s level for %#x\n",
+                    pwcLevelNames[level], vaddr);
+            pwcHits[level]++;
+            table = next_table;
+            walk_level = level;
+            break;
+        }
+    }
+    if (walk_level == 3) {
+        pwcMisses++;
+    }
+
+    translation->walkLevel = walk_level;
+    sendWalkRead(translation,
+                 table + bits(vaddr, 20 + 9 * walk_level, 12 + 9 * walk_level) *
+                 sizeof(uint64_t));
+#else
+    panic("Native page walks are only supported for x86\n");
+#endif
+}
+
+void
+ShaderMMU::sendWalkRead(TranslationRequest *translation, Addr entry_paddr)
+{
+    Request::Flags flags;
+    if (walkBypassL1) {
+        flags.set(Request::BYPASS_L1);
+    }
+    RequestPtr req = new Request(entry_paddr, sizeof(uint64_t), flags,
+                                 masterId);
+    PacketPtr pkt = new Packet(req, MemCmd::ReadReq);
+    pkt->allocate();
+    pkt->pushSenderState(new WalkSenderState(translation));
+    nativeWalkReads++;
+    walkPort.sendPacket(pkt);
+}
+
+void
+ShaderMMU::recvWalkResp(PacketPtr pkt)
+{
+    WalkSenderState *state =
+        safe_cast<WalkSenderState*>(pkt->popSenderState());
+    TranslationRequest *translation = state->translation;
+    delete state;
+#if THE_ISA == X86_ISA
+    PageTableEntry pte = pkt->get<uint64_t>();
+#endif
+    delete pkt->req;
+    delete pkt;
+
+#if THE_ISA == X86_ISA
+    RequestPtr req = translation->req;
+    Addr vaddr = req->getVaddr();
+    int level = translation->walkLevel;
+    bool write = (translation->mode == BaseTLB::Write);
+    bool leaf = (level == 0) || ((level == 1 || level == 2) && pte.ps);
+
+    // The native walker only reads the page table. Walks that would fault
+    // or must set accessed/dirty bits go to the pagewalker for a full walk.
+    if (!pte.p || !pte.u || (write && !pte.w) || !pte.a ||
+        (leaf && write && !pte.d)) {
+        DPRINTF(ShaderMMU, "Native walk for %#x needs a full walk at level "
+                "%d (pte %#x)\n", vaddr, level, (uint64_t)pte);
+        nativeWalkFallbacks++;
+        translation->pageWalker->translateTiming(req, translation->tc,
+                                                 translation,
+                                                 translation->mode);
+        return;
+    }
+
+    Addr next_base = (Addr)pte.base << PageShift;
+    if (!leaf) {
+        if (pageWalkCache[level - 1]) {
+            pageWalkCache[level - 1]->insert(vaddr & ~mask(12 + 9 * level),
+                                             translation->asid, next_base);
+        }
+        translation->walkLevel = level - 1;
+        sendWalkRead(translation,
+                     next_base + bits(vaddr, 11 + 9 * level, 3 + 9 * level) *
+                     sizeof(uint64_t));
+        return;
+    }
+
+    GPUPageSize page_size = (GPUPageSize)level;
+    Addr page_mask = gpuPageBytes(page_size) - 1;
+    req->setPaddr((next_base & ~page_mask) | (vaddr & page_mask));
+    translation->pageSize = page_size;
+    translation->walkedNatively = true;
+    DPRINTF(ShaderMMU, "Native walk for %#x complete: paddr %#x (%s page)\n",
+            vaddr, req->getPaddr(), gpuPageSizeNames[page_size]);
+    finishWalk(translation, NoFault);
+#endif
+}
+
+void
+ShaderMMU::WalkPort::sendPacket(PacketPtr pkt)
+{
+    if (!retryPkts.empty() || !sendTimingReq(pkt)) {
+        retryPkts.push(pkt);
+    }
+}
+
+bool
+ShaderMMU::WalkPort::recvTimingResp(PacketPtr pkt)
+{
+    mmu->recvWalkResp(pkt);
+    return true;
+}
+
+void
+ShaderMMU::WalkPort::recvReqRetry()
+{
+    assert(!retryPkts.empty());
+    while (!retryPkts.empty() && sendTimingReq(retryPkts.front())) {
+        retryPkts.pop();
+    }
+}
+
+GPUPageSize
+ShaderMMU::getWalkPageSize(TranslationRequest *translation)
+{
+#if THE_ISA == X86_ISA
+    // The walker fills its single-entry TLB with the entry it found, which
+    // records the size of the mapping
+    TlbEntry *entry =
+        translation->pageWalker->lookup(translation->req->getVaddr(), false);
+    if (entry) {
+        for (int size = NumGPUPageSizes - 1; size >= 0; size--) {
+            if (entry->logBytes == gpuPageLogBytes[size]) {
+                return (GPUPageSize)size;
+            }
+        }
+        warn_once("GPU pagewalk found unsupported page size (2^%d B)\n",
+                  entry->logBytes);
+    }
+#else
+    // TODO: ARM section and block mappings are currently treated as 4KB
+    // pages since the walker's TLB lookup requires extra context
+#endif
+    return GPUPage4KB;
 }
 
 void
@@ -330,6 +757,30 @@ ShaderMMU::raisePageFaultInterrupt(ThreadContext *tc)
     DPRINTF(ShaderMMU, "Raising interrupt for page fault at addr: %#x\n",
             outstandingFaultInfo->req->getVaddr());
 
+    setFaultRegisters(tc);
+
+#if THE_ISA == ARM_ISA
+    panic("You must be executing in FullSystem mode with ARM:\n"
+          "ShaderMMU cannot yet handle ARM page faults");
+    // TODO: Add interrupt called "triggerGPUInterrupt()" to the ARM
+    // interrupts device
+#elif THE_ISA == X86_ISA
+    Interrupts *interrupts = tc->getCpuPtr()->getInterruptController();
+    interrupts->triggerGPUInterrupt();
+#endif
+    pagefaultInterrupts++;
+
+    // Schedule a timeout event to ensure that it does not get randomly
+    // dropped. Currently, this is for debugging purposes only (e.g. CPU thread
+    // gets swapped or descheduled, or a simulator bug drops the fault).
+    assert(!faultTimeoutEvent.scheduled());
+    faultTimeoutEvent.setTC(tc);
+    schedule(faultTimeoutEvent, clockEdge(faultTimeoutCycles));
+}
+
+void
+ShaderMMU::setFaultRegisters(ThreadContext *tc)
+{
     GPUFaultReg fault_reg = tc->readMiscRegNoEffect(MISCREG_GPU_FAULT);
     assert(fault_reg.inFault == 0);
     fault_reg.inFault = 1;
@@ -351,23 +802,6 @@ ShaderMMU::raisePageFaultInterrupt(ThreadContext *tc)
                                    outstandingFaultInfo->req->getVaddr());
     tc->setMiscRegActuallyNoEffect(MISCREG_GPU_FAULTCODE, code);
     tc->setMiscRegActuallyNoEffect(MISCREG_GPU_FAULT_RSP, fault_rsp);
-
-#if THE_ISA == ARM_ISA
-    panic("You must be executing in FullSystem mode with ARM:\n"
-          "ShaderMMU cannot yet handle ARM page faults");
-    // TODO: Add interrupt called "triggerGPUInterrupt()" to the ARM
-    // interrupts device
-#elif THE_ISA == X86_ISA
-    Interrupts *interrupts = tc->getCpuPtr()->getInterruptController();
-    interrupts->triggerGPUInterrupt();
-#endif
-
-    // Schedule a timeout event to ensure that it does not get randomly
-    // dropped. Currently, this is for debugging purposes only (e.g. CPU thread
-    // gets swapped or descheduled, or a simulator bug drops the fault).
-    assert(!faultTimeoutEvent.scheduled());
-    faultTimeoutEvent.setTC(tc);
-    schedule(faultTimeoutEvent, clockEdge(faultTimeoutCycles));
 }
 
 void
@@ -393,25 +827,23 @@ ShaderMMU::faultTimeout(ThreadContext *tc)
 void
 ShaderMMU::handlePageFault(TranslationRequest *translation)
 {
-    if (!FullSystem) {
-        panic("Page fault handling (addr: %#x, pc: %#x) not available in SE "
-              "mode: No interrupt handler!\n", translation->vpBase,
-              translation->req->getPC());
-    }
     if (translation->prefetch) {
         DPRINTF(ShaderMMU, "Ignoring since fault on prefetch\n");
         prefetchFaults++;
         TranslationRequest *new_translation = NULL;
-        list<TranslationRequest*> &walks = outstandingWalks[translation->vpBase];
-        if (walks.size() != 1) {
+        WalkChain *walks = outstandingWalks.find(translation->walkKey());
+        assert(walks && walks->head == translation);
+        if (walks->size != 1) {
             DPRINTF(ShaderMMU, "Well this is complicated. Prefetch fault for"
                                 "real request.\n");
-            walks.remove(translation);
-            new_translation = walks.front();
+            // The first merged demand request takes over the walk
+            walks->head = translation->nextMerged;
+            walks->size--;
+            new_translation = walks->head;
             delete translation->req;
             delete translation;
         } else {
-            outstandingWalks.erase(translation->vpBase);
+            outstandingWalks.erase(translation->walkKey());
             delete translation->req;
             delete translation;
             return;
@@ -420,6 +852,12 @@ ShaderMMU::handlePageFault(TranslationRequest *translation)
         assert(translation != NULL);
     }
 
+    if (!FullSystem) {
+        panic("Page fault handling (addr: %#x, pc: %#x) not available in SE "
+              "mode: No interrupt handler!\n", translation->vpBase,
+              translation->req->getPC());
+    }
+
     ThreadContext *tc = translation->tc;
     if (tc != CudaGPU::getCudaGPU(0)->getThreadContext()) {
         warn("Host TC changed! Old: %p, New: %p. Changing translation\n",
@@ -428,22 +866,67 @@ ShaderMMU::handlePageFault(TranslationRequest *translation)
         translation->tc = tc;
     }
 
+    // The CPU has not finished the current batch, so it can take one more
+    if (outstandingFaultStatus == InKernel &&
+        faultBatch.size() < faultBatchSize) {
+        addFaultToBatch(translation);
+        return;
+    }
+
+    pendingFaults.push(translation);
     if (outstandingFaultStatus != None) {
-        pendingFaults.push(translation);
         DPRINTF(ShaderMMU, "Outstanding fault. %d faults pending \n",
                 pendingFaults.size());
         return;
     }
 
+    raiseFaultBatch();
+}
+
+void
+ShaderMMU::addFaultToBatch(TranslationRequest *translation)
+{
     numPagefaults++;
+    DPRINTF(ShaderMMU, "fault for %#x (batch entry %d)\n",
+            translation->req->getVaddr(), faultBatch.size());
+    translation->beginFault = curCycle();
+    faultBatch.push_back(translation);
+}
+
+void
+ShaderMMU::raiseFaultBatch()
+{
+    assert(outstandingFaultStatus == None);
+    assert(faultBatch.empty());
+    assert(!pendingFaults.empty());
+
+    while (!pendingFaults.empty() && faultBatch.size() < faultBatchSize) {
+        addFaultToBatch(pendingFaults.front());
+        pendingFaults.pop();
+    }
+    faultBatchStart = curCycle();
+    faultBatchServiced = 0;
 
     outstandingFaultStatus = InKernel;
-    outstandingFaultInfo = translation;
-    DPRINTF(ShaderMMU, "fault for %#x\n", translation->req->getVaddr());
+    outstandingFaultInfo = faultBatch.front();
+    raisePageFaultInterrupt(outstandingFaultInfo->tc);
+}
 
-    outstandingFaultInfo->beginFault = curCycle();
+void
+ShaderMMU::retryFaultBatch()
+{
+    DPRINTF(ShaderMMU, "Retrying pagetable walks for %d faults\n",
+            faultBatch.size());
+    outstandingFaultStatus = Retrying;
+    faultBatchRetries = faultBatch.size();
+    pagefaultBatchSize.sample(faultBatch.size());
 
-    raisePageFaultInterrupt(tc);
+    for (int i = 0; i < faultBatch.size(); i++) {
+        TranslationRequest *translation = faultBatch[i];
+        DPRINTF(ShaderMMU, "Walking for %#x\n", translation->req->getVaddr());
+        queueWalk(translation, WalkFaultRetry);
+    }
+    scheduleWalks();
 }
 
 void
@@ -507,22 +990,24 @@ ShaderMMU::handleFinishPageFault(ThreadContext *tc)
         return;
     }
 
-    DPRINTF(ShaderMMU, "Retrying pagetable walk for %#x\n",
-                        outstandingFaultInfo->req->getVaddr());
-    outstandingFaultStatus = Retrying;
-
     pagefaultLatency.sample(curCycle() - outstandingFaultInfo->beginFault);
 
-    DPRINTF(ShaderMMU, "Walking for %#x\n",
-                        outstandingFaultInfo->req->getVaddr());
-
-    TLB *walker = getFreeWalker();
-    if (walker == NULL) {
-        // May want to push this to the front in the future to decrease latency
-        pendingWalks.push(outstandingFaultInfo);
-    } else {
-        schedulePagewalk(walker, outstandingFaultInfo);
+    faultBatchServiced++;
+    if (faultBatchServiced < faultBatch.size()) {
+        // The next fault of the batch is described in the fault registers
+        // and raised through the interrupt controller like the first one, so
+        // the CPU takes it at an instruction boundary once the handler has
+        // returned. Its walk is retried with the rest of the batch.
+        GPUFaultReg fault_reg = tc->readMiscRegNoEffect(MISCREG_GPU_FAULT);
+        fault_reg.inFault = 0;
+        tc->setMiscRegActuallyNoEffect(MISCREG_GPU_FAULT, fault_reg);
+        outstandingFaultInfo = faultBatch[faultBatchServiced];
+        outstandingFaultInfo->tc = tc;
+        raisePageFaultInterrupt(tc);
+        return;
     }
+
+    retryFaultBatch();
 }
 
 bool
@@ -563,74 +1048,420 @@ ShaderMMU::getFreeWalker()
 }
 
 void
-ShaderMMU::tryPrefetch(Addr vp_base, ThreadContext *tc)
+ShaderMMU::notifyPrefetcher(ShaderTLB *req_tlb, Addr vp_base, GPUAsid asid,
+                            ThreadContext *tc)
 {
-    // If not using a prefetcher, skip this function.
-    if (prefetchBufferSize == 0) {
+    // Prefetching is disabled without a buffer to hold the prefetches
+    if (prefetchBufferSize == 0 || !prefetcher) {
         return;
     }
 
-    // If this address has already been prefetched, skip
-    auto it = prefetchBuffer.find(vp_base);
-    if (it != prefetchBuffer.end()) {
-        return;
-    }
-    if (curOutstandingWalks >= pagewalkers.size()) {
-        // Not issuing a pagewalk since we already have the max outstanding
-        return;
+    prefetchCandidates.clear();
+    prefetcher->notify(req_tlb, vp_base, asid, prefetchCandidates);
+    for (int i = 0; i < prefetchCandidates.size(); i++) {
+        Addr pf_vp_base = prefetchCandidates[i];
+        assert(pf_vp_base % TheISA::PageBytes == 0);
+        if (isPrefetchRedundant(pf_vp_base, asid)) {
+            continue;
+        }
+        if (pendingPrefetches.size() >= prefetchQueueSize) {
+            prefetcher->prefetchDropped();
+            continue;
+        }
+        DPRINTF(ShaderMMU, "Queueing prefetch for %#x.\n", pf_vp_base);
+        PendingPrefetch pending = { pf_vp_base, asid, tc, curCycle() };
+        pendingPrefetches.push_back(pending);
     }
 
-    Addr next_vp_base = vp_base + TheISA::PageBytes;
-    Addr pp_base;
-    if (tlb && tlb->lookup(next_vp_base, pp_base, false)) {
-        // This vp already in the TLB, no need to prefetch
-        return;
+    scheduleWalks();
+}
+
+bool
+ShaderMMU::isPrefetchRedundant(Addr vp_base, GPUAsid asid)
+{
+    if (prefetchBuffer.contains(vp_base, asid)) {
+        return true;
+    }
+    if (outstandingWalks.find(asidTaggedPage(vp_base, asid))) {
+        return true;
+    }
+    Addr paddr;
+    GPUPageSize page_size;
+    if (tlb && tlb->lookup(vp_base, asid, paddr, page_size, false)) {
+        return true;
     }
+    for (int i = 0; i < pendingPrefetches.size(); i++) {
+        if (pendingPrefetches[i].vpBase == vp_base &&
+            pendingPrefetches[i].asid == asid) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    if (outstandingWalks.find(next_vp_base) != outstandingWalks.end()) {
-        // Already walking for this vp, no need to prefetch
-        return;
+void
+ShaderMMU::queueWalk(TranslationRequest *translation, WalkClass walk_class)
+{
+    assert(walk_class != WalkPrefetch);
+    translation->walkClass = walk_class;
+    translation->queuedCycle = curCycle();
+    walkQueues[walk_class].push(translation);
+}
+
+bool
+ShaderMMU::canStartWalk(WalkClass walk_class) const
+{
+    bool waiting = (walk_class == WalkPrefetch) ?
+        !pendingPrefetches.empty() : !walkQueues[walk_class].empty();
+    return waiting && (maxClassWalkers[walk_class] == 0 ||
+                       activeClassWalks[walk_class] <
+                           maxClassWalkers[walk_class]);
+}
+
+Cycles
+ShaderMMU::oldestQueuedCycle(WalkClass walk_class) const
+{
+    if (walk_class == WalkPrefetch) {
+        return pendingPrefetches.front().queuedCycle;
     }
+    return walkQueues[walk_class].front()->queuedCycle;
+}
 
-    numPrefetches++;
+void
+ShaderMMU::scheduleWalks()
+{
+    while (curOutstandingWalks < pagewalkers.size()) {
+        int walk_class = -1;
+        for (int c = 0; c < NumWalkClasses; c++) {
+            if (canStartWalk((WalkClass)c)) {
+                walk_class = c;
+                break;
+            }
+        }
+        if (walk_class < 0) {
+            return;
+        }
 
-    // Prefetch the next PTE into the TLB.
-    Request::Flags flags;
-    RequestPtr req = new Request(0, next_vp_base, 4, flags, 0, 0, 0, 0);
-    TranslationRequest *translation = new TranslationRequest(this, NULL, NULL,
-                                        req, BaseTLB::Read, tc, true);
-    outstandingWalks[next_vp_base].push_back(translation);
-    TLB *walker = getFreeWalker();
-    assert(walker != NULL); // Should never try to issue a prefetch in this case
+        if (starvationCycles > 0) {
+            // Let the longest waiting starved walk of any class go first
+            int starved_class = -1;
+            for (int c = 0; c < NumWalkClasses; c++) {
+                WalkClass wc = (WalkClass)c;
+                if (canStartWalk(wc) &&
+                    curCycle() - oldestQueuedCycle(wc) >= starvationCycles &&
+                    (starved_class < 0 || oldestQueuedCycle(wc) <
+                         oldestQueuedCycle((WalkClass)starved_class))) {
+                    starved_class = c;
+                }
+            }
+            if (starved_class >= 0 && starved_class != walk_class) {
+                DPRINTF(ShaderMMU, "Starting starved %s walk ahead of %s "
+                        "walks\n", walkClassNames[starved_class],
+                        walkClassNames[walk_class]);
+                starvedWalks++;
+                walk_class = starved_class;
+            }
+        }
 
-    DPRINTF(ShaderMMU, "Prefetching translation for %#x.\n", next_vp_base);
+        if (walk_class != WalkPrefetch) {
+            TranslationRequest *translation = walkQueues[walk_class].front();
+            walkQueues[walk_class].pop();
+            startWalk(translation);
+            continue;
+        }
+
+        PendingPrefetch pending = pendingPrefetches.front();
+        pendingPrefetches.pop_front();
+        // Demand misses may have translated the page while this was queued
+        if (isPrefetchRedundant(pending.vpBase, pending.asid)) {
+            continue;
+        }
+
+        numPrefetches++;
+        prefetcher->prefetchIssued();
+
+        Request::Flags flags;
+        RequestPtr req = new Request(0, pending.vpBase, 4, flags, 0, 0, 0, 0);
+        TranslationRequest *translation = new TranslationRequest(this, NULL,
+                NULL, req, BaseTLB::Read, pending.tc, pending.asid, curTick(),
+                true);
+        translation->queuedCycle = pending.queuedCycle;
+        WalkChain chain = { translation, translation, 1 };
+        outstandingWalks.insert(translation->walkKey(), chain);
+
+        DPRINTF(ShaderMMU, "Prefetching translation for %#x.\n",
+                pending.vpBase);
+        startWalk(translation);
+    }
+}
+
+void
+ShaderMMU::startWalk(TranslationRequest *translation)
+{
+    TLB *walker = getFreeWalker();
+    assert(walker != NULL);
+    WalkClass walk_class = translation->walkClass;
+    walkQueueDelay[walk_class].sample(curCycle() - translation->queuedCycle);
+    activeClassWalks[walk_class]++;
     schedulePagewalk(walker, translation);
 }
 
 void
-ShaderMMU::insertPrefetch(Addr vp_base, Addr pp_base)
+ShaderMMU::insertPrefetch(Addr vp_base, GPUAsid asid, Addr pp_base,
+                          GPUPageSize size)
 {
-    DPRINTF(ShaderMMU, "Inserting %#x->%#x into pf buffer\n", vp_base, pp_base);
+    DPRINTF(ShaderMMU, "Inserting %#x->%#x (ASID %d) into pf buffer\n",
+            vp_base, pp_base, asid);
     assert(vp_base % TheISA::PageBytes == 0);
-    // Insert into prefetch buffer
-    if (prefetchBuffer.size() >= prefetchBufferSize) {
-        // evict unused entry from prefetch buffer
-        auto min = prefetchBuffer.begin();
-        Tick minTick = curTick();
-        for (auto it=prefetchBuffer.begin(); it!=prefetchBuffer.end(); it++) {
-            if (it->second.mruTick < minTick) {
-                minTick = it->second.mruTick;
-                min = it;
-            }
+    prefetchBuffer.insert(vp_base, asid, pp_base, size);
+}
+
+unsigned
+ShaderMMU::flushPageWalkCache(GPUAsid asid)
+{
+    unsigned flushed = 0;
+    for (int level = 0; level < NumPWCLevels; level++) {
+        if (pageWalkCache[level]) {
+            flushed += pageWalkCache[level]->flushAsid(asid);
         }
-        assert(minTick != curTick() && min != prefetchBuffer.end());
-        prefetchBuffer.erase(min);
     }
-    GPUTlbEntry &e = prefetchBuffer[vp_base];
-    e.vpBase = vp_base;
-    e.ppBase = pp_base;
-    e.setMRU();
-    assert(prefetchBuffer.size() <= prefetchBufferSize);
+    return flushed;
+}
+
+void
+ShaderMMU::shootdown(Addr vaddr, GPUAsid asid)
+{
+    unsigned invalidated = 0;
+    for (int i = 0; i < tlbs.size(); i++) {
+        invalidated += tlbs[i]->invalidatePage(vaddr, asid);
+    }
+    for (int i = 0; i < clusterTLBs.size(); i++) {
+        invalidated += clusterTLBs[i]->invalidatePage(vaddr, asid);
+    }
+    if (tlb) {
+        invalidated += tlb->demapPage(vaddr, asid);
+    }
+    invalidated += prefetchBuffer.demapPage(vaddr, asid);
+    invalidated += flushPageWalkCache(asid);
+    // The page walkers are host TLBs, which also cache the translations
+    // they walk
+    for (int i = 0; i < pagewalkers.size(); i++) {
+        pagewalkers[i]->demapPage(vaddr, 0);
+    }
+
+    DPRINTF(ShaderMMU, "Shootdown of %#x (ASID %d) invalidated %d entries\n",
+            vaddr, asid, invalidated);
+    shootdowns[ShootdownPage]++;
+    shootdownInvalidations.sample(invalidated);
+}
+
+void
+ShaderMMU::flushASID(GPUAsid asid)
+{
+    unsigned invalidated = 0;
+    for (int i = 0; i < tlbs.size(); i++) {
+        invalidated += tlbs[i]->invalidateAsid(asid);
+    }
+    for (int i = 0; i < clusterTLBs.size(); i++) {
+        invalidated += clusterTLBs[i]->invalidateAsid(asid);
+    }
+    if (tlb) {
+        invalidated += tlb->flushAsid(asid);
+    }
+    invalidated += prefetchBuffer.flushAsid(asid);
+    invalidated += flushPageWalkCache(asid);
+    // The page walkers' translations are not tagged with GPU ASIDs
+    for (int i = 0; i < pagewalkers.size(); i++) {
+        pagewalkers[i]->flushAll();
+    }
+
+    DPRINTF(ShaderMMU, "Flush of ASID %d invalidated %d entries\n", asid,
+            invalidated);
+    shootdowns[ShootdownAsid]++;
+    shootdownInvalidations.sample(invalidated);
+}
+
+void
+ShaderMMU::flushAll()
+{
+    unsigned invalidated = 0;
+    for (int i = 0; i < tlbs.size(); i++) {
+        invalidated += tlbs[i]->invalidateAll();
+    }
+    for (int i = 0; i < clusterTLBs.size(); i++) {
+        invalidated += clusterTLBs[i]->invalidateAll();
+    }
+    if (tlb) {
+        invalidated += tlb->flushAll();
+    }
+    invalidated += prefetchBuffer.flushAll();
+    for (int level = 0; level < NumPWCLevels; level++) {
+        if (pageWalkCache[level]) {
+            invalidated += pageWalkCache[level]->flushAll();
+        }
+    }
+    for (int i = 0; i < pagewalkers.size(); i++) {
+        pagewalkers[i]->flushAll();
+    }
+
+    DPRINTF(ShaderMMU, "Flush of all translations invalidated %d entries\n",
+            invalidated);
+    shootdowns[ShootdownAll]++;
+    shootdownInvalidations.sample(invalidated);
+}
+
+TLBPrefetchBuffer::TLBPrefetchBuffer(int size) :
+    entries(size), index(size), mruHead(-1), lruTail(-1), freeHead(-1)
+{
+    // Chain all entries onto the free list
+    for (int e = size - 1; e >= 0; e--) {
+        entries[e].prev = -1;
+        entries[e].next = freeHead;
+        freeHead = e;
+    }
+}
+
+void
+TLBPrefetchBuffer::unlink(int e)
+{
+    Entry &entry = entries[e];
+    if (entry.prev >= 0) {
+        entries[entry.prev].next = entry.next;
+    } else {
+        mruHead = entry.next;
+    }
+    if (entry.next >= 0) {
+        entries[entry.next].prev = entry.prev;
+    } else {
+        lruTail = entry.prev;
+    }
+}
+
+void
+TLBPrefetchBuffer::pushMRU(int e)
+{
+    Entry &entry = entries[e];
+    entry.prev = -1;
+    entry.next = mruHead;
+    if (mruHead >= 0) {
+        entries[mruHead].prev = e;
+    } else {
+        lruTail = e;
+    }
+    mruHead = e;
+}
+
+void
+TLBPrefetchBuffer::release(int e)
+{
+    Entry &entry = entries[e];
+    unlink(e);
+    index.erase(asidTaggedPage(entry.vpBase, entry.asid));
+    entry.next = freeHead;
+    freeHead = e;
+}
+
+bool
+TLBPrefetchBuffer::remove(Addr vp_base, GPUAsid asid, Addr &pp_base,
+                          GPUPageSize &size)
+{
+    int *e = index.find(asidTaggedPage(vp_base, asid));
+    if (!e) {
+        return false;
+    }
+    Entry &entry = entries[*e];
+    pp_base = entry.ppBase;
+    size = entry.pageSize;
+    release(*e);
+    return true;
+}
+
+void
+TLBPrefetchBuffer::insert(Addr vp_base, GPUAsid asid, Addr pp_base,
+                          GPUPageSize size)
+{
+    assert(!entries.empty());
+    Addr key = asidTaggedPage(vp_base, asid);
+    int *found = index.find(key);
+    int e;
+    if (found) {
+        e = *found;
+        unlink(e);
+    } else if (freeHead >= 0) {
+        e = freeHead;
+        freeHead = entries[e].next;
+        index.insert(key, e);
+    } else {
+        // Evict the least recently inserted prefetch
+        e = lruTail;
+        unlink(e);
+        index.erase(asidTaggedPage(entries[e].vpBase, entries[e].asid));
+        index.insert(key, e);
+    }
+    entries[e].vpBase = vp_base;
+    entries[e].asid = asid;
+    entries[e].ppBase = pp_base;
+    entries[e].pageSize = size;
+    pushMRU(e);
+}
+
+unsigned
+TLBPrefetchBuffer::demapPage(Addr vaddr, GPUAsid asid)
+{
+    // Prefetches of large pages are held per 4KB page, so scan for all that
+    // lie in the demapped page
+    unsigned removed = 0;
+    int e = mruHead;
+    while (e >= 0) {
+        Entry &entry = entries[e];
+        int next = entry.next;
+        if (entry.asid == asid && gpuPageBase(entry.vpBase, entry.pageSize) ==
+                                  gpuPageBase(vaddr, entry.pageSize)) {
+            release(e);
+            removed++;
+        }
+        e = next;
+    }
+    return removed;
+}
+
+unsigned
+TLBPrefetchBuffer::flushAsid(GPUAsid asid)
+{
+    unsigned removed = 0;
+    int e = mruHead;
+    while (e >= 0) {
+        int next = entries[e].next;
+        if (entries[e].asid == asid) {
+            release(e);
+            removed++;
+        }
+        e = next;
+    }
+    return removed;
+}
+
+void
+TLBPrefetchBuffer::getTranslations(
+    std::vector<GPUTranslation> &translations) const
+{
+    for (int e = lruTail; e >= 0; e = entries[e].prev) {
+        const Entry &entry = entries[e];
+        GPUTranslation t = { entry.vpBase, entry.asid, entry.ppBase,
+                             entry.pageSize };
+        translations.push_back(t);
+    }
+}
+
+unsigned
+TLBPrefetchBuffer::flushAll()
+{
+    unsigned removed = 0;
+    while (mruHead >= 0) {
+        release(mruHead);
+        removed++;
+    }
+    return removed;
 }
 
 void
@@ -666,33 +1497,133 @@ ShaderMMU::regStats()
         .desc("Number of faults caused by prefetches")
         ;
 
+    pwcHits
+        .init(NumPWCLevels)
+        .name(name()+".pwcHits")
+        .desc("Native walks starting below a page walk cache hit, by level")
+        ;
+    for (int level = 0; level < NumPWCLevels; level++) {
+        pwcHits.subname(level, pwcLevelNames[level]);
+    }
+
+    pwcMisses
+        .name(name()+".pwcMisses")
+        .desc("Native walks that missed in all page walk cache levels")
+        ;
+
+    nativeWalkReads
+        .name(name()+".nativeWalkReads")
+        .desc("Page table entry reads by the native walker")
+        ;
+
+    nativeWalkFallbacks
+        .name(name()+".nativeWalkFallbacks")
+        .desc("Native walks handed to a pagewalker for a full walk")
+        ;
+
+    l2hitsByPageSize
+        .init(NumGPUPageSizes)
+        .name(name() + ".l2hitsByPageSize")
+        .desc("Hits in the shared L2 by page size")
+        ;
+    walksByPageSize
+        .init(NumGPUPageSizes)
+        .name(name() + ".walksByPageSize")
+        .desc("Successful pagewalks by size of the page found")
+        ;
+    for (int size = 0; size < NumGPUPageSizes; size++) {
+        l2hitsByPageSize.subname(size, gpuPageSizeNames[size]);
+        walksByPageSize.subname(size, gpuPageSizeNames[size]);
+    }
+
+    shootdowns
+        .init(NumShootdownKinds)
+        .name(name() + ".shootdowns")
+        .desc("TLB shootdowns by scope (page, address space or all)")
+        ;
+    for (int kind = 0; kind < NumShootdownKinds; kind++) {
+        shootdowns.subname(kind, shootdownKindNames[kind]);
+    }
+
+    shootdownInvalidations
+        .name(name() + ".shootdownInvalidations")
+        .desc("Translations invalidated per shootdown across all GPU TLBs, "
+              "the prefetch buffer and the page walk cache")
+        .init(32)
+        ;
+
     pagefaultLatency
         .name(name()+".pagefaultLatency")
         .desc("Latency to complete the pagefault")
         .init(32)
         ;
 
+    pagefaultBatchLatency
+        .name(name()+".pagefaultBatchLatency")
+        .desc("Latency from raising a fault batch to retrying all its walks")
+        .init(32)
+        ;
+
+    pagefaultInterrupts
+        .name(name()+".pagefaultInterrupts")
+        .desc("Number of interrupts raised to the CPU for GPU page faults")
+        ;
+    pagefaultBatchSize
+        .name(name()+".pagefaultBatchSize")
+        .desc("Number of page faults serviced per fault batch")
+        .init(16)
+        ;
+
     pagewalkLatency
         .name(name()+".pagewalkLatency")
         .desc("Latency to complete the pagewalk")
         .init(32)
         ;
 
+    for (int c = 0; c < NumWalkClasses; c++) {
+        walkQueueDelay[c]
+            .name(csprintf("%s.%sWalkQueueDelay", name(), walkClassNames[c]))
+            .desc(csprintf("Cycles %s walks waited for a page walker",
+                           walkClassNames[c]))
+            .init(32)
+            ;
+    }
+
+    starvedWalks
+        .name(name() + ".starvedWalks")
+        .desc("Walks started ahead of higher priority walks after waiting "
+              "walk_starvation_cycles")
+        ;
+
     concurrentWalks
         .name(name()+".concurrentWalks")
         .desc("Number of outstanding walks")
         .init(16)
         ;
+
+    lookupPortStalls
+        .name(name()+".lookupPortStalls")
+        .desc("Cycles with arrived misses left waiting for a lookup port")
+        ;
+
+    lookupBatchSize
+        .name(name()+".lookupBatchSize")
+        .desc("Number of misses looked up per lookup cycle")
+        .init(16)
+        ;
 }
 
 ShaderMMU::TranslationRequest::TranslationRequest(ShaderMMU *_mmu,
     ShaderTLB *_tlb, BaseTLB::Translation *translation,
-    RequestPtr _req, BaseTLB::Mode _mode, ThreadContext *_tc, Tick start_tick,
-    bool prefetch)
+    RequestPtr _req, BaseTLB::Mode _mode, ThreadContext *_tc, GPUAsid _asid,
+    Tick start_tick, bool prefetch)
             : mmu(_mmu), origTLB(_tlb), pageWalker(NULL),
               wrappedTranslation(translation), req(_req), mode(_mode), tc(_tc),
-              beginFault(0), beginWalk(0), startTick(start_tick),
-              prefetch(prefetch)
+              asid(_asid), beginFault(0), beginWalk(0), startTick(start_tick),
+              prefetch(prefetch), prefetchLate(false),
+              walkClass(prefetch ? WalkPrefetch : WalkDemand), queuedCycle(0),
+              pageSize(GPUPage4KB), nextMerged(NULL),
+              walkLevel(0), walkedNatively(false)
 {
     vpBase = req->getVaddr() - req->getVaddr() % TheISA::PageBytes;
 }
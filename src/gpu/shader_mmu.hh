@@ -31,21 +31,82 @@
 #ifndef SHADER_MMU_HH_
 #define SHADER_MMU_HH_
 
-#include <list>
+#include <deque>
 #include <map>
 #include <queue>
 #include <set>
 
 #include "arch/tlb.hh"
 #include "base/statistics.hh"
+#include "gpu/addr_hash_table.hh"
 #include "debug/ShaderMMU.hh"
 #include "params/ShaderMMU.hh"
 #include "gpu/shader_tlb.hh"
-#include "sim/clocked_object.hh"
+#include "gpu/tlb_prefetcher.hh"
+#include "mem/mem_object.hh"
 #include "sim/faults.hh"
 #include "arch/generic/tlb.hh"
 
-class ShaderMMU : public ClockedObject
+class ClusterTLB;
+
+/**
+ * Fully associative buffer of prefetched translations with LRU replacement.
+ * Entries live in a fixed array on an intrusive LRU list and are indexed by
+ * a hash table sized for the buffer, so lookup, insert and eviction take
+ * constant time and never allocate.
+ */
+class TLBPrefetchBuffer
+{
+  private:
+    struct Entry {
+        Addr vpBase;
+        GPUAsid asid;
+        Addr ppBase;
+        GPUPageSize pageSize;
+        // Neighbours on the LRU list (or next on the free list), -1 for none
+        int prev;
+        int next;
+    };
+
+    std::vector<Entry> entries;
+    AddrHashTable<int> index;
+    int mruHead;
+    int lruTail;
+    int freeHead;
+
+    void unlink(int e);
+    void pushMRU(int e);
+    /// Unlink an entry, drop it from the index and return it to the free list
+    void release(int e);
+
+  public:
+    TLBPrefetchBuffer(int size);
+
+    // Translations are indexed by ASID-tagged page base
+    bool contains(Addr vp_base, GPUAsid asid)
+    {
+        return index.find(asidTaggedPage(vp_base, asid)) != NULL;
+    }
+
+    /// Remove the translation for vp_base, returning whether it was present
+    bool remove(Addr vp_base, GPUAsid asid, Addr &pp_base, GPUPageSize &size);
+
+    /// Insert a translation, evicting the least recently inserted if full
+    void insert(Addr vp_base, GPUAsid asid, Addr pp_base, GPUPageSize size);
+
+    /// Remove the translations of the page holding vaddr (at the size each
+    /// was prefetched as), of an address space, or all. These return the
+    /// number of translations removed.
+    unsigned demapPage(Addr vaddr, GPUAsid asid);
+    unsigned flushAsid(GPUAsid asid);
+    unsigned flushAll();
+
+    /// Append all translations, least recently inserted first, so that
+    /// inserting them in order restores the replacement order
+    void getTranslations(std::vector<GPUTranslation> &translations) const;
+};
+
+class ShaderMMU : public MemObject
 {
 private:
     std::vector<TheISA::TLB*> pagewalkers;
@@ -55,6 +116,15 @@ private:
     TheISA::Stage2MMU *stage2MMU;
 #endif
 
+    /// Priority classes of page walks, from highest to lowest priority
+    enum WalkClass {
+        WalkFaultRetry,
+        WalkDemand,
+        WalkPrefetch,
+        NumWalkClasses
+    };
+    static const char *walkClassNames[NumWalkClasses];
+
     class TranslationRequest : public BaseTLB::Translation
     {
     public:
@@ -66,17 +136,35 @@ private:
         BaseTLB::Mode mode;
         ThreadContext *tc;
         Addr vpBase;
+        GPUAsid asid;
         Cycles beginFault;
         Cycles beginWalk;
         Tick startTick;
         bool prefetch;
+        // Whether a demand miss has merged into this prefetch's walk, which
+        // counts the prefetch as late (once, however many misses merge)
+        bool prefetchLate;
+        // Class of the walk, and cycle it began waiting for a walker
+        WalkClass walkClass;
+        Cycles queuedCycle;
+        // Size of the page mapping vpBase, as reported by the page walk
+        GPUPageSize pageSize;
+        // Next request waiting on the same walk as this one
+        TranslationRequest *nextMerged;
+        // Level of the next page table read by the native walker (3: PML4
+        // down to 0: PT), and whether the native walker completed the walk
+        int walkLevel;
+        bool walkedNatively;
 
     public:
         TranslationRequest(ShaderMMU *_mmu, ShaderTLB *_tlb,
                            BaseTLB::Translation *translation, RequestPtr _req,
                            BaseTLB::Mode _mode, ThreadContext *_tc,
-                           Tick start_tick, bool prefetch = false);
+                           GPUAsid _asid, Tick start_tick,
+                           bool prefetch = false);
         Tick getStartTick() { return startTick; }
+        /// Key of the page in outstandingWalks
+        Addr walkKey() const { return asidTaggedPage(vpBase, asid); }
         void markDelayed() { wrappedTranslation->markDelayed(); }
         void finish(const Fault &fault, RequestPtr _req, ThreadContext *_tc,
                     BaseTLB::Mode _mode)
@@ -88,6 +176,62 @@ private:
         }
     };
 
+    /**
+     * Port for page table reads by the native page walker. Reads that are
+     * not accepted are held and resent in order on retry.
+     */
+    class WalkPort : public MasterPort
+    {
+        ShaderMMU *mmu;
+        std::queue<PacketPtr> retryPkts;
+    public:
+        WalkPort(const std::string &_name, ShaderMMU *_mmu)
+            : MasterPort(_name, _mmu), mmu(_mmu) {}
+        void sendPacket(PacketPtr pkt);
+    protected:
+        bool recvTimingResp(PacketPtr pkt);
+        void recvReqRetry();
+    };
+
+    class WalkSenderState : public Packet::SenderState
+    {
+    public:
+        TranslationRequest *translation;
+        WalkSenderState(TranslationRequest *_translation)
+            : translation(_translation) {}
+    };
+
+    WalkPort walkPort;
+    MasterID masterId;
+    bool walkBypassL1;
+
+    /**
+     * Page walk cache for the native walker: a cache per upper page table
+     * level (PD, PDP and PML4) of the entries read at that level, indexed by
+     * the virtual address bits the level translates and holding the base of
+     * the next level table. A walk starts from the deepest level that hits,
+     * skipping the reads above it. Walks that would fault or must set the
+     * accessed/dirty bits are handed to the pagewalkers, which do the full
+     * architectural walk. Entries are tagged with the ASID of the page table
+     * they were read from.
+     */
+    enum PWCLevel { PWCLevelPD, PWCLevelPDP, PWCLevelPML4, NumPWCLevels };
+    static const char *pwcLevelNames[NumPWCLevels];
+    TLBMemory *pageWalkCache[NumPWCLevels];
+    // Walk natively if any level has a page walk cache
+    bool nativeWalks;
+
+    /// Invalidate the page walk cache entries of an address space
+    unsigned flushPageWalkCache(GPUAsid asid);
+
+    /// Start a walk in the native walker, skipping levels that hit in the
+    /// page walk cache
+    void beginNativeWalk(TranslationRequest *translation);
+    /// Read the page table entry for the translation's current level
+    void sendWalkRead(TranslationRequest *translation, Addr entry_paddr);
+    /// Continue the walk with the entry read at the current level
+    void recvWalkResp(PacketPtr pkt);
+
     // Latency for requests to reach the MMU from the L1 TLBs
     Cycles latency;
 
@@ -104,6 +248,13 @@ private:
     TLBMissEvent startMissEvent;
     std::queue<TranslationRequest*> startMisses;
 
+    // Number of L2 TLB/prefetch buffer lookups per cycle (0 => unlimited)
+    unsigned lookupPorts;
+
+    /// Look up a single miss in the L2 TLB and prefetch buffer, and start or
+    /// join a page walk if it misses in both
+    void lookupTLBMiss(TranslationRequest *translation_request);
+
     class StartPagewalkEvent : public Event
     {
         ShaderMMU *mmu;
@@ -162,7 +313,7 @@ private:
     FaultTimeoutEvent faultTimeoutEvent;
     Cycles faultTimeoutCycles;
 
-    TLBMemory *tlb;
+    MultiPageTLBMemory *tlb;
 
     enum FaultStatus {
         None, // No outstanding faults
@@ -170,24 +321,93 @@ private:
         Retrying // Retrying the pagetable walk. May not be complete yet.
     };
 
-    std::queue<TranslationRequest*> pendingWalks;
-    std::map<Addr, std::list<TranslationRequest*> > outstandingWalks;
+    /**
+     * Walk scheduler. Walks waiting for a walker are queued by class and
+     * started in class priority order: fault retries, then demand misses,
+     * then prefetches. At most maxClassWalkers of a class are in flight
+     * (0 => no cap), and a walk that has waited starvationCycles or longer
+     * (0 => never) starts ahead of the priority order, oldest first.
+     */
+    // Fault retry and demand walks. Queued prefetches are held in
+    // pendingPrefetches, as they have no TranslationRequest until they start.
+    std::queue<TranslationRequest*> walkQueues[WalkPrefetch];
+    unsigned maxClassWalkers[NumWalkClasses];
+    unsigned activeClassWalks[NumWalkClasses];
+    Cycles starvationCycles;
+
+    /// Queue a walk of the given class to be started by scheduleWalks
+    void queueWalk(TranslationRequest *translation, WalkClass walk_class);
+    /// Whether a walk of the class is waiting and under its walker cap
+    bool canStartWalk(WalkClass walk_class) const;
+    /// Cycle in which the oldest waiting walk of the class was queued
+    Cycles oldestQueuedCycle(WalkClass walk_class) const;
+    /// Start waiting walks on free walkers in scheduling order
+    void scheduleWalks();
+    /// Start a walk on a free walker
+    void startWalk(TranslationRequest *translation);
+    // Requests waiting on the walk for each page, chained through
+    // nextMerged. The head is the request that is being (or will be) walked.
+    struct WalkChain {
+        TranslationRequest *head;
+        TranslationRequest *tail;
+        unsigned size;
+    };
+    AddrHashTable<WalkChain> outstandingWalks;
     std::queue<TranslationRequest*> pendingFaults;
 
     FaultStatus outstandingFaultStatus;
+    // The fault currently raised to the CPU
     TranslationRequest *outstandingFaultInfo;
 
+    // Faults are raised to the CPU in batches of up to faultBatchSize. Each
+    // fault of the batch is raised through the interrupt controller as the
+    // previous one finishes, and their walks are retried together once all
+    // of them have been serviced.
+    unsigned faultBatchSize;
+    std::vector<TranslationRequest*> faultBatch;
+    // Index in faultBatch of the fault raised to the CPU
+    unsigned faultBatchServiced;
+    // Batch retry walks that have not yet completed
+    unsigned faultBatchRetries;
+    Cycles faultBatchStart;
+
     unsigned int curOutstandingWalks;
 
-    std::map<Addr, GPUTlbEntry> prefetchBuffer;
+    TLBPrefetchBuffer prefetchBuffer;
     int prefetchBufferSize;
-    int prefetchAheadDistance;
+
+    TLBPrefetcher *prefetcher;
+
+    // Prefetches waiting for a walker. Prefetch walks are the lowest walk
+    // class, and are not tracked in outstandingWalks until they start.
+    struct PendingPrefetch {
+        Addr vpBase;
+        GPUAsid asid;
+        ThreadContext *tc;
+        Cycles queuedCycle;
+    };
+    std::deque<PendingPrefetch> pendingPrefetches;
+    unsigned prefetchQueueSize;
+    std::vector<Addr> prefetchCandidates;
 
     void finalizeTranslation(TranslationRequest *translation);
 
+    /// Size of the page found by the walker that translated this request
+    GPUPageSize getWalkPageSize(TranslationRequest *translation);
+
     /// Handle a page fault from a shader TLB
     void handlePageFault(TranslationRequest *translation);
 
+    /// Start a batch with up to faultBatchSize pending faults and raise the
+    /// first to the CPU
+    void raiseFaultBatch();
+
+    /// Add a fault to the batch being serviced by the CPU
+    void addFaultToBatch(TranslationRequest *translation);
+
+    /// Retry the walks for all faults of the batch once they are serviced
+    void retryFaultBatch();
+
     void setWalkerFree(TheISA::TLB *walker);
     TheISA::TLB *getFreeWalker();
     void schedulePagewalk(TheISA::TLB *walker, TranslationRequest *translation)
@@ -200,12 +420,41 @@ private:
         schedule(spe, nextCycle());
     }
 
-    // Log the vp base address of the access. If we detect a pattern issue the
-    // prefetch. This is currently just a simple 1-ahead prefetcher
-    void tryPrefetch(Addr vp_base, ThreadContext *tc);
+    // Train the prefetcher on a demand miss to vp_base that missed in the L2
+    // TLB, and queue the prefetches it suggests
+    void notifyPrefetcher(ShaderTLB *req_tlb, Addr vp_base, GPUAsid asid,
+                          ThreadContext *tc);
+
+    // Whether vp_base is already translated, being walked or queued
+    bool isPrefetchRedundant(Addr vp_base, GPUAsid asid);
 
     // Insert prefetch into prefetch buffer
-    void insertPrefetch(Addr vp_base, Addr pp_base);
+    void insertPrefetch(Addr vp_base, GPUAsid asid, Addr pp_base,
+                        GPUPageSize size);
+
+    // The L1 TLBs, for shootdowns and checkpointing
+    std::vector<ShaderTLB*> tlbs;
+    // The cluster TLBs between the L1 TLBs and the MMU, for shootdowns
+    std::vector<ClusterTLB*> clusterTLBs;
+
+    // Whether to save and restore the contents of the GPU TLBs and the
+    // prefetch buffer in checkpoints
+    bool checkpointTranslations;
+
+    static void serializeTranslations(CheckpointOut &cp,
+                                      const std::string &base,
+                                      const std::vector<GPUTranslation> &ts);
+    static void unserializeTranslations(CheckpointIn &cp,
+                                        const std::string &base,
+                                        std::vector<GPUTranslation> &ts);
+
+    enum ShootdownKind {
+        ShootdownPage,
+        ShootdownAsid,
+        ShootdownAll,
+        NumShootdownKinds
+    };
+    static const char *shootdownKindNames[NumShootdownKinds];
 
 public:
     /// Constructor
@@ -213,13 +462,47 @@ public:
     ShaderMMU(const Params *p);
     ~ShaderMMU();
 
+    void init();
+
+    /// Checkpoint the L1 TLBs, the L2 TLB and the prefetch buffer. L1 TLB
+    /// contents are matched to TLBs by name on restore. Those of TLBs that
+    /// no longer exist (e.g. when restoring into fewer SMs) are spread over
+    /// the TLBs of the same kind, where replacement drops any excess.
+    void serialize(CheckpointOut &cp) const;
+    void unserialize(CheckpointIn &cp);
+
+    BaseMasterPort& getMasterPort(const std::string &if_name,
+                                  PortID idx = -1);
+
     /// Called from TLBMissEvent after latency cycles has passed since
-    /// beginTLBMiss
+    /// beginTLBMiss. Looks up all misses that have arrived, up to the number
+    /// of lookup ports, and defers the rest to the next cycle.
     void handleTLBMiss();
 
     /// Called when a shader tlb has a miss
     void beginTLBMiss(ShaderTLB *req_tlb, BaseTLB::Translation *translation,
-                      RequestPtr req, BaseTLB::Mode mode, ThreadContext *tc);
+                      RequestPtr req, BaseTLB::Mode mode, ThreadContext *tc,
+                      GPUAsid asid);
+
+    /// Called by each shader TLB on construction so shootdowns reach it
+    void registerTLB(ShaderTLB *shader_tlb) { tlbs.push_back(shader_tlb); }
+    /// Called by each cluster TLB on construction so shootdowns reach it
+    void registerClusterTLB(ClusterTLB *cluster_tlb)
+    {
+        clusterTLBs.push_back(cluster_tlb);
+    }
+
+    /**
+     * TLB shootdowns. These invalidate the matching translations in all L1
+     * TLBs, cluster TLBs, the L2 TLB, the prefetch buffer and the page
+     * walkers' TLBs (the latter entirely for an ASID flush). Shooting down
+     * a page or an address space also flushes the address space's page walk
+     * cache entries, since unmapping may free page table pages. Walks
+     * already in flight are not squashed.
+     */
+    void shootdown(Addr vaddr, GPUAsid asid);
+    void flushASID(GPUAsid asid);
+    void flushAll();
 
     /// Called from a start pagewalk event
     void walk(TheISA::TLB *walker, TranslationRequest *translation) {
@@ -227,7 +510,12 @@ public:
         assert(walker != NULL);
         translation->beginWalk = curCycle();
         translation->pageWalker = walker;
+        translation->walkedNatively = false;
         numPagewalks++;
+        if (nativeWalks) {
+            beginNativeWalk(translation);
+            return;
+        }
         walker->translateTiming(translation->req, translation->tc, translation,
                                 translation->mode);
     }
@@ -242,6 +530,9 @@ public:
     // Raise the page fault to the CPU if everything is ready
     void raisePageFaultInterrupt(ThreadContext *tc);
 
+    // Describe the outstanding fault in the CPU's GPU fault registers
+    void setFaultRegisters(ThreadContext *tc);
+
     // Page fault timed out, so crash and/or cleanup
     void faultTimeout(ThreadContext *tc);
 
@@ -258,9 +549,27 @@ public:
     Stats::Scalar numPrefetches;
     Stats::Scalar prefetchFaults;
 
+    Stats::Vector pwcHits;
+    Stats::Scalar pwcMisses;
+    Stats::Scalar nativeWalkReads;
+    Stats::Scalar nativeWalkFallbacks;
+
+    Stats::Vector l2hitsByPageSize;
+    Stats::Vector walksByPageSize;
+
+    Stats::Vector shootdowns;
+    Stats::Histogram shootdownInvalidations;
+
+    Stats::Scalar lookupPortStalls;
+    Stats::Histogram lookupBatchSize;
     Stats::Histogram pagefaultLatency;
+    Stats::Histogram pagefaultBatchLatency;
+    Stats::Histogram pagefaultBatchSize;
+    Stats::Scalar pagefaultInterrupts;
     Stats::Histogram concurrentWalks;
     Stats::Histogram pagewalkLatency;
+    Stats::Histogram walkQueueDelay[NumWalkClasses];
+    Stats::Scalar starvedWalks;
 };
 
 #endif // SHADER_MMU_HH_
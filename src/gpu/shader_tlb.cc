@@ -26,10 +26,13 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
 #include <map>
 
 #include "arch/isa.hh"
+#include "base/intmath.hh"
 #include "debug/ShaderTLB.hh"
+#include "gpu/cluster_tlb.hh"
 #include "gpu/shader_tlb.hh"
 #include "gpu/gpgpu-sim/cuda_gpu.hh"
 
@@ -45,16 +48,50 @@
 using namespace std;
 using namespace TheISA;
 
+const unsigned gpuPageLogBytes[NumGPUPageSizes] = { 12, 21, 30 };
+const char *gpuPageSizeNames[NumGPUPageSizes] = { "4KB", "2MB", "1GB" };
+
 ShaderTLB::ShaderTLB(const Params *p) :
     BaseTLB(p), numEntries(p->entries), hitLatency(p->hit_latency),
-    cudaGPU(p->gpu), accessHostPageTable(p->access_host_pagetable)
+    cudaGPU(p->gpu), accessHostPageTable(p->access_host_pagetable),
+    clusterTLB(p->cluster_tlb),
+    lookupPorts(p->lookup_ports), portCycle(0), portsUsed(0),
+    portEvent(this), hitEvent(this)
 {
     if (numEntries > 0) {
-        tlbMemory = new TLBMemory(p->entries, p->associativity);
+        int entries[NumGPUPageSizes] =
+            { p->entries, p->entries_2mb, p->entries_1gb };
+        tlbMemory = new MultiPageTLBMemory(entries, p->associativity,
+                                           p->replacement_policy);
     } else {
-        tlbMemory = new InfiniteTLBMemory();
+        tlbMemory = new MultiPageTLBMemory();
     }
     mmu = cudaGPU->getMMU();
+    mmu->registerTLB(this);
+
+    if (p->translation_cache_entries < 0) {
+        fatal("%s: translation_cache_entries must not be negative\n", name());
+    }
+    translationCacheVPBases.assign(p->translation_cache_entries, (Addr)-1);
+    translationCachePPBases.assign(p->translation_cache_entries, Addr(0));
+
+    if (p->mshrs <= 0 || p->mshr_targets <= 0) {
+        fatal("%s: TLBs need at least one MSHR with one target\n", name());
+    }
+    mshrTargets = p->mshr_targets;
+    activeMSHRs = 0;
+    for (int i = 0; i < p->mshrs; i++) {
+        mshrs.push_back(new TLBMissMSHR(this));
+        mshrs.back()->targets.reserve(mshrTargets);
+    }
+}
+
+ShaderTLB::~ShaderTLB()
+{
+    for (int i = 0; i < mshrs.size(); i++) {
+        delete mshrs[i];
+    }
+    delete tlbMemory;
 }
 
 void
@@ -62,6 +99,7 @@ ShaderTLB::unserialize(CheckpointIn &cp)
 {
     // Intentionally left blank to keep from trying to read shader header from
     // checkpoint files. Allows for restore into any number of shader cores.
+    // TLB contents are restored by the ShaderMMU if it checkpoints them.
     // NOTE: Cannot checkpoint during kernels
 }
 
@@ -70,7 +108,31 @@ ShaderTLB::beginTranslateTiming(RequestPtr req,
                                 BaseTLB::Translation *translation,
                                 BaseTLB::Mode mode)
 {
+    // The direct segment maps GPU addresses only; host TLBs (e.g. the copy
+    // engine's) translate through the host page table
+    Addr segment_paddr;
+    if (!accessHostPageTable &&
+        cudaGPU->translateDirectSegment(req->getVaddr(), segment_paddr)) {
+        // No TLB storage or lookup ports needed for the direct segment
+        directSegmentHits++;
+        req->setPaddr(segment_paddr);
+        translation->finish(NoFault, req, NULL, mode);
+        return;
+    }
+
     if (accessHostPageTable) {
+        if (!portQueue.empty() || !claimLookupPort()) {
+            // Wait for a port behind any lookups already waiting
+            DPRINTF(ShaderTLB, "No lookup port for vaddr %#x\n",
+                    req->getVaddr());
+            lookupPortStalls++;
+            PendingLookup pending = { req, translation, mode };
+            portQueue.push(pending);
+            if (!portEvent.scheduled()) {
+                schedule(portEvent, cudaGPU->clockEdge(Cycles(1)));
+            }
+            return;
+        }
         translateTiming(req, cudaGPU->getThreadContext(), translation, mode);
     } else {
         // The below code implements a perfect TLB with instant access to the
@@ -81,9 +143,27 @@ ShaderTLB::beginTranslateTiming(RequestPtr req,
         Addr page_vaddr = cudaGPU->getGPUPageTable()->addrToPage(vaddr);
         Addr offset = vaddr - page_vaddr;
         Addr page_paddr;
+
+        int entry = -1;
+        if (!translationCacheVPBases.empty()) {
+            entry = (page_vaddr / TheISA::PageBytes) %
+                    translationCacheVPBases.size();
+            if (translationCacheVPBases[entry] == page_vaddr) {
+                translationCacheHits++;
+                req->setPaddr(translationCachePPBases[entry] + offset);
+                translation->finish(NoFault, req, NULL, mode);
+                return;
+            }
+            translationCacheMisses++;
+        }
+
         if (cudaGPU->getGPUPageTable()->lookup(page_vaddr, page_paddr)) {
             DPRINTF(ShaderTLB, "Translation found for vaddr %x = paddr %x\n",
                                 vaddr, page_paddr + offset);
+            if (entry >= 0) {
+                translationCacheVPBases[entry] = page_vaddr;
+                translationCachePPBases[entry] = page_paddr;
+            }
             req->setPaddr(page_paddr + offset);
             translation->finish(NoFault, req, NULL, mode);
         } else {
@@ -93,6 +173,62 @@ ShaderTLB::beginTranslateTiming(RequestPtr req,
     }
 }
 
+bool
+ShaderTLB::lookupPortAvailable()
+{
+    if (!accessHostPageTable || lookupPorts == 0) {
+        return true;
+    }
+    return portQueue.empty() &&
+           (portCycle != cudaGPU->curCycle() || portsUsed < lookupPorts);
+}
+
+bool
+ShaderTLB::claimLookupPort()
+{
+    Cycles cur_cycle = cudaGPU->curCycle();
+    if (cur_cycle != portCycle) {
+        if (portsUsed > 0) {
+            lookupsPerCycle.sample(portsUsed);
+        }
+        portCycle = cur_cycle;
+        portsUsed = 0;
+    }
+    if (lookupPorts > 0 && portsUsed == lookupPorts) {
+        return false;
+    }
+    portsUsed++;
+    return true;
+}
+
+void
+ShaderTLB::startQueuedLookups()
+{
+    while (!portQueue.empty() && claimLookupPort()) {
+        PendingLookup pending = portQueue.front();
+        portQueue.pop();
+        translateTiming(pending.req, cudaGPU->getThreadContext(),
+                        pending.translation, pending.mode);
+    }
+    if (!portQueue.empty()) {
+        schedule(portEvent, cudaGPU->clockEdge(Cycles(1)));
+    }
+}
+
+void
+ShaderTLB::completeHits()
+{
+    // All hits take the same latency, so they become ready in order
+    while (!hitQueue.empty() && hitQueue.front().readyTick <= curTick()) {
+        PendingHit hit = hitQueue.front();
+        hitQueue.pop();
+        hit.translation->finish(NoFault, hit.req, hit.tc, hit.mode);
+    }
+    if (!hitQueue.empty()) {
+        schedule(hitEvent, hitQueue.front().readyTick);
+    }
+}
+
 void
 ShaderTLB::translateTiming(RequestPtr req, ThreadContext *tc,
                            Translation *translation, Mode mode)
@@ -131,92 +267,671 @@ ShaderTLB::translateTiming(RequestPtr req, ThreadContext *tc,
 #endif
 
     Addr vaddr = req->getVaddr();
-    DPRINTF(ShaderTLB, "Translating vaddr %#x.\n", vaddr);
-    Addr offset = vaddr % TheISA::PageBytes;
-    Addr vp_base = vaddr - offset;
-    Addr pp_base;
+    GPUAsid asid = cudaGPU->getRunningASID();
+    DPRINTF(ShaderTLB, "Translating vaddr %#x (ASID %d).\n", vaddr, asid);
+    Addr paddr;
+    GPUPageSize page_size;
 
-    if (tlbMemory->lookup(vp_base, pp_base)) {
-        DPRINTF(ShaderTLB, "TLB hit. Phys addr %#x.\n", pp_base + offset);
+    if (tlbMemory->lookup(vaddr, asid, paddr, page_size)) {
+        DPRINTF(ShaderTLB, "TLB hit (%s page). Phys addr %#x.\n",
+                gpuPageSizeNames[page_size], paddr);
         hits++;
-        req->setPaddr(pp_base + offset);
-        translation->finish(NoFault, req, tc, mode);
+        hitsByPageSize[page_size]++;
+        req->setPaddr(paddr);
+        if (hitLatency == 0) {
+            translation->finish(NoFault, req, tc, mode);
+        } else {
+            PendingHit hit = { req, tc, translation, mode,
+                               cudaGPU->clockEdge(hitLatency) };
+            hitQueue.push(hit);
+            if (!hitEvent.scheduled()) {
+                schedule(hitEvent, hit.readyTick);
+            }
+        }
     } else {
         // TLB miss! Let the TLB handle the walk, etc
         DPRINTF(ShaderTLB, "TLB miss for addr %#x\n", vaddr);
         misses++;
         translation->markDelayed();
 
-        mmu->beginTLBMiss(this, translation, req, mode, tc);
+        // Keep misses in order behind any that are already stalled
+        if (!stalledMisses.empty() ||
+            !handleMiss(req, tc, translation, mode, asid)) {
+            DPRINTF(ShaderTLB, "No MSHR for addr %#x, stalling miss\n", vaddr);
+            mshrFullStalls++;
+            StalledMiss stalled = { req, tc, translation, mode, asid };
+            stalledMisses.push(stalled);
+        }
+    }
+}
+
+ShaderTLB::TLBMissMSHR *
+ShaderTLB::findMSHR(Addr vp_base, GPUAsid asid, Mode mode)
+{
+    for (int i = 0; i < mshrs.size(); i++) {
+        TLBMissMSHR *mshr = mshrs[i];
+        if (mshr->valid && mshr->vpBase == vp_base && mshr->asid == asid &&
+            (mshr->mode == mode || mshr->mode == BaseTLB::Write)) {
+            return mshr;
+        }
+    }
+    return NULL;
+}
+
+bool
+ShaderTLB::handleMiss(RequestPtr req, ThreadContext *tc,
+                      Translation *translation, Mode mode, GPUAsid asid)
+{
+    Addr vp_base = gpuPageBase(req->getVaddr(), GPUPage4KB);
+    TLBMissMSHR::Target target = { req, translation, mode };
+
+    TLBMissMSHR *mshr = findMSHR(vp_base, asid, mode);
+    if (mshr) {
+        if (mshr->targets.size() >= mshrTargets) {
+            return false;
+        }
+        DPRINTF(ShaderTLB, "Merging miss for addr %#x into MSHR for %#x\n",
+                req->getVaddr(), vp_base);
+        mshrMerges++;
+        mshr->targets.push_back(target);
+        return true;
+    }
+
+    if (activeMSHRs == mshrs.size()) {
+        return false;
+    }
+    for (int i = 0; i < mshrs.size(); i++) {
+        if (!mshrs[i]->valid) {
+            mshr = mshrs[i];
+            break;
+        }
+    }
+    assert(mshr && mshr->targets.empty());
+    mshr->valid = true;
+    mshr->vpBase = vp_base;
+    mshr->asid = asid;
+    mshr->mode = mode;
+    mshr->fillSize = GPUPage4KB;
+    mshr->targets.push_back(target);
+    activeMSHRs++;
+
+    if (clusterTLB) {
+        clusterTLB->beginTLBMiss(this, mshr, req, mode, tc, asid);
+    } else {
+        mmu->beginTLBMiss(this, mshr, req, mode, tc, asid);
+    }
+    return true;
+}
+
+void
+ShaderTLB::finishMiss(TLBMissMSHR *mshr, const Fault &fault, RequestPtr req,
+                      ThreadContext *tc)
+{
+    assert(mshr->valid);
+    assert(mshr->targets.front().req == req);
+    // The MMU (or cluster TLB) has already filled this TLB. All targets lie
+    // in the same 4KB page as the primary miss, so they share its page
+    // offset translation.
+    Addr vp_base = mshr->vpBase;
+    Addr pp_base = req->getPaddr() - (req->getVaddr() - vp_base);
+    DPRINTF(ShaderTLB, "MSHR for %#x complete with %d targets\n",
+            vp_base, mshr->targets.size());
+
+    // Free the MSHR before completing targets, which may begin new
+    // translations in this TLB
+    std::vector<TLBMissMSHR::Target> targets;
+    targets.swap(mshr->targets);
+    mshr->targets.reserve(mshrTargets);
+    mshr->valid = false;
+    activeMSHRs--;
+
+    // Every target was counted as a miss, so count each by the size of the
+    // page that satisfied it
+    if (fault == NoFault) {
+        missesByPageSize[mshr->fillSize] += targets.size();
+    }
+
+    for (int i = 0; i < targets.size(); i++) {
+        TLBMissMSHR::Target &target = targets[i];
+        if (fault == NoFault && target.req != req) {
+            target.req->setPaddr(pp_base + (target.req->getVaddr() - vp_base));
+        }
+        target.translation->finish(fault, target.req, tc, target.mode);
+    }
+
+    replayStalledMisses();
+}
+
+void
+ShaderTLB::replayStalledMisses()
+{
+    while (!stalledMisses.empty()) {
+        StalledMiss &stalled = stalledMisses.front();
+        Addr paddr;
+        GPUPageSize page_size;
+        if (tlbMemory->lookup(stalled.req->getVaddr(), stalled.asid, paddr,
+                              page_size)) {
+            // Filled while this miss was stalled. Already counted as a miss.
+            missesByPageSize[page_size]++;
+            stalled.req->setPaddr(paddr);
+            stalled.translation->finish(NoFault, stalled.req, stalled.tc,
+                                        stalled.mode);
+        } else if (!handleMiss(stalled.req, stalled.tc, stalled.translation,
+                               stalled.mode, stalled.asid)) {
+            return;
+        }
+        stalledMisses.pop();
     }
 }
 
 void
-ShaderTLB::insert(Addr vp_base, Addr pp_base)
+ShaderTLB::insert(Addr vaddr, GPUAsid asid, Addr paddr, GPUPageSize size,
+                  bool fill_cluster)
 {
-    tlbMemory->insert(vp_base, pp_base);
+    GPUPageSize fill_size = tlbMemory->insert(vaddr, asid, paddr, size);
+
+    // Record the fill's page size in the MSHRs waiting on it, so their
+    // misses are counted by page size when they complete
+    Addr vp_base = gpuPageBase(vaddr, GPUPage4KB);
+    for (int i = 0; i < mshrs.size(); i++) {
+        TLBMissMSHR *mshr = mshrs[i];
+        if (mshr->valid && mshr->vpBase == vp_base && mshr->asid == asid) {
+            mshr->fillSize = fill_size;
+        }
+    }
+
+    if (clusterTLB && fill_cluster) {
+        clusterTLB->insert(vaddr, asid, paddr, size);
+    }
 }
 
 void
 ShaderTLB::demapPage(Addr addr, uint64_t asn)
 {
-    DPRINTF(ShaderTLB, "Demapping %#x.\n", addr);
-    panic("Demap addr unimplemented");
+    // The host's address space number does not identify a GPU address
+    // space, so the page is shot down in the address space the GPU is
+    // running, in all GPU TLBs, not just this one.
+    GPUAsid asid = cudaGPU->getRunningASID();
+    DPRINTF(ShaderTLB, "Demapping %#x (ASID %d).\n", addr, asid);
+    mmu->shootdown(addr, asid);
 }
 
 void
 ShaderTLB::flushAll()
 {
-    panic("Flush all unimplemented");
+    DPRINTF(ShaderTLB, "Flushing all translations.\n");
+    mmu->flushAll();
+}
+
+unsigned
+ShaderTLB::invalidatePage(Addr vaddr, GPUAsid asid)
+{
+    return tlbMemory->demapPage(vaddr, asid);
+}
+
+unsigned
+ShaderTLB::invalidateAsid(GPUAsid asid)
+{
+    return tlbMemory->flushAsid(asid);
+}
+
+unsigned
+ShaderTLB::invalidateAll()
+{
+    return tlbMemory->flushAll();
+}
+
+TLBMemory::TLBMemory(int _numEntries, int associativity,
+                     Enums::TLBReplacementPolicy policy,
+                     unsigned log_page_bytes) :
+    numEntries(_numEntries), assoc(associativity),
+    logPageBytes(log_page_bytes)
+{
+    if (assoc == 0) {
+        assoc = numEntries;
+    }
+    assert(numEntries % assoc == 0);
+    numSets = numEntries / assoc;
+
+    tags = new Addr[numEntries];
+    ppBases = new Addr[numEntries];
+    for (int i = 0; i < numEntries; i++) {
+        tags[i] = invalidTag;
+        ppBases[i] = Addr(0);
+    }
+    filledWays = new int[numSets];
+    for (int set = 0; set < numSets; set++) {
+        filledWays[set] = 0;
+    }
+
+    replacementPolicy = TLBReplacementPolicy::create(policy, numSets, assoc);
+}
+
+TLBMemory::~TLBMemory()
+{
+    delete[] tags;
+    delete[] ppBases;
+    delete[] filledWays;
+    delete replacementPolicy;
+}
+
+int
+TLBMemory::findWay(int set, Addr tag) const
+{
+    // Compare the filled ways of the set without an early exit so the
+    // compiler can vectorize the loop. A page is held by at most one way of
+    // a set.
+    const Addr *set_tags = &tags[set * assoc];
+    int filled = filledWays[set];
+    int hit_way = -1;
+    for (int way = 0; way < filled; way++) {
+        hit_way = (set_tags[way] == tag) ? way : hit_way;
+    }
+    return hit_way;
+}
+
+bool
+TLBMemory::lookup(Addr vp_base, GPUAsid asid, Addr& pp_base, bool set_mru)
+{
+    Addr tag = asidTaggedPage(vp_base, asid);
+    int set = setIndex(tag);
+    int way = findWay(set, tag);
+    if (way < 0) {
+        pp_base = Addr(0);
+        return false;
+    }
+    pp_base = ppBases[set * assoc + way];
+    if (set_mru) {
+        replacementPolicy->touch(set, way);
+    }
+    return true;
+}
+
+void
+TLBMemory::insert(Addr vp_base, GPUAsid asid, Addr pp_base)
+{
+    Addr tag = asidTaggedPage(vp_base, asid);
+    assert(tag != invalidTag);
+    int set = setIndex(tag);
+    int way = findWay(set, tag);
+    if (way >= 0) {
+        replacementPolicy->touch(set, way);
+        return;
+    }
+    // Refill a way invalidated by a demap before filling a new one
+    Addr *set_tags = &tags[set * assoc];
+    for (int i = 0; i < filledWays[set]; i++) {
+        if (set_tags[i] == invalidTag) {
+            way = i;
+            break;
+        }
+    }
+    if (way < 0 && filledWays[set] < assoc) {
+        way = filledWays[set]++;
+    }
+    if (way < 0) {
+        way = replacementPolicy->victim(set);
+        DPRINTF(ShaderTLB, "Evicting entry for vp %#x\n", set_tags[way]);
+    }
+
+    set_tags[way] = tag;
+    ppBases[set * assoc + way] = pp_base;
+    replacementPolicy->touch(set, way);
 }
 
 bool
-TLBMemory::lookup(Addr vp_base, Addr& pp_base, bool set_mru)
-{
-    int way = (vp_base / TheISA::PageBytes) % ways;
-    for (int i=0; i < sets; i++) {
-        if (entries[way][i].vpBase == vp_base && !entries[way][i].free) {
-            pp_base = entries[way][i].ppBase;
-            assert(entries[way][i].mruTick > 0);
-            if (set_mru) {
-                entries[way][i].setMRU();
+TLBMemory::demapPage(Addr vp_base, GPUAsid asid)
+{
+    Addr tag = asidTaggedPage(vp_base, asid);
+    int set = setIndex(tag);
+    int way = findWay(set, tag);
+    if (way < 0) {
+        return false;
+    }
+    tags[set * assoc + way] = invalidTag;
+    return true;
+}
+
+unsigned
+TLBMemory::flushAsid(GPUAsid asid)
+{
+    unsigned flushed = 0;
+    for (int i = 0; i < numEntries; i++) {
+        if (tags[i] != invalidTag && taggedPageAsid(tags[i]) == asid) {
+            tags[i] = invalidTag;
+            flushed++;
+        }
+    }
+    return flushed;
+}
+
+void
+TLBMemory::getTranslations(std::vector<GPUTranslation> &translations,
+                           GPUPageSize size) const
+{
+    std::vector<unsigned> ways;
+    for (int set = 0; set < numSets; set++) {
+        ways.clear();
+        replacementPolicy->recencyOrder(set, ways);
+        for (int w = 0; w < ways.size(); w++) {
+            int i = set * assoc + ways[w];
+            if (tags[i] != invalidTag) {
+                GPUTranslation t = { taggedPageBase(tags[i]),
+                                     taggedPageAsid(tags[i]), ppBases[i],
+                                     size };
+                translations.push_back(t);
             }
-            entries[way][i].hits++;
+        }
+    }
+}
+
+unsigned
+TLBMemory::flushAll()
+{
+    unsigned flushed = 0;
+    for (int i = 0; i < numEntries; i++) {
+        flushed += (tags[i] != invalidTag);
+        tags[i] = invalidTag;
+    }
+    for (int set = 0; set < numSets; set++) {
+        filledWays[set] = 0;
+    }
+    return flushed;
+}
+
+MultiPageTLBMemory::MultiPageTLBMemory(const int entries[NumGPUPageSizes],
+                                       int associativity,
+                                       Enums::TLBReplacementPolicy policy)
+{
+    assert(entries[GPUPage4KB] > 0);
+    memories[GPUPage4KB] = new TLBMemory(entries[GPUPage4KB], associativity,
+                                         policy, gpuPageLogBytes[GPUPage4KB]);
+    for (int size = GPUPage4KB + 1; size < NumGPUPageSizes; size++) {
+        if (entries[size] > 0) {
+            memories[size] = new TLBMemory(entries[size], 0, policy,
+                                           gpuPageLogBytes[size]);
+        } else {
+            memories[size] = NULL;
+        }
+    }
+}
+
+MultiPageTLBMemory::MultiPageTLBMemory()
+{
+    for (int size = 0; size < NumGPUPageSizes; size++) {
+        memories[size] = new InfiniteTLBMemory();
+    }
+}
+
+MultiPageTLBMemory::~MultiPageTLBMemory()
+{
+    for (int size = 0; size < NumGPUPageSizes; size++) {
+        if (memories[size]) {
+            delete memories[size];
+        }
+    }
+}
+
+bool
+MultiPageTLBMemory::lookup(Addr vaddr, GPUAsid asid, Addr& paddr,
+                           GPUPageSize& size, bool set_mru)
+{
+    // A page may only be mapped at a single size, so at most one memory hits
+    for (int s = NumGPUPageSizes - 1; s >= 0; s--) {
+        if (!memories[s]) {
+            continue;
+        }
+        Addr vp_base = gpuPageBase(vaddr, (GPUPageSize)s);
+        Addr pp_base;
+        if (memories[s]->lookup(vp_base, asid, pp_base, set_mru)) {
+            paddr = pp_base + (vaddr - vp_base);
+            size = (GPUPageSize)s;
             return true;
         }
     }
-    pp_base = Addr(0);
+    paddr = Addr(0);
     return false;
 }
 
+GPUPageSize
+MultiPageTLBMemory::insert(Addr vaddr, GPUAsid asid, Addr paddr,
+                           GPUPageSize size)
+{
+    int s = size;
+    while (!memories[s]) {
+        assert(s > GPUPage4KB);
+        s--;
+    }
+    GPUPageSize fill_size = (GPUPageSize)s;
+    memories[s]->insert(gpuPageBase(vaddr, fill_size), asid,
+                        gpuPageBase(paddr, fill_size));
+    return fill_size;
+}
+
+unsigned
+MultiPageTLBMemory::demapPage(Addr vaddr, GPUAsid asid)
+{
+    unsigned demapped = 0;
+    for (int s = 0; s < NumGPUPageSizes; s++) {
+        if (memories[s]) {
+            demapped += memories[s]->demapPage(
+                gpuPageBase(vaddr, (GPUPageSize)s), asid);
+        }
+    }
+    return demapped;
+}
+
+unsigned
+MultiPageTLBMemory::flushAsid(GPUAsid asid)
+{
+    unsigned flushed = 0;
+    for (int s = 0; s < NumGPUPageSizes; s++) {
+        if (memories[s]) {
+            flushed += memories[s]->flushAsid(asid);
+        }
+    }
+    return flushed;
+}
+
 void
-TLBMemory::insert(Addr vp_base, Addr pp_base)
+MultiPageTLBMemory::getTranslations(
+    std::vector<GPUTranslation> &translations) const
 {
-    Addr a;
-    if (lookup(vp_base, a)) {
-        return;
+    for (int s = 0; s < NumGPUPageSizes; s++) {
+        if (memories[s]) {
+            memories[s]->getTranslations(translations, (GPUPageSize)s);
+        }
     }
-    int way = (vp_base / TheISA::PageBytes) % ways;
-    GPUTlbEntry* entry = NULL;
-    Tick minTick = curTick();
-    for (int i=0; i < sets; i++) {
-        if (entries[way][i].free) {
-            entry = &entries[way][i];
-            break;
-        } else if (entries[way][i].mruTick <= minTick) {
-            minTick = entries[way][i].mruTick;
-            entry = &entries[way][i];
+}
+
+unsigned
+MultiPageTLBMemory::flushAll()
+{
+    unsigned flushed = 0;
+    for (int s = 0; s < NumGPUPageSizes; s++) {
+        if (memories[s]) {
+            flushed += memories[s]->flushAll();
         }
     }
-    assert(entry);
-    if (!entry->free) {
-        DPRINTF(ShaderTLB, "Evicting entry for vp %#x\n", entry->vpBase);
+    return flushed;
+}
+
+TLBReplacementPolicy *
+TLBReplacementPolicy::create(Enums::TLBReplacementPolicy policy,
+                             unsigned num_sets, unsigned assoc)
+{
+    switch (policy) {
+      case Enums::LRU:
+        return new LRUTLBPolicy(num_sets, assoc);
+      case Enums::TreePLRU:
+        return new TreePLRUTLBPolicy(num_sets, assoc);
+      case Enums::NRU:
+        return new NRUTLBPolicy(num_sets, assoc);
+      default:
+        panic("Unknown TLB replacement policy: %d\n", policy);
     }
+    return NULL;
+}
 
-    entry->vpBase = vp_base;
-    entry->ppBase = pp_base;
-    entry->free = false;
-    entry->setMRU();
+LRUTLBPolicy::LRUTLBPolicy(unsigned num_sets, unsigned _assoc) :
+    TLBReplacementPolicy(num_sets, _assoc), ages(num_sets * _assoc)
+{
+    if (assoc > (1 << 16)) {
+        fatal("LRU TLB replacement supports at most 65536 ways (got %d)\n",
+              assoc);
+    }
+    // Ages within a set are always a permutation of 0..assoc-1, 0 being MRU
+    for (unsigned set = 0; set < numSets; set++) {
+        for (unsigned way = 0; way < assoc; way++) {
+            ages[set * assoc + way] = way;
+        }
+    }
+}
+
+void
+LRUTLBPolicy::touch(unsigned set, unsigned way)
+{
+    uint16_t *set_ages = &ages[set * assoc];
+    uint16_t touched_age = set_ages[way];
+    for (unsigned i = 0; i < assoc; i++) {
+        set_ages[i] += (set_ages[i] < touched_age) ? 1 : 0;
+    }
+    set_ages[way] = 0;
+}
+
+unsigned
+LRUTLBPolicy::victim(unsigned set)
+{
+    uint16_t *set_ages = &ages[set * assoc];
+    unsigned lru_way = 0;
+    for (unsigned i = 1; i < assoc; i++) {
+        if (set_ages[i] > set_ages[lru_way]) {
+            lru_way = i;
+        }
+    }
+    return lru_way;
+}
+
+void
+LRUTLBPolicy::recencyOrder(unsigned set, std::vector<unsigned> &ways) const
+{
+    // Ages are a permutation of 0..assoc-1, so place each way by its age
+    const uint16_t *set_ages = &ages[set * assoc];
+    unsigned first = ways.size();
+    ways.resize(first + assoc);
+    for (unsigned i = 0; i < assoc; i++) {
+        ways[first + assoc - 1 - set_ages[i]] = i;
+    }
+}
+
+TreePLRUTLBPolicy::TreePLRUTLBPolicy(unsigned num_sets, unsigned _assoc) :
+    TLBReplacementPolicy(num_sets, _assoc), levels(0),
+    treeBits(num_sets * _assoc, 0)
+{
+    if (!isPowerOf2(assoc)) {
+        fatal("Tree pseudo-LRU TLB replacement requires a power of 2 "
+              "associativity (got %d)\n", assoc);
+    }
+    levels = floorLog2(assoc);
+}
+
+void
+TreePLRUTLBPolicy::touch(unsigned set, unsigned way)
+{
+    // Walk from the root to the leaf of the touched way, pointing each node
+    // on the path away from it. Node n has children 2n+1 and 2n+2.
+    uint8_t *set_bits = &treeBits[set * assoc];
+    unsigned node = 0;
+    for (int level = levels - 1; level >= 0; level--) {
+        unsigned dir = (way >> level) & 1;
+        set_bits[node] = !dir;
+        node = 2 * node + 1 + dir;
+    }
+}
+
+unsigned
+TreePLRUTLBPolicy::victim(unsigned set)
+{
+    uint8_t *set_bits = &treeBits[set * assoc];
+    unsigned node = 0;
+    unsigned way = 0;
+    for (unsigned level = 0; level < levels; level++) {
+        unsigned dir = set_bits[node];
+        way = (way << 1) | dir;
+        node = 2 * node + 1 + dir;
+    }
+    return way;
+}
+
+void
+TreePLRUTLBPolicy::recencyOrder(unsigned set,
+                                std::vector<unsigned> &ways) const
+{
+    // Repeatedly take the victim of a copy of the tree and touch it. Each
+    // touch points the path away from the ways taken so far, so every way
+    // is taken once, in the order the tree would evict them.
+    TreePLRUTLBPolicy order(1, assoc);
+    std::copy(treeBits.begin() + set * assoc,
+              treeBits.begin() + (set + 1) * assoc, order.treeBits.begin());
+    for (unsigned i = 0; i < assoc; i++) {
+        unsigned way = order.victim(0);
+        ways.push_back(way);
+        order.touch(0, way);
+    }
+}
+
+NRUTLBPolicy::NRUTLBPolicy(unsigned num_sets, unsigned _assoc) :
+    TLBReplacementPolicy(num_sets, _assoc), referenced(num_sets * _assoc, 0)
+{
+}
+
+void
+NRUTLBPolicy::touch(unsigned set, unsigned way)
+{
+    uint8_t *set_refs = &referenced[set * assoc];
+    set_refs[way] = 1;
+    // When every way has been referenced, start a new epoch so there is
+    // always a not-recently-used way to evict
+    bool all_referenced = true;
+    for (unsigned i = 0; i < assoc; i++) {
+        all_referenced &= (set_refs[i] != 0);
+    }
+    if (all_referenced) {
+        for (unsigned i = 0; i < assoc; i++) {
+            set_refs[i] = (i == way);
+        }
+    }
+}
+
+unsigned
+NRUTLBPolicy::victim(unsigned set)
+{
+    uint8_t *set_refs = &referenced[set * assoc];
+    for (unsigned i = 0; i < assoc; i++) {
+        if (!set_refs[i]) {
+            return i;
+        }
+    }
+    // Only reachable with a direct-mapped TLB
+    assert(assoc == 1);
+    return 0;
+}
+
+void
+NRUTLBPolicy::recencyOrder(unsigned set, std::vector<unsigned> &ways) const
+{
+    // Not-recently-used ways before recently used ones
+    const uint8_t *set_refs = &referenced[set * assoc];
+    for (unsigned i = 0; i < assoc; i++) {
+        if (!set_refs[i]) {
+            ways.push_back(i);
+        }
+    }
+    for (unsigned i = 0; i < assoc; i++) {
+        if (set_refs[i]) {
+            ways.push_back(i);
+        }
+    }
 }
 
 void
@@ -236,6 +951,57 @@ ShaderTLB::regStats()
         ;
 
     hitRate = hits / (hits + misses);
+
+    hitsByPageSize
+        .init(NumGPUPageSizes)
+        .name(name()+".hitsByPageSize")
+        .desc("Number of hits in this TLB by page size")
+        ;
+    missesByPageSize
+        .init(NumGPUPageSizes)
+        .name(name()+".missesByPageSize")
+        .desc("Number of misses in this TLB by size of the page that "
+              "satisfied them (faulting misses are not counted)")
+        ;
+    for (int size = 0; size < NumGPUPageSizes; size++) {
+        hitsByPageSize.subname(size, gpuPageSizeNames[size]);
+        missesByPageSize.subname(size, gpuPageSizeNames[size]);
+    }
+
+    mshrMerges
+        .name(name()+".mshrMerges")
+        .desc("Number of misses merged into an outstanding MSHR")
+        ;
+    mshrFullStalls
+        .name(name()+".mshrFullStalls")
+        .desc("Number of misses stalled waiting for an MSHR or MSHR target")
+        ;
+
+    directSegmentHits
+        .name(name()+".directSegmentHits")
+        .desc("Translations done by the GPU direct segment")
+        ;
+
+    translationCacheHits
+        .name(name()+".translationCacheHits")
+        .desc("GPU page table translations found in the translation cache")
+        ;
+
+    translationCacheMisses
+        .name(name()+".translationCacheMisses")
+        .desc("GPU page table translations missing in the translation cache")
+        ;
+
+    lookupPortStalls
+        .name(name()+".lookupPortStalls")
+        .desc("Lookups delayed because all lookup ports were in use")
+        ;
+
+    lookupsPerCycle
+        .name(name()+".lookupsPerCycle")
+        .desc("Number of lookups started per cycle with any lookup")
+        .init(8)
+        ;
 }
 
 ShaderTLB *
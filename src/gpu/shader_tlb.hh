@@ -29,92 +29,307 @@
 #ifndef SHADER_TLB_HH_
 #define SHADER_TLB_HH_
 
-#include <map>
+#include <queue>
 #include <set>
+#include <vector>
 
+#include "arch/isa_traits.hh"
 #include "base/statistics.hh"
+#include "enums/TLBReplacementPolicy.hh"
+#include "gpu/addr_hash_table.hh"
 #include "params/ShaderTLB.hh"
+#include "sim/eventq.hh"
 #include "arch/generic/tlb.hh"
 
+class ClusterTLB;
 class ShaderMMU;
 class CudaGPU;
 
-class GPUTlbEntry {
-public:
+/// Page sizes that can be mapped by GPU translations
+enum GPUPageSize {
+    GPUPage4KB,
+    GPUPage2MB,
+    GPUPage1GB,
+    NumGPUPageSizes
+};
+
+/// log2 of the number of bytes in each of the GPUPageSizes
+extern const unsigned gpuPageLogBytes[NumGPUPageSizes];
+/// Stat subnames for each of the GPUPageSizes
+extern const char *gpuPageSizeNames[NumGPUPageSizes];
+
+inline Addr
+gpuPageBytes(GPUPageSize size)
+{
+    return ULL(1) << gpuPageLogBytes[size];
+}
+
+inline Addr
+gpuPageBase(Addr addr, GPUPageSize size)
+{
+    return addr & ~(gpuPageBytes(size) - 1);
+}
+
+/// GPU address space identifier. ASIDs are 12 bits wide, like x86 PCIDs, so
+/// an ASID fits in the page offset bits of any page base address.
+typedef uint16_t GPUAsid;
+const unsigned NumGPUAsids = 1 << 12;
+
+/// A page base address tagged with the address space it belongs to
+inline Addr
+asidTaggedPage(Addr vp_base, GPUAsid asid)
+{
+    assert(asid < NumGPUAsids);
+    return vp_base | asid;
+}
+
+inline GPUAsid
+taggedPageAsid(Addr tagged_page)
+{
+    return tagged_page & (NumGPUAsids - 1);
+}
+
+inline Addr
+taggedPageBase(Addr tagged_page)
+{
+    return tagged_page & ~(Addr)(NumGPUAsids - 1);
+}
+
+/// A translation held in a TLB, as saved to and restored from checkpoints
+struct GPUTranslation {
     Addr vpBase;
+    GPUAsid asid;
     Addr ppBase;
-    bool free;
-    Tick mruTick;
-    uint32_t hits;
-    GPUTlbEntry() : vpBase(0), ppBase(0), free(true), mruTick(0), hits(0) {}
-    void setMRU() { mruTick = curTick(); }
+    GPUPageSize size;
 };
 
 class BaseTLBMemory {
 public:
-    virtual bool lookup(Addr vp_base, Addr& pp_base, bool set_mru=true) = 0;
-    virtual void insert(Addr vp_base, Addr pp_base) = 0;
+    virtual ~BaseTLBMemory() {}
+    virtual bool lookup(Addr vp_base, GPUAsid asid, Addr& pp_base,
+                        bool set_mru=true) = 0;
+    virtual void insert(Addr vp_base, GPUAsid asid, Addr pp_base) = 0;
+    /// Invalidate the translation of a page, returning whether it was held
+    virtual bool demapPage(Addr vp_base, GPUAsid asid) = 0;
+    /// Invalidate all translations of an address space, returning how many
+    virtual unsigned flushAsid(GPUAsid asid) = 0;
+    /// Invalidate all translations, returning how many
+    virtual unsigned flushAll() = 0;
+    /// Append all held translations, which map pages of the given size, from
+    /// least to most recently used so inserting them in order restores
+    /// their recency
+    virtual void getTranslations(std::vector<GPUTranslation> &translations,
+                                 GPUPageSize size) const = 0;
+};
+
+/**
+ * Replacement state for the ways of a set-associative TLBMemory. Policies
+ * keep a few bits of state per way (or per set) rather than a timestamp per
+ * entry, so the replacement metadata for a set stays as compact as its tags.
+ */
+class TLBReplacementPolicy {
+protected:
+    const unsigned numSets;
+    const unsigned assoc;
+
+public:
+    TLBReplacementPolicy(unsigned num_sets, unsigned _assoc) :
+        numSets(num_sets), assoc(_assoc) {}
+    virtual ~TLBReplacementPolicy() {}
+
+    /// Update the state of a set when one of its ways is accessed or filled
+    virtual void touch(unsigned set, unsigned way) = 0;
+    /// Choose the way to evict from a set in which all ways are valid
+    virtual unsigned victim(unsigned set) = 0;
+    /// Append the ways of a set from least to most recently used, so that
+    /// touching them in this order rebuilds the set's replacement state
+    /// (approximately, for policies that do not track a total order)
+    virtual void recencyOrder(unsigned set,
+                              std::vector<unsigned> &ways) const = 0;
+
+    static TLBReplacementPolicy *create(Enums::TLBReplacementPolicy policy,
+                                        unsigned num_sets, unsigned assoc);
 };
 
+/// True LRU using an age per way, from 0 (MRU) to assoc-1 (LRU). Ages are
+/// held in 16 bits, so fully associative memories of up to 64K entries work.
+class LRUTLBPolicy : public TLBReplacementPolicy {
+    std::vector<uint16_t> ages;
+
+public:
+    LRUTLBPolicy(unsigned num_sets, unsigned _assoc);
+    void touch(unsigned set, unsigned way);
+    unsigned victim(unsigned set);
+    void recencyOrder(unsigned set, std::vector<unsigned> &ways) const;
+};
+
+/// Tree pseudo-LRU using assoc-1 bits per set. Requires power of 2 assoc.
+class TreePLRUTLBPolicy : public TLBReplacementPolicy {
+    unsigned levels;
+    std::vector<uint8_t> treeBits;
+
+public:
+    TreePLRUTLBPolicy(unsigned num_sets, unsigned _assoc);
+    void touch(unsigned set, unsigned way);
+    unsigned victim(unsigned set);
+    void recencyOrder(unsigned set, std::vector<unsigned> &ways) const;
+};
+
+/// Not-recently-used using a single reference bit per way
+class NRUTLBPolicy : public TLBReplacementPolicy {
+    std::vector<uint8_t> referenced;
+
+public:
+    NRUTLBPolicy(unsigned num_sets, unsigned _assoc);
+    void touch(unsigned set, unsigned way);
+    unsigned victim(unsigned set);
+    void recencyOrder(unsigned set, std::vector<unsigned> &ways) const;
+};
+
+/**
+ * A set-associative TLB array. Tags and physical page bases are stored in
+ * separate arrays (structure-of-arrays), with the ways of each set adjacent
+ * in memory, so a lookup compares one short, contiguous run of tags.
+ */
 class TLBMemory : public BaseTLBMemory {
     int numEntries;
-    int sets;
-    int ways;
+    int numSets;
+    int assoc;
+    unsigned logPageBytes;
+
+    // Tag value of an invalid way. Tags are ASID-tagged page bases, and the
+    // last page of the address space is never mapped for the GPU, so valid
+    // tags can never match this value.
+    static const Addr invalidTag = (Addr)-1;
 
-    GPUTlbEntry **entries;
+    // ASID-tagged page bases (see asidTaggedPage)
+    Addr *tags;
+    Addr *ppBases;
+    // Number of leading ways of each set filled since the memory was last
+    // flushed. Sets fill in way order, so the ways after these are invalid
+    // and lookups only compare the filled ways.
+    int *filledWays;
+
+    TLBReplacementPolicy *replacementPolicy;
+
+    int setIndex(Addr tag) const
+    {
+        return (tag >> logPageBytes) % numSets;
+    }
+
+    /// Return the way holding tag in the set, or -1 if not present
+    int findWay(int set, Addr tag) const;
 
 protected:
     TLBMemory() {}
 
 public:
-    TLBMemory(int _numEntries, int associativity) :
-        numEntries(_numEntries), sets(associativity)
-    {
-        if (sets == 0) {
-            sets = numEntries;
-        }
-        assert(numEntries % sets == 0);
-        ways = numEntries/sets;
-        entries = new GPUTlbEntry*[ways];
-        for (int i=0; i < ways; i++) {
-            entries[i] = new GPUTlbEntry[sets];
-        }
-    }
-    virtual ~TLBMemory()
-    {
-        for (int i=0; i < sets; i++) {
-            delete[] entries[i];
-        }
-        delete[] entries;
-    }
+    TLBMemory(int _numEntries, int associativity,
+              Enums::TLBReplacementPolicy policy = Enums::LRU,
+              unsigned log_page_bytes = TheISA::PageShift);
+    virtual ~TLBMemory();
 
-    virtual bool lookup(Addr vp_base, Addr& pp_base, bool set_mru=true);
-    virtual void insert(Addr vp_base, Addr pp_base);
+    virtual bool lookup(Addr vp_base, GPUAsid asid, Addr& pp_base,
+                        bool set_mru=true);
+    virtual void insert(Addr vp_base, GPUAsid asid, Addr pp_base);
+    virtual bool demapPage(Addr vp_base, GPUAsid asid);
+    virtual unsigned flushAsid(GPUAsid asid);
+    virtual unsigned flushAll();
+    virtual void getTranslations(std::vector<GPUTranslation> &translations,
+                                 GPUPageSize size) const;
 };
 
 class InfiniteTLBMemory : public BaseTLBMemory {
-    std::map<Addr, Addr> entries;
+    // Physical page bases keyed by ASID-tagged page base
+    AddrHashTable<Addr> entries;
 public:
     InfiniteTLBMemory() {}
     ~InfiniteTLBMemory() {}
 
-    bool lookup(Addr vp_base, Addr& pp_base, bool set_mru=true)
+    bool lookup(Addr vp_base, GPUAsid asid, Addr& pp_base, bool set_mru=true)
     {
-        auto it = entries.find(vp_base);
-        if (it != entries.end()) {
-            pp_base = it->second;
+        Addr *found = entries.find(asidTaggedPage(vp_base, asid));
+        if (found) {
+            pp_base = *found;
             return true;
         } else {
             pp_base = Addr(0);
             return false;
         }
     }
-    void insert(Addr vp_base, Addr pp_base)
+    void insert(Addr vp_base, GPUAsid asid, Addr pp_base)
+    {
+        Addr tag = asidTaggedPage(vp_base, asid);
+        Addr *found = entries.find(tag);
+        if (found) {
+            *found = pp_base;
+        } else {
+            entries.insert(tag, pp_base);
+        }
+    }
+    bool demapPage(Addr vp_base, GPUAsid asid)
+    {
+        return entries.erase(asidTaggedPage(vp_base, asid));
+    }
+    unsigned flushAsid(GPUAsid asid)
+    {
+        return entries.eraseIf([asid](Addr tag, Addr pp_base) {
+            return taggedPageAsid(tag) == asid;
+        });
+    }
+    unsigned flushAll()
+    {
+        unsigned flushed = entries.size();
+        entries.clear();
+        return flushed;
+    }
+    void getTranslations(std::vector<GPUTranslation> &translations,
+                         GPUPageSize size) const
     {
-        entries[vp_base] = pp_base;
+        entries.forEach([&translations, size](Addr tag, Addr pp_base) {
+            GPUTranslation t = { taggedPageBase(tag), taggedPageAsid(tag),
+                                 pp_base, size };
+            translations.push_back(t);
+        });
     }
 };
 
+/**
+ * TLB storage for all GPU page sizes, organized as a separate TLB memory per
+ * page size that are all probed on each lookup. A page size without its own
+ * memory is splintered: its translations are filled as the next smaller page
+ * size that has a memory (4KB pages always have one).
+ */
+class MultiPageTLBMemory {
+    BaseTLBMemory *memories[NumGPUPageSizes];
+
+public:
+    /// Finite memories with entries[size] entries per page size. 4KB pages
+    /// use the given associativity, larger pages are fully associative.
+    MultiPageTLBMemory(const int entries[NumGPUPageSizes], int associativity,
+                       Enums::TLBReplacementPolicy policy);
+    /// Infinite memories for all page sizes
+    MultiPageTLBMemory();
+    ~MultiPageTLBMemory();
+
+    /// Translate vaddr to paddr if any page size holds its page
+    bool lookup(Addr vaddr, GPUAsid asid, Addr& paddr, GPUPageSize& size,
+                bool set_mru=true);
+    /// Insert the translation vaddr->paddr for a page of the given size.
+    /// Returns the page size the translation was filled as.
+    GPUPageSize insert(Addr vaddr, GPUAsid asid, Addr paddr,
+                       GPUPageSize size);
+
+    /// Invalidate the translation of the page holding vaddr at any page
+    /// size. These return the number of translations invalidated.
+    unsigned demapPage(Addr vaddr, GPUAsid asid);
+    unsigned flushAsid(GPUAsid asid);
+    unsigned flushAll();
+
+    /// Append the translations of all page sizes
+    void getTranslations(std::vector<GPUTranslation> &translations) const;
+};
+
 class ShaderTLB : public BaseTLB
 {
 private:
@@ -126,16 +341,128 @@ private:
     CudaGPU* cudaGPU;
     bool accessHostPageTable;
 
-    BaseTLBMemory *tlbMemory;
+    // Direct-mapped cache of GPU page table translations used when not
+    // accessing the host page table. GPU page table mappings are never
+    // removed, so cached translations never go stale.
+    std::vector<Addr> translationCacheVPBases;
+    std::vector<Addr> translationCachePPBases;
+
+    MultiPageTLBMemory *tlbMemory;
 
     void translateTiming(RequestPtr req, ThreadContext *tc,
                          Translation *translation, Mode mode);
 
     ShaderMMU *mmu;
+    // TLB shared by the SMs of this cluster, if any, which misses go to
+    // before the MMU
+    ClusterTLB *clusterTLB;
+
+    /**
+     * Lookup pipeline. At most lookupPorts lookups start per cycle (of the
+     * GPU clock), and hits complete hitLatency cycles after they start.
+     * Lookups begun without a free port wait in order for one in later
+     * cycles. Callers that can stall instead should check
+     * lookupPortAvailable() first.
+     */
+    unsigned lookupPorts;
+    // Cycle in which portsUsed lookups have started
+    Cycles portCycle;
+    unsigned portsUsed;
+
+    struct PendingLookup {
+        RequestPtr req;
+        BaseTLB::Translation *translation;
+        Mode mode;
+    };
+    std::queue<PendingLookup> portQueue;
+
+    struct PendingHit {
+        RequestPtr req;
+        ThreadContext *tc;
+        BaseTLB::Translation *translation;
+        Mode mode;
+        Tick readyTick;
+    };
+    std::queue<PendingHit> hitQueue;
+
+    /// Claim a lookup port in the current cycle if one is free
+    bool claimLookupPort();
+    /// Start lookups waiting for a port
+    void startQueuedLookups();
+    /// Finish hits that have spent hitLatency in the pipeline
+    void completeHits();
+
+    EventWrapper<ShaderTLB, &ShaderTLB::startQueuedLookups> portEvent;
+    EventWrapper<ShaderTLB, &ShaderTLB::completeHits> hitEvent;
+
+    /**
+     * Miss status holding register tracking an outstanding miss to a page.
+     * The first miss to a page is sent to the MMU wrapped in the MSHR, and
+     * later misses to the same page are held here as targets, so the MMU
+     * sees a single request per page. A read MSHR does not accept write
+     * targets, since the walk only checked read permissions. MSHRs only
+     * merge misses from the same address space.
+     */
+    class TLBMissMSHR : public BaseTLB::Translation
+    {
+      public:
+        struct Target {
+            RequestPtr req;
+            BaseTLB::Translation *translation;
+            Mode mode;
+        };
+
+        ShaderTLB *tlb;
+        bool valid;
+        Addr vpBase;
+        GPUAsid asid;
+        Mode mode;
+        // Page size the miss was filled as, once the fill arrives
+        GPUPageSize fillSize;
+        std::vector<Target> targets;
+
+        TLBMissMSHR(ShaderTLB *_tlb)
+            : tlb(_tlb), valid(false), vpBase(0), asid(0),
+              mode(BaseTLB::Read), fillSize(GPUPage4KB) {}
+
+        // Targets were already marked delayed when they missed
+        void markDelayed() {}
+        void finish(const Fault &fault, RequestPtr req, ThreadContext *tc,
+                    Mode mode)
+        {
+            tlb->finishMiss(this, fault, req, tc);
+        }
+    };
+
+    /// A miss that could not get an MSHR (or MSHR target) when it occurred
+    struct StalledMiss {
+        RequestPtr req;
+        ThreadContext *tc;
+        BaseTLB::Translation *translation;
+        Mode mode;
+        GPUAsid asid;
+    };
+
+    std::vector<TLBMissMSHR*> mshrs;
+    unsigned mshrTargets;
+    unsigned activeMSHRs;
+    std::queue<StalledMiss> stalledMisses;
+
+    TLBMissMSHR *findMSHR(Addr vp_base, GPUAsid asid, Mode mode);
+    /// Merge the miss into an MSHR or allocate one and send it to the MMU.
+    /// Returns false if neither an MSHR nor an MSHR target was available.
+    bool handleMiss(RequestPtr req, ThreadContext *tc,
+                    Translation *translation, Mode mode, GPUAsid asid);
+    /// Complete all targets of the MSHR once the MMU has translated its page
+    void finishMiss(TLBMissMSHR *mshr, const Fault &fault, RequestPtr req,
+                    ThreadContext *tc);
+    /// Retry misses that stalled waiting for an MSHR, in order
+    void replayStalledMisses();
 
 public:
     typedef ShaderTLBParams Params;
     ShaderTLB(const Params *p);
+    ~ShaderTLB();
 
     // For checkpoint restore (empty unserialize)
     virtual void unserialize(CheckpointIn &cp);
@@ -143,21 +470,59 @@ public:
     void beginTranslateTiming(RequestPtr req, BaseTLB::Translation *translation,
                               BaseTLB::Mode mode);
 
+    /// Whether a lookup begun now would start this cycle
+    bool lookupPortAvailable();
+
     void finishTranslation(Fault fault, RequestPtr req, ThreadContext *tc,
                            Mode mode, Translation* origTranslation);
 
+    /// Invalidate the page holding addr in all GPU TLBs, in the address
+    /// space the GPU is running. asn is the host's and is ignored.
     void demapPage(Addr addr, uint64_t asn);
     void flushAll();
 
+    /// Selective invalidations for the ShaderMMU's shootdowns. These return
+    /// the number of TLB entries invalidated. Outstanding misses are not
+    /// squashed: the walks they wait on observe the updated page table.
+    unsigned invalidatePage(Addr vaddr, GPUAsid asid);
+    unsigned invalidateAsid(GPUAsid asid);
+    unsigned invalidateAll();
+
     void takeOverFrom(BaseTLB *_tlb) {}
 
-    void insert(Addr vp_base, Addr pp_base);
+    /// Fill a translation after a miss. Fills from the MMU also fill the
+    /// cluster TLB; fills from a cluster TLB hit pass fill_cluster = false,
+    /// as the hit has already refreshed the cluster TLB's entry.
+    void insert(Addr vaddr, GPUAsid asid, Addr paddr,
+                GPUPageSize size = GPUPage4KB, bool fill_cluster = true);
+
+    /// For checkpointing by the ShaderMMU, which saves the contents of all
+    /// L1 TLBs so they can be redistributed over a different number of SMs
+    void getTranslations(std::vector<GPUTranslation> &translations) const
+    {
+        tlbMemory->getTranslations(translations);
+    }
+    /// Restore a checkpointed translation without counting it as a fill
+    void restoreTranslation(const GPUTranslation &translation)
+    {
+        tlbMemory->insert(translation.vpBase, translation.asid,
+                          translation.ppBase, translation.size);
+    }
 
     void regStats();
 
     Stats::Scalar hits;
     Stats::Scalar misses;
     Stats::Formula hitRate;
+    Stats::Vector hitsByPageSize;
+    Stats::Vector missesByPageSize;
+    Stats::Scalar mshrMerges;
+    Stats::Scalar mshrFullStalls;
+    Stats::Scalar directSegmentHits;
+    Stats::Scalar translationCacheHits;
+    Stats::Scalar translationCacheMisses;
+    Stats::Scalar lookupPortStalls;
+    Stats::Histogram lookupsPerCycle;
 };
 
 #endif /* SHADER_TLB_HH_ */
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2013 Mark D. Hill and David A. Wood
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer;
+ * redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution;
+ * neither the name of the copyright holders nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+
+#include "arch/isa_traits.hh"
+#include "base/misc.hh"
+#include "gpu/tlb_prefetcher.hh"
+
+using namespace std;
+
+TLBPrefetcher::TLBPrefetcher(const Params *p) :
+    SimObject(p), degree(p->degree)
+{
+    if (degree == 0) {
+        fatal("%s: TLB prefetcher degree must be at least 1\n", name());
+    }
+}
+
+bool
+TLBPrefetcher::pageAtDelta(Addr vp_base, int64_t delta, Addr &pf_vp_base)
+{
+    if (delta == 0) {
+        return false;
+    }
+    pf_vp_base = vp_base + delta * (int64_t)TheISA::PageBytes;
+    // Do not prefetch pages that wrap around the address space
+    return (delta > 0) ? (pf_vp_base > vp_base) : (pf_vp_base < vp_base);
+}
+
+void
+TLBPrefetcher::regStats()
+{
+    demandMisses
+        .name(name() + ".demandMisses")
+        .desc("Number of demand L2 TLB misses seen by the prefetcher")
+        ;
+    issuedPrefetches
+        .name(name() + ".issuedPrefetches")
+        .desc("Number of prefetch walks issued")
+        ;
+    droppedPrefetches
+        .name(name() + ".droppedPrefetches")
+        .desc("Number of prefetches dropped because the queue was full")
+        ;
+    usefulPrefetches
+        .name(name() + ".usefulPrefetches")
+        .desc("Number of demand misses that hit a prefetched translation")
+        ;
+    latePrefetches
+        .name(name() + ".latePrefetches")
+        .desc("Number of demand misses that waited on a prefetch walk")
+        ;
+    accuracy
+        .name(name() + ".accuracy")
+        .desc("Fraction of issued prefetches used by a demand miss")
+        ;
+    accuracy = (usefulPrefetches + latePrefetches) / issuedPrefetches;
+    coverage
+        .name(name() + ".coverage")
+        .desc("Fraction of demand misses satisfied by a completed prefetch")
+        ;
+    coverage = usefulPrefetches / demandMisses;
+    timeliness
+        .name(name() + ".timeliness")
+        .desc("Fraction of used prefetches that completed before the demand")
+        ;
+    timeliness = usefulPrefetches / (usefulPrefetches + latePrefetches);
+}
+
+void
+NextNTLBPrefetcher::calculatePrefetches(ShaderTLB *tlb, Addr vp_base,
+                                        GPUAsid asid,
+                                        vector<Addr> &prefetches)
+{
+    Addr pf_vp_base;
+    for (int i = 1; i <= degree; i++) {
+        if (pageAtDelta(vp_base, i, pf_vp_base)) {
+            prefetches.push_back(pf_vp_base);
+        }
+    }
+}
+
+StrideTLBPrefetcher::StrideTLBPrefetcher(const Params *p) :
+    TLBPrefetcher(p), confidenceThreshold(p->confidence_threshold)
+{
+}
+
+void
+StrideTLBPrefetcher::calculatePrefetches(ShaderTLB *tlb, Addr vp_base,
+                                         GPUAsid asid,
+                                         vector<Addr> &prefetches)
+{
+    pair<ShaderTLB*, GPUAsid> key(tlb, asid);
+    map<pair<ShaderTLB*, GPUAsid>, StrideEntry>::iterator it =
+        strideTable.find(key);
+    if (it == strideTable.end()) {
+        // The first miss only gives the stride a starting point
+        StrideEntry &entry = strideTable[key];
+        entry.lastVpBase = vp_base;
+        entry.stride = 0;
+        entry.confidence = 0;
+        return;
+    }
+
+    StrideEntry &entry = it->second;
+    int64_t stride = ((int64_t)(vp_base - entry.lastVpBase)) /
+                     (int64_t)TheISA::PageBytes;
+    if (stride == 0) {
+        // Repeated misses to the same page say nothing about the stride
+        return;
+    }
+    if (stride == entry.stride) {
+        if (entry.confidence < confidenceThreshold) {
+            entry.confidence++;
+        }
+    } else {
+        entry.stride = stride;
+        entry.confidence = 0;
+    }
+    entry.lastVpBase = vp_base;
+
+    if (entry.confidence < confidenceThreshold) {
+        return;
+    }
+    Addr pf_vp_base;
+    for (int i = 1; i <= degree; i++) {
+        if (pageAtDelta(vp_base, i * stride, pf_vp_base)) {
+            prefetches.push_back(pf_vp_base);
+        }
+    }
+}
+
+DistanceTLBPrefetcher::DistanceTLBPrefetcher(const Params *p) :
+    TLBPrefetcher(p), distanceTable(p->table_entries)
+{
+    if (distanceTable.empty()) {
+        fatal("%s: Distance prefetcher needs at least one table entry\n",
+              name());
+    }
+    for (int i = 0; i < distanceTable.size(); i++) {
+        distanceTable[i].valid = false;
+        distanceTable[i].asid = 0;
+        distanceTable[i].distance = 0;
+        distanceTable[i].next.reserve(degree);
+    }
+}
+
+DistanceTLBPrefetcher::DistanceEntry *
+DistanceTLBPrefetcher::findEntry(GPUAsid asid, int64_t distance,
+                                 bool allocate)
+{
+    DistanceEntry &entry = distanceTable[((uint64_t)distance ^ asid) %
+                                         distanceTable.size()];
+    if (entry.valid && entry.asid == asid && entry.distance == distance) {
+        return &entry;
+    }
+    if (!allocate) {
+        return NULL;
+    }
+    entry.valid = true;
+    entry.asid = asid;
+    entry.distance = distance;
+    entry.next.clear();
+    return &entry;
+}
+
+void
+DistanceTLBPrefetcher::calculatePrefetches(ShaderTLB *tlb, Addr vp_base,
+                                           GPUAsid asid,
+                                           vector<Addr> &prefetches)
+{
+    map<GPUAsid, MissHistory>::iterator it = missHistories.find(asid);
+    if (it == missHistories.end()) {
+        // There is no distance until the address space's second miss
+        MissHistory &history = missHistories[asid];
+        history.lastVpBase = vp_base;
+        history.lastDistance = 0;
+        history.haveLastDistance = false;
+        return;
+    }
+
+    MissHistory &history = it->second;
+    if (vp_base == history.lastVpBase) {
+        return;
+    }
+    int64_t distance = ((int64_t)(vp_base - history.lastVpBase)) /
+                       (int64_t)TheISA::PageBytes;
+    history.lastVpBase = vp_base;
+
+    // Record that this distance followed the previous one
+    if (history.haveLastDistance) {
+        DistanceEntry *prev = findEntry(asid, history.lastDistance, true);
+        vector<int64_t>::iterator next_it =
+            find(prev->next.begin(), prev->next.end(), distance);
+        if (next_it != prev->next.end()) {
+            prev->next.erase(next_it);
+        } else if (prev->next.size() == degree) {
+            prev->next.pop_back();
+        }
+        prev->next.insert(prev->next.begin(), distance);
+    }
+    history.lastDistance = distance;
+    history.haveLastDistance = true;
+
+    DistanceEntry *entry = findEntry(asid, distance, false);
+    if (!entry) {
+        return;
+    }
+    Addr pf_vp_base;
+    for (int i = 0; i < entry->next.size(); i++) {
+        if (pageAtDelta(vp_base, entry->next[i], pf_vp_base)) {
+            prefetches.push_back(pf_vp_base);
+        }
+    }
+}
+
+NextNTLBPrefetcher *
+NextNTLBPrefetcherParams::create()
+{
+    return new NextNTLBPrefetcher(this);
+}
+
+StrideTLBPrefetcher *
+StrideTLBPrefetcherParams::create()
+{
+    return new StrideTLBPrefetcher(this);
+}
+
+DistanceTLBPrefetcher *
+DistanceTLBPrefetcherParams::create()
+{
+    return new DistanceTLBPrefetcher(this);
+}
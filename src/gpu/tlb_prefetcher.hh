@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2013 Mark D. Hill and David A. Wood
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer;
+ * redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution;
+ * neither the name of the copyright holders nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TLB_PREFETCHER_HH_
+#define TLB_PREFETCHER_HH_
+
+#include <map>
+#include <vector>
+
+#include "base/statistics.hh"
+#include "base/types.hh"
+#include "gpu/shader_tlb.hh"
+#include "params/DistanceTLBPrefetcher.hh"
+#include "params/NextNTLBPrefetcher.hh"
+#include "params/StrideTLBPrefetcher.hh"
+#include "params/TLBPrefetcher.hh"
+#include "sim/sim_object.hh"
+
+/**
+ * Base class for translation prefetchers in the ShaderMMU. The MMU notifies
+ * the prefetcher of each demand request that misses in the L2 TLB, and the
+ * prefetcher responds with the virtual page bases to prefetch in the same
+ * address space. Prefetchers train separately on each address space. The MMU
+ * filters and schedules the prefetch walks, and reports back on their use
+ * for the accuracy, coverage and timeliness statistics.
+ */
+class TLBPrefetcher : public SimObject
+{
+  protected:
+    // Maximum number of pages to prefetch per demand miss
+    unsigned degree;
+
+    /// Append the 4KB page bases to prefetch after a demand miss to
+    /// vp_base in address space asid from the L1 TLB tlb
+    virtual void calculatePrefetches(ShaderTLB *tlb, Addr vp_base,
+                                     GPUAsid asid,
+                                     std::vector<Addr> &prefetches) = 0;
+
+    /// The page delta pages away from vp_base, or false if it wraps
+    static bool pageAtDelta(Addr vp_base, int64_t delta, Addr &pf_vp_base);
+
+  public:
+    typedef TLBPrefetcherParams Params;
+    TLBPrefetcher(const Params *p);
+
+    void notify(ShaderTLB *tlb, Addr vp_base, GPUAsid asid,
+                std::vector<Addr> &prefetches)
+    {
+        demandMisses++;
+        calculatePrefetches(tlb, vp_base, asid, prefetches);
+    }
+
+    // Feedback from the MMU on prefetches
+    void prefetchIssued() { issuedPrefetches++; }
+    void prefetchDropped() { droppedPrefetches++; }
+    /// A demand miss hit a completed prefetch in the prefetch buffer
+    void prefetchUseful() { usefulPrefetches++; }
+    /// A demand miss found the walk for its page prefetch still in flight
+    void prefetchLate() { latePrefetches++; }
+
+    void regStats();
+
+    Stats::Scalar demandMisses;
+    Stats::Scalar issuedPrefetches;
+    Stats::Scalar droppedPrefetches;
+    Stats::Scalar usefulPrefetches;
+    Stats::Scalar latePrefetches;
+    Stats::Formula accuracy;
+    Stats::Formula coverage;
+    Stats::Formula timeliness;
+};
+
+/**
+ * Prefetch the degree pages following each demand miss.
+ */
+class NextNTLBPrefetcher : public TLBPrefetcher
+{
+  protected:
+    void calculatePrefetches(ShaderTLB *tlb, Addr vp_base, GPUAsid asid,
+                             std::vector<Addr> &prefetches);
+
+  public:
+    typedef NextNTLBPrefetcherParams Params;
+    NextNTLBPrefetcher(const Params *p) : TLBPrefetcher(p) {}
+};
+
+/**
+ * Detect a constant page stride in the miss stream of each L1 TLB (i.e. each
+ * SM) in each address space, and prefetch the next degree pages along it
+ * once the stride has been seen confidenceThreshold times in a row.
+ */
+class StrideTLBPrefetcher : public TLBPrefetcher
+{
+  private:
+    struct StrideEntry {
+        Addr lastVpBase;
+        int64_t stride;
+        unsigned confidence;
+    };
+
+    // Created on the first miss of each L1 TLB in each address space
+    std::map<std::pair<ShaderTLB*, GPUAsid>, StrideEntry> strideTable;
+    unsigned confidenceThreshold;
+
+  protected:
+    void calculatePrefetches(ShaderTLB *tlb, Addr vp_base, GPUAsid asid,
+                             std::vector<Addr> &prefetches);
+
+  public:
+    typedef StrideTLBPrefetcherParams Params;
+    StrideTLBPrefetcher(const Params *p);
+};
+
+/**
+ * Distance prefetching (Kandiraju and Sivasubramaniam, ISCA 2002). Tracks
+ * the delta between consecutive missing pages of each address space across
+ * all SMs, and learns which deltas tend to follow each delta. On a miss, the
+ * deltas that followed the current delta last time are prefetched. The
+ * table is direct mapped by address space and delta, and holds degree
+ * successor deltas per entry.
+ */
+class DistanceTLBPrefetcher : public TLBPrefetcher
+{
+  private:
+    struct DistanceEntry {
+        bool valid;
+        GPUAsid asid;
+        int64_t distance;
+        // Successor distances, most recent first
+        std::vector<int64_t> next;
+    };
+
+    std::vector<DistanceEntry> distanceTable;
+
+    // The miss history of an address space, created on its first miss
+    struct MissHistory {
+        Addr lastVpBase;
+        int64_t lastDistance;
+        bool haveLastDistance;
+    };
+    std::map<GPUAsid, MissHistory> missHistories;
+
+    DistanceEntry *findEntry(GPUAsid asid, int64_t distance, bool allocate);
+
+  protected:
+    void calculatePrefetches(ShaderTLB *tlb, Addr vp_base, GPUAsid asid,
+                             std::vector<Addr> &prefetches);
+
+  public:
+    typedef DistanceTLBPrefetcherParams Params;
+    DistanceTLBPrefetcher(const Params *p);
+};
+
+#endif // TLB_PREFETCHER_HH_
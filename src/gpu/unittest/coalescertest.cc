@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) 2013 Mark D. Hill and David A. Wood
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer;
+ * redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution;
+ * neither the name of the copyright holders nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Tests of WarpInstBuffer coalescing. Warp instructions are built from lane
+ * addresses, coalesced, and the accesses generated (address, size and
+ * lanes, in order) are compared against the expected accesses.
+ *
+ * With Fermi rules, random loads and stores are also checked against the
+ * coalescer that the bitmask-based WarpInstBuffer::coalesce() replaced,
+ * reproduced below as baselineCoalesce(). The two must generate exactly the
+ * same accesses.
+ *
+ * Stores are split into contiguous chunks within each block. A lane's word
+ * joins the chunk of the previous word (in offset order) only if it is the
+ * same word or starts right after it; partially overlapping words start a
+ * new chunk.
+ */
+
+#include <bitset>
+#include <cstdio>
+#include <list>
+#include <map>
+#include <vector>
+
+#include "gpu/lsq_warp_inst_buffer.hh"
+#include "sim/eventq.hh"
+
+namespace {
+
+typedef WarpInstBuffer::LaneMask LaneMask;
+
+const unsigned laneCount = 32;
+const unsigned lineBytes = 128;
+const unsigned sectorBytes = 32;
+const Addr base = 0x10000;
+
+/// Lane address of a lane that does not take part in the instruction
+const Addr inactive = (Addr)-1;
+
+struct Access {
+    Addr addr;
+    unsigned size;
+    LaneMask lanes;
+};
+
+/// Coalesce a load or store of data_size bytes per lane from the lanes with
+/// addresses in lane_addrs, returning the accesses generated
+std::vector<Access>
+coalesceInst(CoalescedAccessPools &pools, Enums::CoalescingRules rules,
+             bool store, unsigned data_size,
+             const std::vector<Addr> &lane_addrs, unsigned warp_parts = 1)
+{
+    WarpInstBuffer inst(laneCount, 1, lineBytes, sectorBytes, rules, &pools,
+                        warp_parts);
+    std::vector<PacketPtr> lane_pkts(laneCount, (PacketPtr)NULL);
+    bool first = true;
+    for (unsigned lane = 0; lane < lane_addrs.size(); lane++) {
+        if (lane_addrs[lane] == inactive) {
+            continue;
+        }
+        Request::Flags flags;
+        RequestPtr req = new Request(0, lane_addrs[lane], data_size, flags,
+                                     0, 0, 0, 0);
+        PacketPtr pkt = new Packet(req, store ? MemCmd::WriteReq :
+                                                MemCmd::ReadReq);
+        uint8_t *data = new uint8_t[data_size];
+        for (unsigned b = 0; b < data_size; b++) {
+            data[b] = lane;
+        }
+        pkt->dataDynamic(data);
+        if (first) {
+            inst.initializeInstBuffer(pkt);
+            first = false;
+        }
+        inst.addLaneRequest(lane, pkt);
+        lane_pkts[lane] = pkt;
+    }
+    inst.coalesceMemRequests();
+
+    std::vector<Access> accesses;
+    std::vector<WarpInstBuffer::CoalescedAccess*> coalesced;
+    for (WarpInstBuffer::CoalescedAccess *access =
+             inst.getCoalescedAccesses();
+         access; access = access->coalescedNext) {
+        coalesced.push_back(access);
+    }
+    assert(coalesced.size() == inst.coalescedAccessesSize());
+    for (int i = 0; i < coalesced.size(); i++) {
+        WarpInstBuffer::CoalescedAccess *access = coalesced[i];
+        Access a = { access->req->getVaddr(), access->getSize(),
+                     *access->getActiveLanes() };
+        accesses.push_back(a);
+        if (store) {
+            access->moveDataToPacket();
+        } else {
+            access->allocateData();
+        }
+        inst.removeCoalesced(access);
+        inst.setTranslated(access);
+    }
+    // Completing the accesses frees the stores' lane packets
+    for (int i = 0; i < coalesced.size(); i++) {
+        inst.finishAccess(coalesced[i]);
+    }
+    inst.resetState();
+    if (!store) {
+        for (unsigned lane = 0; lane < laneCount; lane++) {
+            if (lane_pkts[lane]) {
+                delete lane_pkts[lane]->req;
+                delete lane_pkts[lane];
+            }
+        }
+    }
+    return accesses;
+}
+
+bool
+checkAccesses(const char *test, const std::vector<Access> &actual,
+              const std::vector<Access> &expected)
+{
+    bool match = (actual.size() == expected.size());
+    for (int i = 0; match && i < actual.size(); i++) {
+        match = actual[i].addr == expected[i].addr &&
+                actual[i].size == expected[i].size &&
+                actual[i].lanes == expected[i].lanes;
+    }
+    printf("%-48s %s\n", test, match ? "passed" : "FAILED");
+    if (!match) {
+        for (int i = 0; i < expected.size(); i++) {
+            printf("  expected %#llx size %u lanes %#llx\n",
+                   (unsigned long long)expected[i].addr, expected[i].size,
+                   (unsigned long long)expected[i].lanes);
+        }
+        for (int i = 0; i < actual.size(); i++) {
+            printf("  actual   %#llx size %u lanes %#llx\n",
+                   (unsigned long long)actual[i].addr, actual[i].size,
+                   (unsigned long long)actual[i].lanes);
+        }
+    }
+    return match;
+}
+
+/// Store data_size bytes from each lane with an address in lane_addrs, and
+/// check the chunks (address, size, lanes) the block is split into
+bool
+checkStore(CoalescedAccessPools &pools, const char *test,
+           unsigned data_size, const std::vector<Addr> &lane_addrs,
+           const std::vector<Access> &expected)
+{
+    return checkAccesses(test, coalesceInst(pools, Enums::Fermi, true,
+                                            data_size, lane_addrs),
+                         expected);
+}
+
+bool
+testStoreMerging(CoalescedAccessPools &pools)
+{
+    bool passed = true;
+    {
+        std::vector<Addr> lanes = { base, base + 4, base + 8, base + 12 };
+        passed &= checkStore(pools, "stores: adjacent words merge", 4,
+                             lanes, { { base, 16, 0xf } });
+    }
+    {
+        std::vector<Addr> lanes = { base + 4, base, base + 4, base + 8 };
+        passed &= checkStore(pools, "stores: identical words merge", 4,
+                             lanes, { { base, 12, 0xf } });
+    }
+    {
+        // Out of lane order, with a gap
+        std::vector<Addr> lanes = { base + 12, base, base + 4, inactive,
+                                    base + 16 };
+        passed &= checkStore(pools, "stores: gap splits chunks", 4, lanes,
+                             { { base, 8, 0x6 }, { base + 12, 8, 0x11 } });
+    }
+    {
+        // Unaligned 8 byte words overlapping by half
+        std::vector<Addr> lanes = { base, base + 4, base + 12 };
+        passed &= checkStore(pools, "stores: partial overlap splits chunks",
+                             8, lanes,
+                             { { base, 8, 0x1 }, { base + 4, 16, 0x6 } });
+    }
+    {
+        // A word identical to one overlapping the previous word still joins
+        // the overlapping word's chunk
+        std::vector<Addr> lanes = { base, base + 2, base + 2, base + 6 };
+        passed &= checkStore(pools, "stores: overlap then identical", 4,
+                             lanes,
+                             { { base, 4, 0x1 }, { base + 2, 8, 0xe } });
+    }
+    return passed;
+}
+
+/// The lanes and 32-byte chunks of a segment accessed by a subwarp
+struct BaselineTransaction {
+    std::bitset<4> chunks;
+    std::list<unsigned> activeLanes;
+};
+
+/// The list-and-map based coalescer, with the Fermi rules for 32 lanes,
+/// 128-byte lines and 32-byte sectors, as it was before coalesce() was
+/// rewritten to use lane bitmasks. Lanes may not cross a sector boundary.
+std::vector<Access>
+baselineCoalesce(bool store, unsigned data_size,
+                 const std::vector<Addr> &lane_addrs, unsigned warp_parts)
+{
+    std::vector<Access> accesses;
+    unsigned segment_size = 0;
+    switch (data_size) {
+      case 1: segment_size = 32; break;
+      case 2: segment_size = 64; break;
+      case 4: case 8: case 16: segment_size = 128; break;
+    }
+    unsigned subwarp_size = laneCount / warp_parts;
+
+    for (unsigned subwarp = 0; subwarp < warp_parts; subwarp++) {
+        std::map<Addr, BaselineTransaction> subwarp_transactions;
+
+        // Step 1: Find all transactions generated by this subwarp
+        for (unsigned thread = subwarp * subwarp_size;
+             thread < subwarp_size * (subwarp + 1); thread++) {
+            if (thread >= lane_addrs.size() || lane_addrs[thread] == inactive)
+                continue;
+            Addr addr = lane_addrs[thread];
+            Addr block_address = addr & ~((Addr)(segment_size - 1));
+            unsigned chunk = (addr & 127) / 32;
+            BaselineTransaction &info = subwarp_transactions[block_address];
+            assert(block_address == ((addr + data_size - 1) &
+                   ~((Addr)(segment_size - 1))));
+            info.chunks.set(chunk);
+            info.activeLanes.push_back(thread);
+        }
+
+        // Step 2: Reduce each transaction size, if possible
+        std::map<Addr, BaselineTransaction>::iterator t =
+            subwarp_transactions.begin();
+        for (; t != subwarp_transactions.end(); t++) {
+            Addr addr = t->first;
+            BaselineTransaction &info = t->second;
+            const std::bitset<4> &q = info.chunks;
+            std::bitset<2> h;
+
+            unsigned size = segment_size;
+            if (segment_size == 128) {
+                bool lower_half_used = q[0] || q[1];
+                bool upper_half_used = q[2] || q[3];
+                if (lower_half_used && !upper_half_used) {
+                    size = 64;
+                    if (q[0]) h.set(0);
+                    if (q[1]) h.set(1);
+                } else if (!lower_half_used && upper_half_used) {
+                    addr += 64;
+                    size = 64;
+                    if (q[2]) h.set(0);
+                    if (q[3]) h.set(1);
+                }
+            } else if (segment_size == 64) {
+                if ((addr % 128) == 0) {
+                    if (q[0]) h.set(0);
+                    if (q[1]) h.set(1);
+                } else {
+                    if (q[2]) h.set(0);
+                    if (q[3]) h.set(1);
+                }
+            }
+            if (size == 64) {
+                bool lower_half_used = h[0];
+                bool upper_half_used = h[1];
+                if (lower_half_used && !upper_half_used) {
+                    size = 32;
+                } else if (!lower_half_used && upper_half_used) {
+                    addr += 32;
+                    size = 32;
+                }
+            }
+
+            LaneMask lanes = 0;
+            std::list<unsigned>::const_iterator lane =
+                info.activeLanes.begin();
+            for (; lane != info.activeLanes.end(); lane++) {
+                lanes |= WarpInstBuffer::laneBit(*lane);
+            }
+            if (!store) {
+                Access a = { addr, size, lanes };
+                accesses.push_back(a);
+                continue;
+            }
+
+            // Writes must be contiguous. Words at the same offset as the
+            // previous word, or right after it, extend the chunk.
+            std::multimap<unsigned, unsigned> valid_words;
+            for (lane = info.activeLanes.begin();
+                 lane != info.activeLanes.end(); lane++) {
+                unsigned offset = lane_addrs[*lane] & (size - 1);
+                valid_words.insert(std::make_pair(offset, *lane));
+            }
+            std::multimap<unsigned, unsigned>::iterator it =
+                valid_words.begin();
+            while (it != valid_words.end()) {
+                Access a = { addr + it->first, data_size, 0 };
+                std::multimap<unsigned, unsigned>::iterator next(it);
+                next++;
+                do {
+                    a.lanes |= WarpInstBuffer::laneBit(it->second);
+                    if (next == valid_words.end()) {
+                        it++;
+                        break;
+                    }
+                    if (it->first + data_size == next->first) {
+                        a.size += data_size;
+                    } else if (it->first != next->first) {
+                        it++;
+                        break;
+                    }
+                    it++;
+                    next++;
+                } while (it != valid_words.end());
+                accesses.push_back(a);
+            }
+        }
+    }
+    return accesses;
+}
+
+/// A small linear congruential generator, so runs are reproducible
+struct Random {
+    uint64_t state;
+    Random(uint64_t seed) : state(seed) {}
+    unsigned next(unsigned range)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (state >> 33) % range;
+    }
+};
+
+bool
+testAgainstBaseline(CoalescedAccessPools &pools, unsigned num_insts)
+{
+    const unsigned data_sizes[] = { 1, 2, 4, 8, 16 };
+    Random random(1);
+    unsigned mismatches = 0;
+    for (unsigned i = 0; i < num_insts; i++) {
+        bool store = random.next(2);
+        unsigned data_size = data_sizes[random.next(5)];
+        unsigned warp_parts = random.next(2) ? 2 : 1;
+        // Lanes access a region of 1 to 512 words, some of them unaligned,
+        // with a varying fraction of the lanes active
+        Addr region = base + random.next(16) * 4096;
+        unsigned words = 1 << random.next(10);
+        bool unaligned = random.next(4) == 0;
+        unsigned active_percent = 10 + random.next(91);
+        std::vector<Addr> lane_addrs(laneCount, inactive);
+        unsigned num_active = 0;
+        for (unsigned lane = 0; lane < laneCount; lane++) {
+            if (random.next(100) >= active_percent) {
+                continue;
+            }
+            Addr addr = region + random.next(words) * data_size;
+            if (unaligned) {
+                addr += random.next(data_size);
+            }
+            // The baseline coalescer only marked the sector holding a lane's
+            // first byte, so its accesses could miss the end of a lane that
+            // crosses a sector, which the current one covers. Compare only
+            // lanes within one sector.
+            if (addr / sectorBytes != (addr + data_size - 1) / sectorBytes) {
+                continue;
+            }
+            lane_addrs[lane] = addr;
+            num_active++;
+        }
+        if (num_active == 0) {
+            continue;
+        }
+
+        std::vector<Access> expected =
+            baselineCoalesce(store, data_size, lane_addrs, warp_parts);
+        std::vector<Access> actual = coalesceInst(pools, Enums::Fermi, store,
+                                                  data_size, lane_addrs,
+                                                  warp_parts);
+        bool match = (actual.size() == expected.size());
+        for (int a = 0; match && a < actual.size(); a++) {
+            match = actual[a].addr == expected[a].addr &&
+                    actual[a].size == expected[a].size &&
+                    actual[a].lanes == expected[a].lanes;
+        }
+        if (!match && mismatches++ < 5) {
+            char test[64];
+            snprintf(test, sizeof(test), "baseline: %s %uB x %u part(s)",
+                     store ? "store" : "load", data_size, warp_parts);
+            checkAccesses(test, actual, expected);
+        }
+    }
+    printf("%-48s %s\n", "baseline: random loads and stores",
+           mismatches ? "FAILED" : "passed");
+    if (mismatches) {
+        printf("  %u of %u instructions differ\n", mismatches, num_insts);
+    }
+    return mismatches == 0;
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    // WarpInstBuffers record the tick of each instruction
+    curEventQueue(getEventQueue(0));
+
+    CoalescedAccessPools pools(laneCount, lineBytes, 4);
+    bool passed = testStoreMerging(pools);
+    passed &= testAgainstBaseline(pools, 100000);
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2013 Mark D. Hill and David A. Wood
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer;
+ * redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution;
+ * neither the name of the copyright holders nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Tests of LSQMSHRTable. Lines are allocated, found and released, and the
+ * table is checked against a std::map of the lines it should hold after
+ * every release. Each entry is tagged through its numMerged field, so an
+ * entry moved by release()'s backward shift deletion must keep its line
+ * and contents.
+ *
+ * The lines are scattered at random through memory, as consecutive lines
+ * rarely collide. Small tables keep many of them in few slots, so probe
+ * sequences collide, wrap around the end of the table and are shifted
+ * back on release.
+ */
+
+#include <cstdio>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "gpu/lsq_mshr_table.hh"
+
+namespace {
+
+const unsigned lineBytes = 128;
+
+struct Random {
+    uint64_t state;
+    Random(uint64_t seed) : state(seed) {}
+    unsigned next(unsigned range)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (state >> 33) % range;
+    }
+};
+
+/// Return num_lines distinct line addresses scattered through 1GB
+std::vector<Addr>
+randomLines(unsigned num_lines)
+{
+    Random random(num_lines);
+    std::set<Addr> chosen;
+    std::vector<Addr> lines;
+    while (lines.size() < num_lines) {
+        Addr line_addr = (Addr)random.next(1 << 23) * lineBytes;
+        if (chosen.insert(line_addr).second) {
+            lines.push_back(line_addr);
+        }
+    }
+    return lines;
+}
+
+/// Check that the table holds exactly the lines in expected, each with the
+/// tag it was allocated with, and none of the other lines
+bool
+checkTable(LSQMSHRTable &table, const std::map<Addr, unsigned> &expected,
+           const std::vector<Addr> &lines)
+{
+    if (table.size() != expected.size()) {
+        printf("  size %u, expected %u\n", table.size(),
+               (unsigned)expected.size());
+        return false;
+    }
+    for (unsigned line = 0; line < lines.size(); line++) {
+        Addr line_addr = lines[line];
+        LSQMSHRTable::Entry *entry = table.find(line_addr);
+        std::map<Addr, unsigned>::const_iterator it =
+            expected.find(line_addr);
+        if (it == expected.end()) {
+            if (entry) {
+                printf("  found released line %#llx\n",
+                       (unsigned long long)line_addr);
+                return false;
+            }
+            continue;
+        }
+        if (!entry || entry->lineAddr != line_addr ||
+            entry->numMerged != it->second) {
+            printf("  line %#llx %s\n", (unsigned long long)line_addr,
+                   entry ? "has the wrong contents" : "not found");
+            return false;
+        }
+    }
+    return true;
+}
+
+LSQMSHRTable::Entry *
+allocateLine(LSQMSHRTable &table, std::map<Addr, unsigned> &expected,
+             Addr line_addr, unsigned tag)
+{
+    LSQMSHRTable::Entry *entry = table.allocate(line_addr);
+    entry->numMerged = tag;
+    expected[line_addr] = tag;
+    return entry;
+}
+
+void
+releaseLine(LSQMSHRTable &table, std::map<Addr, unsigned> &expected,
+            Addr line_addr)
+{
+    table.release(table.find(line_addr));
+    expected.erase(line_addr);
+}
+
+/// Fill a table to its capacity, then release its lines from the oldest,
+/// the newest and the middle, checking the table after each release
+bool
+testFillAndDrain(unsigned capacity)
+{
+    LSQMSHRTable table(capacity, lineBytes);
+    std::map<Addr, unsigned> expected;
+    std::vector<Addr> lines = randomLines(2 * capacity);
+    bool passed = true;
+    for (unsigned line = 0; line < capacity; line++) {
+        passed &= !table.full();
+        allocateLine(table, expected, lines[line], line + 1);
+    }
+    passed &= table.full() && checkTable(table, expected, lines);
+
+    // The lines still allocated are lines[first..last]
+    unsigned first = 0;
+    unsigned last = capacity - 1;
+    for (unsigned i = 0; passed && i < capacity; i++) {
+        unsigned line;
+        if (i % 3 == 0) {
+            line = first++;
+        } else if (i % 3 == 1) {
+            line = last--;
+        } else {
+            // Release a line from the middle, and swap the first line into
+            // its place so the lines still allocated stay contiguous
+            line = first + (last - first) / 2;
+            std::swap(lines[line], lines[first]);
+            line = first++;
+        }
+        releaseLine(table, expected, lines[line]);
+        passed &= checkTable(table, expected, lines);
+    }
+    passed &= table.size() == 0 && !table.full();
+
+    char test[64];
+    snprintf(test, sizeof(test), "fill and drain: %u entries", capacity);
+    printf("%-48s %s\n", test, passed ? "passed" : "FAILED");
+    return passed;
+}
+
+/// Randomly allocate and release lines out of num_lines, checking the table
+/// after every release. With no capacity, the table grows as lines are
+/// allocated.
+bool
+testRandom(unsigned capacity, unsigned num_lines, unsigned num_ops)
+{
+    LSQMSHRTable table(capacity, lineBytes);
+    std::map<Addr, unsigned> expected;
+    std::vector<Addr> lines = randomLines(num_lines);
+    Random random(capacity + num_lines);
+    bool passed = true;
+    for (unsigned op = 1; passed && op <= num_ops; op++) {
+        Addr line_addr = lines[random.next(num_lines)];
+        if (table.find(line_addr)) {
+            releaseLine(table, expected, line_addr);
+            passed = checkTable(table, expected, lines);
+        } else if (!table.full()) {
+            allocateLine(table, expected, line_addr, op);
+        } else if (expected.size() != capacity) {
+            printf("  full with %u entries\n", (unsigned)expected.size());
+            passed = false;
+        }
+    }
+
+    char test[64];
+    snprintf(test, sizeof(test), "random: %u entries, %u lines", capacity,
+             num_lines);
+    printf("%-48s %s\n", test, passed ? "passed" : "FAILED");
+    return passed;
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    bool passed = testFillAndDrain(1);
+    passed &= testFillAndDrain(8);
+    passed &= testFillAndDrain(48);
+    passed &= testRandom(1, 4, 1000);
+    passed &= testRandom(8, 16, 100000);
+    passed &= testRandom(48, 64, 100000);
+    // No capacity, so the table grows
+    passed &= testRandom(0, 512, 100000);
+
+    return passed ? 0 : 1;
+}
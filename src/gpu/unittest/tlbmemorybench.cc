@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2013 Mark D. Hill and David A. Wood
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met: redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer;
+ * redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution;
+ * neither the name of the copyright holders nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Microbenchmark of TLBMemory lookups. The structure-of-arrays TLBMemory
+ * with pluggable replacement is compared against the array-of-structures
+ * layout with a timestamp per entry that it replaced (reproduced below as
+ * AoSTLBMemory). Both run the same stream of lookups, inserting on misses,
+ * for a few TLB geometries and working set sizes, either on a single TLB or
+ * interleaved across one TLB per SM as in the simulator. With LRU
+ * replacement the two must see exactly the same hits, which is checked; the
+ * time per access of each is reported.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "gpu/shader_tlb.hh"
+
+namespace {
+
+/// The TLBMemory layout before the structure-of-arrays rework: entries
+/// scattered across per-way arrays, each holding its own LRU timestamp
+class AoSTLBMemory
+{
+    struct Entry {
+        Addr vpBase;
+        Addr ppBase;
+        bool free;
+        uint64_t mruTick;
+        Entry() : vpBase(0), ppBase(0), free(true), mruTick(0) {}
+    };
+
+    int numSets;
+    int assoc;
+    Entry **entries;
+    uint64_t tick;
+
+  public:
+    AoSTLBMemory(int num_entries, int associativity) :
+        numSets(num_entries / associativity), assoc(associativity), tick(0)
+    {
+        entries = new Entry*[numSets];
+        for (int i = 0; i < numSets; i++) {
+            entries[i] = new Entry[assoc];
+        }
+    }
+
+    ~AoSTLBMemory()
+    {
+        for (int i = 0; i < numSets; i++) {
+            delete[] entries[i];
+        }
+        delete[] entries;
+    }
+
+    bool
+    lookup(Addr vp_base, GPUAsid asid, Addr &pp_base)
+    {
+        int set = (vp_base >> TheISA::PageShift) % numSets;
+        for (int i = 0; i < assoc; i++) {
+            if (entries[set][i].vpBase == vp_base && !entries[set][i].free) {
+                pp_base = entries[set][i].ppBase;
+                entries[set][i].mruTick = ++tick;
+                return true;
+            }
+        }
+        pp_base = Addr(0);
+        return false;
+    }
+
+    void
+    insert(Addr vp_base, GPUAsid asid, Addr pp_base)
+    {
+        int set = (vp_base >> TheISA::PageShift) % numSets;
+        Entry *entry = NULL;
+        uint64_t min_tick = ~(uint64_t)0;
+        for (int i = 0; i < assoc; i++) {
+            if (entries[set][i].free) {
+                entry = &entries[set][i];
+                break;
+            } else if (entries[set][i].mruTick <= min_tick) {
+                min_tick = entries[set][i].mruTick;
+                entry = &entries[set][i];
+            }
+        }
+        entry->vpBase = vp_base;
+        entry->ppBase = pp_base;
+        entry->free = false;
+        entry->mruTick = ++tick;
+    }
+};
+
+/// Page base addresses drawn from a working set of pages, with a skew so
+/// that some pages are much hotter than others
+std::vector<Addr>
+makeAccessStream(unsigned working_set, unsigned length, uint64_t seed)
+{
+    std::vector<Addr> stream(length);
+    uint64_t state = seed;
+    for (unsigned i = 0; i < length; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        unsigned r = state >> 33;
+        // Half of the accesses go to the first eighth of the working set
+        unsigned range = (r & 1) ? working_set : (working_set + 7) / 8;
+        Addr page = (r >> 1) % range;
+        stream[i] = Addr(0x10000000) + (page << TheISA::PageShift);
+    }
+    return stream;
+}
+
+/// Time the stream of accesses to num_tlbs TLBs of type Memory, accesses
+/// going to the TLBs in turn. Returns the ns per access and counts hits.
+template <class Memory>
+double
+timeAccesses(const std::vector<Addr> &stream, int entries, int assoc,
+             int num_tlbs, unsigned &hits)
+{
+    std::vector<Memory*> tlbs;
+    for (int i = 0; i < num_tlbs; i++) {
+        tlbs.push_back(new Memory(entries, assoc));
+    }
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    hits = 0;
+    for (unsigned i = 0; i < stream.size(); i++) {
+        Memory *tlb = tlbs[i % num_tlbs];
+        Addr pp_base;
+        if (tlb->lookup(stream[i], 0, pp_base)) {
+            hits++;
+        } else {
+            tlb->insert(stream[i], 0, stream[i] ^ 0x1000000);
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    for (int i = 0; i < num_tlbs; i++) {
+        delete tlbs[i];
+    }
+    return elapsed.count() / stream.size();
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    const unsigned stream_length = 4000000;
+    const int geometries[][2] = {
+        // { entries, associativity }
+        { 64, 64 }, { 128, 8 }, { 512, 8 }, { 512, 16 }, { 1024, 32 },
+    };
+    const int tlb_counts[] = { 1, 32 };
+    const unsigned working_sets[] = { 48, 400, 4000 };
+    bool failed = false;
+
+    printf("%8s %6s %5s %8s %10s %12s %12s %8s\n", "entries", "assoc",
+           "TLBs", "pages", "hit rate", "AoS ns/acc", "SoA ns/acc",
+           "speedup");
+    for (unsigned g = 0; g < sizeof(geometries) / sizeof(geometries[0]);
+         g++) {
+        for (unsigned t = 0; t < sizeof(tlb_counts) / sizeof(tlb_counts[0]);
+             t++) {
+            for (unsigned w = 0;
+                 w < sizeof(working_sets) / sizeof(working_sets[0]); w++) {
+                int entries = geometries[g][0];
+                int assoc = geometries[g][1];
+                std::vector<Addr> stream = makeAccessStream(
+                    working_sets[w], stream_length, g * 7 + w);
+
+                unsigned aos_hits, soa_hits;
+                double aos_ns = timeAccesses<AoSTLBMemory>(
+                    stream, entries, assoc, tlb_counts[t], aos_hits);
+                double soa_ns = timeAccesses<TLBMemory>(
+                    stream, entries, assoc, tlb_counts[t], soa_hits);
+
+                printf("%8d %6d %5d %8d %9.2f%% %12.2f %12.2f %7.2fx\n",
+                       entries, assoc, tlb_counts[t], working_sets[w],
+                       100.0 * soa_hits / stream_length, aos_ns, soa_ns,
+                       aos_ns / soa_ns);
+                if (aos_hits != soa_hits) {
+                    printf("  MISMATCH: AoS hits %u, SoA hits %u\n",
+                           aos_hits, soa_hits);
+                    failed = true;
+                }
+            }
+        }
+    }
+
+    return failed ? 1 : 0;
+}